@@ -1,453 +1,1371 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
-#include <list>
-#include <unordered_map>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arcSnapshotFile.h"
+#include "arcTelemetry.h"
+#include "flatHashMap.h"
+#include "ghostList.h"
+#include "hashMix.h"
+#include "intrusiveList.h"
+#include "slabPool.h"
+#include "timerWheel.h"
+
+//! @brief The default weigher of ARCache: every entry weighs 1,
+//! so the capacity is the amount of entries
+struct unitWeigher {
+	template<class KeyT, class T>
+	size_t operator()(const KeyT&, const T&) const {
+		return 1;
+	}
+};
 
 //! @brief The main class that performs ARC cache algorithm
 //! @param T - the type of the currently caching data
 //! @param T1  - the LRU list for recent cache entries
 //! @param T2 - the LRU list for frequent cache entries (referred at least 2 times)
 //! @param B1 - the list of "ghost" entries that are no longer in the cash and
-//! have been removed from T1
+//! have been removed from T1 (only fingerprints of their keys, see ghostList)
 //! @param B2 - the list of "ghost" entries that are no longer in the cash and
-//! have been removed from T2
-template<class T, class KeyT = int> class ARCache {
-	std::list<T> T1;
-	std::list<T> T2;
-	std::list<T> B1;
-	std::list<T> B2;
-
-	typedef typename std::list<T>::iterator ListIt;
-	std::unordered_map<KeyT, ListIt> hash_T1;
-	std::unordered_map<KeyT, ListIt> hash_T2;
-	std::unordered_map<KeyT, ListIt> hash_B1;
-	std::unordered_map<KeyT, ListIt> hash_B2;
-
-	int c;
-	int p;
-
-	//! Change the sizes of all lists according to new value of 'p'
-	//! This function is only called in 'lookup' method
-	void setLists();
-	//! Delete some element from certain list (for T_i - delete element and put it into B_i)
-	void deleteFromT1(const T *elem);
-	void deleteFromT2(const T *elem);
-	void deleteFromB1(const T *elem);
-	void deleteFromB2(const T *elem);
-
-	void foundNowhere(const T *elem);
-	void foundT1(const T *elem);
-	void foundT2(const T *elem);
-	void foundB1();
-	void foundB2();
+//! have been removed from T2 (only fingerprints of their keys)
+//! @param Weigher - callable 'size_t(const KeyT&, const T&)' giving the weight
+//! of an entry (e.g. its size in bytes). 'c', 'p' and the bounds of all lists
+//! are measured in weights, a ghost entry keeps the weight it had in the cache.
+//! An entry heavier than the whole cache is not cached at all
+//!
+//! Resident entries live in one slab of c nodes, every node is tagged with the
+//! list it belongs to and one hash index maps a key to its node. So a hit costs
+//! one hash probe, and moving an entry between T1 and T2 is a pointer splice
+//! without any allocation or copying. Ghosts don't have nodes at all: B1 and B2
+//! keep only fingerprints, so the history of up to 2c keys is cheap in memory.
+//! With a weigher the amount of entries is not known, so the slab starts small
+//! and grows twice when it is exhausted.
+//!
+//! Entries may have a TTL in ticks of the caller's clock ('advanceTime' moves
+//! it). Expiry times are kept in a timing wheel linked through the nodes, so
+//! expiring never scans T1 or T2. An expired entry leaves its list without
+//! becoming a ghost (its expiry says nothing about the workload) and is counted
+//! apart from evictions.
+template<class T, class KeyT = int, class Weigher = unitWeigher> class ARCache {
+	//! The list the node is linked into
+	enum listId {
+		LIST_T1, LIST_T2
+	};
+
+	struct Node {
+		KeyT key;
+		std::optional<T> elem;
+
+		Node *prev;
+		Node *next;
+
+		listId list;
+		size_t weight;
+		//! The fingerprint the key gets in B1 or B2
+		uint32_t fingerprint;
+
+		//! The links of the timing wheel and the expiry time (if the entry has a TTL)
+		Node *timer_prev;
+		Node *timer_next;
+		uint64_t expires;
+		uint32_t timer_bucket;
+	};
+
+	intrusiveList<Node> T1;
+	intrusiveList<Node> T2;
+	ghostList B1;
+	ghostList B2;
+
+	//! The total weight of the nodes of each list (ghost lists count their own)
+	size_t T1_weight;
+	size_t T2_weight;
+
+	flatHashMap<KeyT, Node*> index;
+	slabPool<Node> slab;
+
+	//! Expiry times of the entries with a TTL
+	timerWheel<Node> timers;
+	//! The TTL given to the admitted entries, 0 - no TTL
+	uint64_t default_ttl;
+
+	size_t c;
+	size_t p;
+
+	Weigher weigher;
+
+	//! Event counters and the history of 'p'
+	arcTelemetry telemetry;
+
+	//! How many keys of a batch are prefetched at once
+	static constexpr size_t batch_window = 16;
+
+	//! Keeps the element when the cache has zero size
+	//! (or when the element is heavier than the cache)
+	std::optional<T> uncached;
+
+	//! Takes the entries that left the cache with the reason (may be empty)
+	std::function<void(const KeyT&, T&&, evictionReason)> evict_listener;
+
+	//! The weight of the element, at least 1
+	size_t weigh(const KeyT &key, const T &elem) const;
+
+	//! Link the node at the MRU end of the list counting its weight
+	void pushList(listId list, Node *node);
+	//! Unlink the node from its list
+	void removeList(Node *node);
+	//! Take a free node from the slab (growing it if needed), link it into
+	//! the list and the index
+	Node* newNode(const KeyT &key, uint32_t fingerprint, size_t weight,
+			listId list);
+
+	//! Free place in the cache moving LRU entries of T1 or T2 (depending on 'p')
+	//! to the corresponding ghost lists until an entry of 'weight' fits
+	//! @param in_B2 - true if the requested element was found in B2
+	void replace(bool in_B2, size_t weight);
+	//! True if 'replace' takes the entry from T1 (and from T2 otherwise)
+	bool replaceFromT1(bool in_B2) const;
+	//! Move LRU element of T_i to the top of B_i
+	void deleteFromT1();
+	void deleteFromT2();
+	//! Forget LRU element of T1 completely (when T1 takes the whole cache)
+	void dropFromT1();
+	//! Forget LRU element of B_i
+	void deleteFromB1();
+	void deleteFromB2();
+	//! Forget the oldest ghosts while the history is heavier than 2c
+	void trimGhosts();
+	//! Count the eviction of the unlinked node and give its element to the listener
+	void evictNode(Node *node, evictionReason reason);
+	//! Return the node to the slab and remove it from the index
+	void dropNode(Node *node);
+	//! Expire the node at 'ttl' ticks from now (0 - never)
+	void setTTL(Node *node, uint64_t ttl);
+	//! Remove the node whose TTL ran out from the cache
+	void expireNode(Node *node);
+	//! Forget all the entries and ghosts
+	void reset();
+	//! Build the node of the snapshot record at the LRU end of the list
+	//! @return false if the key is in the cache already
+	bool restoreNode(const uint8_t *record, listId list);
+
+	//! Start loading the index group and the ghost slots of the key
+	void prefetchBucket(const KeyT &key) const;
+	//! Find the node of the key (its index group should be loaded already) and
+	//! start loading it, nullptr if the key is not cached
+	Node* prefetchNode(const KeyT &key) const;
+	//! Load the element of the key that is not in the cache and admit it
+	template<class Loader>
+	T& loadMissing(const KeyT &key, Loader loader);
+	//! Count the finished access (dumping the snapshot if it is time)
+	void accessDone();
+	//! Count the miss of the element that is too heavy to be cached
+	void uncachedMiss();
+	//! Keep the element the cache can't take (zero size or heavier than the
+	//! cache) for the caller, the listener gets a copy as evicted at once
+	T& keepUncached(const KeyT &key, T &&elem);
+
+	//! Find the node of the resident key, nullptr if there is none
+	Node* findNode(const KeyT &key);
+	//! Move the resident node according to ARC on a hit
+	void touch(Node *node);
+	//! Make place for the missed key and link its node into T1 or T2
+	//! (T2 if the key is a ghost), the caller puts the element into the returned node
+	//! @param weight - the weight of the element (not greater than 'c')
+	Node* admit(const KeyT &key, size_t weight);
+	//! Change the weight of the resident node that was just touched
+	//! (evicting other entries if the cache becomes too heavy)
+	void reweigh(Node *node, size_t weight);
+
+	Node* foundNowhere(const KeyT &key, uint32_t fingerprint, size_t weight);
+	void foundT1(Node *node);
+	void foundT2(Node *node);
+	Node* foundB1(const KeyT &key, uint32_t fingerprint, size_t weight);
+	Node* foundB2(const KeyT &key, uint32_t fingerprint, size_t weight);
 
 	bool isOK();
 public:
-	ARCache(size_t cache_size);
+	ARCache(size_t cache_size, Weigher weigher = Weigher());
 
 	//! Print all the lists that ARC uses (for debug only)
 	void printLists();
 	//! Looks if the given element is in the cache and doing ARC algorithm
+	//! (the element is copied into the cache on a miss)
 	bool lookup(const T *elem);
+
+	//! @brief Returns the cached element of the key. On a miss the element is
+	//! loaded with 'loader(key)' (called exactly once) and moved into the cache
+	//! @param loader - callable taking the key and returning T
+	//! @return reference valid until the next access to the cache
+	template<class Loader>
+	T& get_or_load(const KeyT &key, Loader loader);
+	//! Move the element into the cache (replacing the cached one), counts as an access
+	T& insert(const KeyT &key, T &&elem);
+	//! The same, the entry expires in 'ttl' ticks (0 - never)
+	T& insert(const KeyT &key, T &&elem, uint64_t ttl);
+	//! @brief Move the element of a key that is not resident into T2, like a key
+	//! seen twice. Neither an access nor a ghost hit is counted and 'p' stays:
+	//! the entry comes back from another cache (a level of a hierarchy) where
+	//! it was hit. A resident key is inserted as by 'insert'
+	T& insertFrequent(const KeyT &key, T &&elem);
+	//! @brief Looks up the batch of keys with exactly the same result as
+	//! 'get_or_load' called for every key in order. The keys are hashed and
+	//! their index entries, nodes and ghost slots are prefetched 'batch_window'
+	//! keys ahead, so the cache misses of the probes overlap. Every key is
+	//! probed in the index once, the node found is used unless an earlier
+	//! access of the window evicted it
+	//! @param hits - true is written for every key found in the cache
+	template<class Loader>
+	void lookup_batch(const KeyT *keys, size_t count, bool *hits,
+			Loader loader);
+
+	//! Returns the cached element of the key doing ARC algorithm for a hit,
+	//! nullptr on a miss (the cache is not changed then)
+	T* find(const KeyT &key);
+	//! The key that would be evicted first if a key the cache knows nothing about
+	//! (not in any list) was admitted now, nullptr if nothing would be evicted
+	const KeyT* victim(size_t weight = 1) const;
+
+	//! The total weight of the resident entries
+	size_t weight() const;
+
+	//! @brief Remove the resident entry from the cache and return its element
+	//! (empty if the key is not resident), the caller moves it somewhere else.
+	//! The key becomes a ghost of its list like an evicted one, but neither
+	//! an access nor an eviction is counted
+	//! @param ghost - false forgets the key at once: the entry is moved into
+	//! another cache (a level of a hierarchy), so when it comes back here it
+	//! was not evicted by this cache and must not be taken for a ghost hit
+	std::optional<T> extract(const KeyT &key, bool ghost = true);
+	//! @brief Call 'listener(key, elem, reason)' for every entry evicted to make
+	//! place or expired, right before the entry is forgotten (the element may be
+	//! moved out). An element the cache can't take (the cache has zero size or
+	//! the element is heavier than the cache) is reported at once as evicted to
+	//! make place, with a copy of it. It is not called for extracted or replaced
+	//! elements. The listener runs on the lookup path and must not access this
+	//! cache, slow cleanup may be handed over to a background thread with
+	//! evictionQueue
+	void setEvictionListener(
+			std::function<void(const KeyT&, T&&, evictionReason)> listener);
+	//! @brief The same for the entries evicted to make place only (not expired),
+	//! the handler is called without the reason. Replaces the listener
+	void setEvictionHandler(std::function<void(const KeyT&, T&&)> handler);
+
+	//! The TTL of the entries admitted by 'lookup', 'get_or_load' and 'insert'
+	//! without a TTL (0 - they never expire). A hit doesn't renew the TTL
+	void setDefaultTTL(uint64_t ttl);
+	//! Move the clock to 'now' (not less than before) expiring the entries
+	//! whose TTL ran out
+	void advanceTime(uint64_t now);
+
+	//! @brief Write the whole state (the lists in their order, 'p' and 'c') into
+	//! the binary snapshot file, see arcSnapshotFile.h. Event counters are not saved
+	//! @return false if the file can't be written
+	bool save(const char *path) const;
+	//! @brief Restore the state written by 'save' into this empty cache of the
+	//! same 'c'. The file is mapped and the lists, the index and the slab are
+	//! built in bulk without going through the ARC transitions
+	//! @return false if the file is broken or doesn't fit the cache
+	//! (the cache stays empty then)
+	bool restore(const char *path);
+
+	//! Event counters (merged from all threads), sizes of the lists
+	//! and the sampled history of 'p'
+	arcSnapshot snapshot() const;
+	//! Write the snapshot as a JSON line into 'out' every 'period' accesses
+	//! (nullptr or zero period stops dumping)
+	void setTelemetryDump(std::ostream *out, size_t period);
 };
 
-template<class T, class KeyT>
-inline ARCache<T, KeyT>::ARCache(size_t cache_size) :
-		c(cache_size), p(0) {
+template<class T, class KeyT, class Weigher>
+inline ARCache<T, KeyT, Weigher>::ARCache(size_t cache_size, Weigher weigher) :
+		T1_weight(0), T2_weight(0), slab(
+				std::is_same<Weigher, unitWeigher>::value ?
+						cache_size : std::min<size_t>(cache_size, 1024)), default_ttl(
+				0), c(cache_size), p(0), weigher(weigher) {
+	index.reserve(slab.max_size());
+}
+
+template<class T, class KeyT, class Weigher>
+inline size_t ARCache<T, KeyT, Weigher>::weigh(const KeyT &key,
+		const T &elem) const {
+	return std::max<size_t>(1, weigher(key, elem));
 }
 
-template<class T, class KeyT>
-inline bool ARCache<T, KeyT>::lookup(const T *elem) {
+template<class T, class KeyT, class Weigher>
+inline size_t ARCache<T, KeyT, Weigher>::weight() const {
+	return T1_weight + T2_weight;
+}
+
+template<class T, class KeyT, class Weigher>
+inline bool ARCache<T, KeyT, Weigher>::lookup(const T *elem) {
 	assert(elem);
 
+	if (c == 0)
+		return false;
+
+	Node *node = findNode(elem->id);
+
+	if (node != nullptr) {
+		touch(node);
+		return true;
+	}
+
+	size_t weight_ = weigh(elem->id, *elem);
+
+	// Too heavy to be cached
+	if (weight_ > c) {
+		uncachedMiss();
+		return false;
+	}
+
+	node = admit(elem->id, weight_);
+	node->elem.emplace(*elem);
+	setTTL(node, default_ttl);
+
+	return false;
+}
+
+template<class T, class KeyT, class Weigher>
+template<class Loader>
+inline T& ARCache<T, KeyT, Weigher>::get_or_load(const KeyT &key,
+		Loader loader) {
+	if (c == 0)
+		return keepUncached(key, loader(key));
+
+	Node *node = findNode(key);
+
+	if (node != nullptr) {
+		touch(node);
+		return *node->elem;
+	}
+
+	return loadMissing(key, loader);
+}
+
+template<class T, class KeyT, class Weigher>
+template<class Loader>
+inline T& ARCache<T, KeyT, Weigher>::loadMissing(const KeyT &key,
+		Loader loader) {
+	// Load before touching the lists, so a throwing loader changes nothing
+	T elem_ = loader(key);
+	size_t weight_ = weigh(key, elem_);
+
+	if (weight_ > c) {
+		uncachedMiss();
+
+		return keepUncached(key, std::move(elem_));
+	}
+
+	Node *node = admit(key, weight_);
+	node->elem.emplace(std::move(elem_));
+	setTTL(node, default_ttl);
+
+	return *node->elem;
+}
+
+template<class T, class KeyT, class Weigher>
+inline T& ARCache<T, KeyT, Weigher>::insert(const KeyT &key, T &&elem) {
+	return insert(key, std::move(elem), default_ttl);
+}
+
+template<class T, class KeyT, class Weigher>
+inline T& ARCache<T, KeyT, Weigher>::insertFrequent(const KeyT &key,
+		T &&elem) {
+	size_t weight_ = (c == 0) ? 0 : weigh(key, elem);
+
+	if (c == 0 || weight_ > c || findNode(key) != nullptr)
+		return insert(key, std::move(elem));
+
+	// T1 doesn't grow, so only the whole history may be full
+	if (T1_weight + T2_weight + B1.weight() + B2.weight() + weight_ > c) {
+		while (T1_weight + T2_weight + B1.weight() + B2.weight() + weight_ > 2 * c
+				&& !B2.empty())
+			deleteFromB2();
+
+		replace(false, weight_);
+	}
+
+	Node *node = newNode(key, ghostList::fingerprint(hashKey(key)), weight_,
+			LIST_T2);
+	trimGhosts();
+
+	node->elem.emplace(std::move(elem));
+	setTTL(node, default_ttl);
+
+	return *node->elem;
+}
+
+template<class T, class KeyT, class Weigher>
+inline T& ARCache<T, KeyT, Weigher>::insert(const KeyT &key, T &&elem,
+		uint64_t ttl) {
+	if (c == 0)
+		return keepUncached(key, std::move(elem));
+
+	Node *node = findNode(key);
+	size_t weight_ = weigh(key, elem);
+
+	if (node != nullptr) {
+		touch(node);
+
+		if (weight_ > c) {
+			// The new element is too heavy, the old one leaves the cache
+			removeList(node);
+			evictNode(node, EVICT_CAPACITY);
+			dropNode(node);
+
+			return keepUncached(key, std::move(elem));
+		}
+
+		reweigh(node, weight_);
+		*node->elem = std::move(elem);
+		// The new element lives the whole TTL
+		setTTL(node, ttl);
+
+		return *node->elem;
+	}
+
+	if (weight_ > c) {
+		uncachedMiss();
+
+		return keepUncached(key, std::move(elem));
+	}
+
+	node = admit(key, weight_);
+	node->elem.emplace(std::move(elem));
+	setTTL(node, ttl);
+
+	return *node->elem;
+}
+
+template<class T, class KeyT, class Weigher>
+template<class Loader>
+inline void ARCache<T, KeyT, Weigher>::lookup_batch(const KeyT *keys,
+		size_t count, bool *hits, Loader loader) {
+	assert(keys || count == 0);
+	assert(hits || count == 0);
+
+	Node *nodes_[batch_window];
+
+	for (size_t start = 0; start < count; start += batch_window) {
+		size_t end_ = std::min(count, start + batch_window);
+
+		// The probes are independent, so the CPU overlaps their misses.
+		// Every step needs the memory loaded by the previous one
+		for (size_t i = start; i < end_; i++)
+			prefetchBucket(keys[i]);
+
+		for (size_t i = start; i < end_; i++)
+			nodes_[i - start] = prefetchNode(keys[i]);
+
+		// The accesses of the window change the cache: a node found before is
+		// still the key's one only if it keeps the key and the element (a
+		// released node has no element), a key not found is still missing
+		// unless the window loaded it before
+		for (size_t i = start; i < end_; i++) {
+			Node *node = nodes_[i - start];
+
+			if (node != nullptr && node->elem && node->key == keys[i]) {
+				touch(node);
+				hits[i] = true;
+
+				continue;
+			}
+
+			bool repeated_ = false;
+
+			for (size_t j = start; j < i && !repeated_; j++)
+				repeated_ = keys[j] == keys[i];
+
+			if (node == nullptr && !repeated_ && c != 0) {
+				loadMissing(keys[i], loader);
+				hits[i] = false;
+
+				continue;
+			}
+
+			bool hit_ = true;
+
+			get_or_load(keys[i], [&](const KeyT &key) {
+				hit_ = false;
+				return loader(key);
+			});
+
+			hits[i] = hit_;
+		}
+	}
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::prefetchBucket(const KeyT &key) const {
+	index.prefetch(key);
+
+	// A miss looks at the ghosts
+	uint32_t fingerprint_ = ghostList::fingerprint(hashKey(key));
+
+	B1.prefetch(fingerprint_);
+	B2.prefetch(fingerprint_);
+}
+
+template<class T, class KeyT, class Weigher>
+inline typename ARCache<T, KeyT, Weigher>::Node* ARCache<T, KeyT, Weigher>::prefetchNode(
+		const KeyT &key) const {
+	auto hit = index.find(key);
+
+	if (hit == index.end())
+		return nullptr;
+
+	__builtin_prefetch(hit->second);
+
+	return hit->second;
+}
+
+template<class T, class KeyT, class Weigher>
+inline typename ARCache<T, KeyT, Weigher>::Node* ARCache<T, KeyT, Weigher>::findNode(
+		const KeyT &key) {
 	if (!isOK()) {
 		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
 		std::cerr << "Wrong size of the list!\n";
 		exit(-1);
 	}
 
-	auto hit = hash_T2.find(elem->id);
+	auto hit = index.find(key);
 
-	if (hit != hash_T2.end()) {
-		foundT2(elem);
-		return true;
+	if (hit == index.end())
+		return nullptr;
+
+	return hit->second;
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::touch(Node *node) {
+	assert(node);
+
+	if (node->list == LIST_T1) {
+		telemetry.record(EVENT_HIT_T1);
+		foundT1(node);
+	} else {
+		telemetry.record(EVENT_HIT_T2);
+		foundT2(node);
 	}
 
-	hit = hash_T1.find(elem->id);
+	accessDone();
+}
+
+template<class T, class KeyT, class Weigher>
+inline typename ARCache<T, KeyT, Weigher>::Node* ARCache<T, KeyT, Weigher>::admit(
+		const KeyT &key, size_t weight) {
+	assert(weight <= c);
 
-	if (hit != hash_T1.end()) {
-		foundT1(elem);
-		return true;
+	uint32_t fingerprint_ = ghostList::fingerprint(hashKey(key));
+	Node *node;
+
+	telemetry.record(EVENT_MISS);
+
+	if (B1.contains(fingerprint_)) {
+		telemetry.record(EVENT_GHOST_B1);
+		node = foundB1(key, fingerprint_, weight);
+	} else if (B2.contains(fingerprint_)) {
+		telemetry.record(EVENT_GHOST_B2);
+		node = foundB2(key, fingerprint_, weight);
+	} else {
+		node = foundNowhere(key, fingerprint_, weight);
 	}
 
-	hit = hash_B1.find(elem->id);
+	accessDone();
+
+	return node;
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::uncachedMiss() {
+	telemetry.record(EVENT_MISS);
+	accessDone();
+}
+
+template<class T, class KeyT, class Weigher>
+inline T& ARCache<T, KeyT, Weigher>::keepUncached(const KeyT &key, T &&elem) {
+	uncached.emplace(std::move(elem));
+
+	if (evict_listener)
+		evict_listener(key, T(*uncached), EVICT_CAPACITY);
 
-	if (hit != hash_B1.end()) {
-		foundB1();
+	return *uncached;
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::accessDone() {
+	if (!telemetry.access(p))
+		return;
+
+	std::ostream &dump_ = *telemetry.dumpStream();
+
+	writeJSON(dump_, snapshot());
+	dump_ << "\n";
+}
+
+template<class T, class KeyT, class Weigher>
+inline arcSnapshot ARCache<T, KeyT, Weigher>::snapshot() const {
+	arcSnapshot snapshot_;
+
+	snapshot_.accesses = telemetry.accesses_count();
+	snapshot_.hits_T1 = telemetry.count(EVENT_HIT_T1);
+	snapshot_.hits_T2 = telemetry.count(EVENT_HIT_T2);
+	snapshot_.ghost_hits_B1 = telemetry.count(EVENT_GHOST_B1);
+	snapshot_.ghost_hits_B2 = telemetry.count(EVENT_GHOST_B2);
+	snapshot_.misses = telemetry.count(EVENT_MISS);
+	snapshot_.evictions = telemetry.count(EVENT_EVICTION);
+	snapshot_.expirations = telemetry.count(EVENT_EXPIRATION);
+
+	snapshot_.c = c;
+	snapshot_.p = p;
+	snapshot_.T1_size = T1.size();
+	snapshot_.T2_size = T2.size();
+	snapshot_.B1_size = B1.size();
+	snapshot_.B2_size = B2.size();
+
+	snapshot_.p_history = telemetry.history();
+
+	return snapshot_;
+}
+
+template<class T, class KeyT, class Weigher>
+inline bool ARCache<T, KeyT, Weigher>::save(const char *path) const {
+	static_assert(std::is_trivially_copyable<T>::value
+			&& std::is_trivially_copyable<KeyT>::value,
+			"Snapshots keep elements and keys as they are in memory");
+
+	std::ofstream output_(path, std::ios::binary);
+
+	if (!output_)
 		return false;
+
+	arcFileHeader header_;
+
+	std::memcpy(header_.magic, detail::arc_magic, 4);
+	header_.version = detail::arc_version;
+	header_.key_size = sizeof(KeyT);
+	header_.elem_size = sizeof(T);
+	header_.c = c;
+	header_.p = p;
+	header_.T1_count = T1.size();
+	header_.T2_count = T2.size();
+	header_.B1_count = B1.size();
+	header_.B2_count = B2.size();
+
+	output_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+
+	std::vector<uint8_t> record_(sizeof(KeyT) + sizeof(T) + 2 * sizeof(uint64_t));
+
+	for (const intrusiveList<Node> *list : { &T1, &T2 }) {
+		for (Node *node = list->front(); node != nullptr; node = node->next) {
+			uint64_t weight_ = node->weight;
+			uint64_t ttl_ = (node->timer_bucket != timerWheel<Node>::unscheduled) ?
+					node->expires - timers.now() : 0;
+
+			uint8_t *field_ = record_.data();
+
+			std::memcpy(field_, &node->key, sizeof(KeyT));
+			field_ += sizeof(KeyT);
+			std::memcpy(field_, &*node->elem, sizeof(T));
+			field_ += sizeof(T);
+			std::memcpy(field_, &weight_, sizeof(weight_));
+			field_ += sizeof(weight_);
+			std::memcpy(field_, &ttl_, sizeof(ttl_));
+
+			output_.write(reinterpret_cast<const char*>(record_.data()),
+					record_.size());
+		}
 	}
 
-	hit = hash_B2.find(elem->id);
+	for (const ghostList *list : { &B1, &B2 }) {
+		list->forEach([&](uint32_t fingerprint, size_t weight) {
+			uint32_t ghost_[2] = { fingerprint, static_cast<uint32_t>(weight) };
+
+			output_.write(reinterpret_cast<const char*>(ghost_), sizeof(ghost_));
+		});
+	}
 
-	if (hit != hash_T1.end()) {
-		foundB2();
+	return bool(output_);
+}
+
+template<class T, class KeyT, class Weigher>
+inline bool ARCache<T, KeyT, Weigher>::restoreNode(const uint8_t *record,
+		listId list) {
+	KeyT key_;
+	uint64_t weight_;
+	uint64_t ttl_;
+	alignas(T) uint8_t elem_[sizeof(T)];
+
+	std::memcpy(&key_, record, sizeof(KeyT));
+	record += sizeof(KeyT);
+	std::memcpy(elem_, record, sizeof(T));
+	record += sizeof(T);
+	std::memcpy(&weight_, record, sizeof(weight_));
+	record += sizeof(weight_);
+	std::memcpy(&ttl_, record, sizeof(ttl_));
+
+	Node *node = slab.acquire();
+	assert(node);
+
+	if (!index.emplace(key_, node).second) {
+		slab.release(node);
 		return false;
 	}
 
-	foundNowhere(elem);
+	node->key = key_;
+	node->elem.emplace(*reinterpret_cast<const T*>(elem_));
+	node->weight = weight_;
+	node->fingerprint = ghostList::fingerprint(hashKey(key_));
+	node->timer_bucket = timerWheel<Node>::unscheduled;
+	node->list = list;
+
+	// The records go from the MRU end, so every node is the LRU one so far
+	if (list == LIST_T1) {
+		T1.push_back(node);
+		T1_weight += node->weight;
+	} else {
+		T2.push_back(node);
+		T2_weight += node->weight;
+	}
 
-	return false;
+	setTTL(node, ttl_);
+
+	return true;
 }
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::setLists() {
-	if (p > T1.size()) {
-		// We increased the size of the T1 list
-		// The size of T2 must be reduced, and all
-		// deleted elements will be put into B2
+template<class T, class KeyT, class Weigher>
+inline bool ARCache<T, KeyT, Weigher>::restore(const char *path) {
+	static_assert(std::is_trivially_copyable<T>::value
+			&& std::is_trivially_copyable<KeyT>::value,
+			"Snapshots keep elements and keys as they are in memory");
 
-		if (T2.size() > (c - p)) {
-			// If there are elements to be thrown away
+	if (!T1.empty() || !T2.empty() || !B1.empty() || !B2.empty()) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The snapshot is restored only into the empty cache\n";
 
-			int boundary_ = p - T1.size();
-			boundary_ = std::min(boundary_, (int) B1.size());
+		return false;
+	}
 
-			for (int i = 0; i < boundary_; i++) {
-				ListIt iterator_ = std::prev(T2.end());
+	int fd_ = ::open(path, O_RDONLY);
+	if (fd_ < 0)
+		return false;
 
-				T2.erase(iterator_);
-				hash_T2.erase(iterator_->id);
+	struct stat stat_;
+	if (fstat(fd_, &stat_) < 0
+			|| (size_t) stat_.st_size < sizeof(arcFileHeader)) {
+		close(fd_);
+		return false;
+	}
 
-				// If B2 list is full
-				if (B2.size() == c) {
-					ListIt iterator_ = std::prev(B2.end());
+	size_t file_size_ = stat_.st_size;
+	void *file_ = mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+	close(fd_);
 
-					deleteFromB2(&(*iterator_));
-				}
+	if (file_ == MAP_FAILED)
+		return false;
 
-				B2.push_front(*iterator_);
-				hash_B2[iterator_->id] = B2.begin();
-			}
+	madvise(file_, file_size_, MADV_SEQUENTIAL);
 
-			for (int i = 0; i < boundary_; i++) {
-				ListIt iterator_ = B1.begin();
+	const uint8_t *bytes_ = static_cast<const uint8_t*>(file_);
+	arcFileHeader header_;
 
-				// Add to T1
-				T1.push_front(*iterator_);
-				hash_T1[iterator_->id] = T1.begin();
+	std::memcpy(&header_, bytes_, sizeof(header_));
 
-				// Delete from B1
-				deleteFromB1(&(*iterator_));
-			}
-		}
-	} else if (p < T1.size()) {
-		int boundary_ = -p + T1.size();
-		boundary_ = std::min(boundary_, (int) B2.size());
+	size_t record_size_ = sizeof(KeyT) + sizeof(T) + 2 * sizeof(uint64_t);
+	size_t records_ = (file_size_ - sizeof(header_)) / record_size_;
+	size_t ghosts_ = (file_size_ - sizeof(header_)) / detail::ghost_record_size;
+
+	if (std::memcmp(header_.magic, detail::arc_magic, 4)
+			|| header_.version != detail::arc_version
+			|| header_.key_size != sizeof(KeyT) || header_.elem_size != sizeof(T)
+			|| header_.c != c || header_.p > c || header_.T1_count > records_
+			|| header_.T2_count > records_ - header_.T1_count
+			|| header_.B1_count > ghosts_ || header_.B2_count > ghosts_
+			|| (header_.T1_count + header_.T2_count) * record_size_
+					+ (header_.B1_count + header_.B2_count)
+							* detail::ghost_record_size
+					> file_size_ - sizeof(header_)) {
+		munmap(file_, file_size_);
+		return false;
+	}
 
-		for (int i = 0; i < boundary_; i++) {
-			ListIt iterator_ = std::prev(T1.end());
+	size_t residents_ = header_.T1_count + header_.T2_count;
 
-			T1.erase(iterator_);
-			hash_T1.erase(iterator_->id);
+	// All the nodes are taken from the slab at once
+	if (residents_ > slab.max_size())
+		slab.grow(residents_ - slab.max_size());
 
-			// If B1 list is full
-			if (B1.size() == c) {
-				ListIt iterator_ = std::prev(B1.end());
+	index.reserve(residents_);
 
-				deleteFromB1(&(*iterator_));
-			}
+	const uint8_t *record_ = bytes_ + sizeof(header_);
+	bool valid_ = true;
+
+	for (size_t start = 0; start < residents_ && valid_; start += batch_window) {
+		size_t end_ = std::min(residents_, start + batch_window);
 
-			B1.push_front(*iterator_);
-			hash_B1[iterator_->id] = B1.begin();
+		// The index slots of the records are random, their misses overlap
+		for (size_t i = start; i < end_; i++) {
+			KeyT key_;
+
+			std::memcpy(&key_, record_ + (i - start) * record_size_, sizeof(KeyT));
+			index.prefetch(key_);
 		}
 
-		for (int i = 0; i < boundary_; i++) {
-			ListIt iterator_ = B2.begin();
+		for (size_t i = start; i < end_ && valid_; i++, record_ += record_size_)
+			valid_ = restoreNode(record_,
+					(i < header_.T1_count) ? LIST_T1 : LIST_T2);
+	}
+
+	// The ghosts go from the newest one, so they are pushed from the end
+	for (ghostList *list : { &B1, &B2 }) {
+		size_t count_ = (list == &B1) ? header_.B1_count : header_.B2_count;
+
+		for (size_t i = count_; i-- > 0 && valid_;) {
+			uint32_t ghost_[2];
+
+			std::memcpy(ghost_, record_ + i * detail::ghost_record_size,
+					sizeof(ghost_));
+			list->push_front(ghost_[0], ghost_[1]);
+		}
+
+		record_ += count_ * detail::ghost_record_size;
+	}
+
+	munmap(file_, file_size_);
 
-			// Add to T2
-			T2.push_front(*iterator_);
-			hash_T2[iterator_->id] = T2.begin();
+	p = header_.p;
 
-			// Delete from B2
-			deleteFromB2(&(*iterator_));
+	if (!valid_ || !isOK()) {
+		reset();
+		return false;
+	}
+
+	return true;
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::reset() {
+	for (intrusiveList<Node> *list : { &T1, &T2 }) {
+		while (!list->empty()) {
+			Node *node = list->back();
+
+			removeList(node);
+			dropNode(node);
 		}
 	}
 
-	// If 'p' didn't change, do nothing
+	while (!B1.empty())
+		deleteFromB1();
+
+	while (!B2.empty())
+		deleteFromB2();
+
+	p = 0;
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::setTelemetryDump(std::ostream *out,
+		size_t period) {
+	telemetry.setDump(out, period);
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::reweigh(Node *node, size_t weight) {
+	assert(node && node->list == LIST_T2);
+
+	T2_weight = T2_weight - node->weight + weight;
+	node->weight = weight;
+
+	// The node is at the top of T2, so it is evicted only if it is alone there
+	while (T1_weight + T2_weight > c) {
+		if (!T1.empty() && (replaceFromT1(false) || T2.back() == node))
+			deleteFromT1();
+		else
+			deleteFromT2();
+	}
+
+	trimGhosts();
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::pushList(listId list, Node *node) {
+	assert(node);
+
+	node->list = list;
+
+	switch (list) {
+	case LIST_T1:
+		T1.push_front(node);
+		T1_weight += node->weight;
+		break;
+	case LIST_T2:
+		T2.push_front(node);
+		T2_weight += node->weight;
+		break;
+	}
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::removeList(Node *node) {
+	assert(node);
+
+	switch (node->list) {
+	case LIST_T1:
+		T1.remove(node);
+		T1_weight -= node->weight;
+		break;
+	case LIST_T2:
+		T2.remove(node);
+		T2_weight -= node->weight;
+		break;
+	}
+}
+
+template<class T, class KeyT, class Weigher>
+inline typename ARCache<T, KeyT, Weigher>::Node* ARCache<T, KeyT, Weigher>::newNode(
+		const KeyT &key, uint32_t fingerprint, size_t weight, listId list) {
+	Node *node = slab.acquire();
+
+	if (node == nullptr) {
+		slab.grow(std::max<size_t>(1, slab.max_size()));
+		node = slab.acquire();
+	}
+
+	assert(node);
+
+	node->key = key;
+	node->weight = weight;
+	node->fingerprint = fingerprint;
+	node->timer_bucket = timerWheel<Node>::unscheduled;
+
+	pushList(list, node);
+
+	index.emplace(node->key, node);
+
+	return node;
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::replace(bool in_B2, size_t weight) {
+	// Loops until there is enough free space in the cache
+	while (T1_weight + T2_weight + weight > c && !(T1.empty() && T2.empty())) {
+		if (replaceFromT1(in_B2))
+			deleteFromT1();
+		else
+			deleteFromT2();
+	}
+}
+
+template<class T, class KeyT, class Weigher>
+inline bool ARCache<T, KeyT, Weigher>::replaceFromT1(bool in_B2) const {
+	if (!T1.empty() && (T1_weight > p || (in_B2 && T1_weight == p)))
+		return true;
+
+	return T2.empty();
 }
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::printLists() {
+template<class T, class KeyT, class Weigher>
+inline T* ARCache<T, KeyT, Weigher>::find(const KeyT &key) {
+	if (c == 0)
+		return nullptr;
+
+	Node *node = findNode(key);
+
+	if (node == nullptr)
+		return nullptr;
+
+	touch(node);
+
+	return &*node->elem;
+}
+
+template<class T, class KeyT, class Weigher>
+inline std::optional<T> ARCache<T, KeyT, Weigher>::extract(const KeyT &key,
+		bool ghost) {
+	std::optional<T> elem_;
+
+	if (c == 0)
+		return elem_;
+
+	Node *node = findNode(key);
+
+	if (node == nullptr)
+		return elem_;
+
+	elem_.emplace(std::move(*node->elem));
+
+	// The key is remembered like an evicted one, so ARC adapts when it comes back
+	// (unless the entry only moves to another level)
+	removeList(node);
+
+	if (ghost) {
+		if (node->list == LIST_T1)
+			B1.push_front(node->fingerprint, node->weight);
+		else
+			B2.push_front(node->fingerprint, node->weight);
+	}
+
+	dropNode(node);
+
+	return elem_;
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::setEvictionListener(
+		std::function<void(const KeyT&, T&&, evictionReason)> listener) {
+	evict_listener = std::move(listener);
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::setEvictionHandler(
+		std::function<void(const KeyT&, T&&)> handler) {
+	if (!handler) {
+		evict_listener = nullptr;
+		return;
+	}
+
+	evict_listener = [handler = std::move(handler)](const KeyT &key, T &&elem,
+			evictionReason reason) {
+		if (reason != EVICT_TTL)
+			handler(key, std::move(elem));
+	};
+}
+
+template<class T, class KeyT, class Weigher>
+inline const KeyT* ARCache<T, KeyT, Weigher>::victim(size_t weight) const {
+	// The same cases as in 'foundNowhere'
+	if (T1_weight + B1.weight() + weight > c) {
+		// Forgetting all of B1 is not enough - T1 takes the whole cache
+		if (T1_weight + weight > c)
+			return T1.empty() ? nullptr : &T1.back()->key;
+	} else if (T1_weight + T2_weight + B1.weight() + B2.weight() + weight <= c) {
+		return nullptr;
+	}
+
+	// 'replace' doesn't evict anything until the cache is full
+	if (T1_weight + T2_weight + weight <= c)
+		return nullptr;
+
+	return replaceFromT1(false) ? &T1.back()->key : &T2.back()->key;
+}
+
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::printLists() {
 	std::cout << "================\n";
 
 	std::cout << "T1: ";
-	for (auto elem : T1) {
-		std::cout << elem.data << " ";
+	for (Node *node = T1.front(); node != nullptr; node = node->next) {
+		std::cout << node->elem->data << " ";
 	}
 
 	std::cout << "\n";
 
 	std::cout << "T2: ";
-	for (auto elem : T2) {
-		std::cout << elem.data << " ";
+	for (Node *node = T2.front(); node != nullptr; node = node->next) {
+		std::cout << node->elem->data << " ";
 	}
 
 	std::cout << "\n";
 
+	// Ghost entries don't keep the data nor keys, only fingerprints
 	std::cout << "B1: ";
-	for (auto elem : B1) {
-		std::cout << elem.data << " ";
-	}
+	B1.forEach([](uint32_t fingerprint, size_t) {
+		std::cout << std::hex << fingerprint << std::dec << " ";
+	});
 
 	std::cout << "\n";
 
 	std::cout << "B2: ";
-	for (auto elem : B2) {
-		std::cout << elem.data << " ";
-	}
+	B2.forEach([](uint32_t fingerprint, size_t) {
+		std::cout << std::hex << fingerprint << std::dec << " ";
+	});
 
 	std::cout << "\n";
 
 	std::cout << "c = " << c << "\n";
 	std::cout << "p = " << p << "\n";
-	std::cout << "T1.size() = " << T1.size() << "\n";
-	std::cout << "T2.size() = " << T2.size() << "\n";
-	std::cout << "B1.size() = " << B1.size() << "\n";
-	std::cout << "B2.size() = " << B2.size() << "\n";
+	std::cout << "T1.size() = " << T1.size() << ", weight = " << T1_weight << "\n";
+	std::cout << "T2.size() = " << T2.size() << ", weight = " << T2_weight << "\n";
+	std::cout << "B1.size() = " << B1.size() << ", weight = " << B1.weight() << "\n";
+	std::cout << "B2.size() = " << B2.size() << ", weight = " << B2.weight() << "\n";
 
 	std::cout << "================\n";
 }
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::deleteFromT1(const T *elem) {
-	assert(elem);
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::deleteFromT1() {
+	Node *node = T1.back();
+	assert(node);
 
-	auto pair_ = hash_T1.find(elem->id);
+	removeList(node);
+	B1.push_front(node->fingerprint, node->weight);
 
-	if (pair_ == hash_T1.end()) {
-		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
-		std::cerr << "Can't find the element " << elem << " in T1!\n";
+	evictNode(node, EVICT_CAPACITY);
+	dropNode(node);
+}
 
-		exit(-1);
-	}
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::deleteFromT2() {
+	Node *node = T2.back();
+	assert(node);
 
-	hash_T1.erase(elem->id);
-	T1.erase(pair_->second);
+	removeList(node);
+	B2.push_front(node->fingerprint, node->weight);
 
-	// If B1 list is full
-	if (B1.size() == c) {
-		ListIt iterator_ = std::prev(B1.end());
+	evictNode(node, EVICT_CAPACITY);
+	dropNode(node);
+}
 
-		deleteFromB1(&(*iterator_));
-	}
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::dropFromT1() {
+	Node *node = T1.back();
+	assert(node);
 
-	B1.push_front(*elem);
-	hash_B1[elem->id] = B1.begin();
+	removeList(node);
+	evictNode(node, EVICT_GHOST_TRIM);
+	dropNode(node);
+}
 
-	p--;
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::deleteFromB1() {
+	B1.pop_back();
 }
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::deleteFromT2(const T *elem) {
-	assert(elem);
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::deleteFromB2() {
+	B2.pop_back();
+}
 
-	auto pair_ = hash_T2.find(elem->id);
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::trimGhosts() {
+	while (T1_weight + T2_weight + B1.weight() + B2.weight() > 2 * c
+			&& !(B1.empty() && B2.empty())) {
+		if (!B2.empty())
+			deleteFromB2();
+		else
+			deleteFromB1();
+	}
+}
 
-	if (pair_ == hash_T2.end()) {
-		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
-		std::cerr << "Can't find the element " << elem << " in T2!\n";
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::evictNode(Node *node,
+		evictionReason reason) {
+	assert(node);
 
-		exit(-1);
-	}
+	telemetry.record((reason == EVICT_TTL) ? EVENT_EXPIRATION : EVENT_EVICTION);
 
-	hash_T2.erase(elem->id);
-	T2.erase(pair_->second);
+	if (evict_listener)
+		evict_listener(node->key, std::move(*node->elem), reason);
+}
 
-	// If B2 list is full
-	if (B2.size() == c) {
-		ListIt iterator_ = std::prev(B2.end());
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::dropNode(Node *node) {
+	assert(node);
 
-		deleteFromB2(&(*iterator_));
-	}
+	index.erase(node->key);
 
-	B2.push_front(*elem);
-	hash_B2[elem->id] = B2.begin();
+	if (node->timer_bucket != timerWheel<Node>::unscheduled)
+		timers.cancel(node);
 
-	p++;
+	node->elem.reset();
+	slab.release(node);
 }
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::deleteFromB1(const T *elem) {
-	assert(elem);
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::setTTL(Node *node, uint64_t ttl) {
+	assert(node);
 
-	ListIt iterator_ = hash_B1.find(elem->id)->second;
+	if (node->timer_bucket != timerWheel<Node>::unscheduled)
+		timers.cancel(node);
 
-	hash_B1.erase(elem->id);
-	B1.erase(iterator_);
+	if (ttl != 0)
+		timers.schedule(node, timers.now() + ttl);
 }
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::deleteFromB2(const T *elem) {
-	assert(elem);
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::expireNode(Node *node) {
+	assert(node);
 
-	ListIt iterator_ = hash_B2.find(elem->id)->second;
+	removeList(node);
+	evictNode(node, EVICT_TTL);
+	dropNode(node);
+}
 
-	hash_B2.erase(elem->id);
-	B2.erase(iterator_);
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::setDefaultTTL(uint64_t ttl) {
+	default_ttl = ttl;
 }
 
-template<class T, class KeyT>
-inline bool ARCache<T, KeyT>::isOK() {
-	if (p < 0) {
-		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
-		std::cerr << "p is negative \'c\'\n";
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::advanceTime(uint64_t now) {
+	timers.advance(now, [this](Node *node) {
+		expireNode(node);
+	});
 
-		return false;
+	if (!isOK()) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "Wrong size of the list!\n";
+		exit(-1);
 	}
+}
 
-	if (c < 0) {
+template<class T, class KeyT, class Weigher>
+inline bool ARCache<T, KeyT, Weigher>::isOK() {
+	if (p > c) {
 		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
-		std::cerr << "c is negative \'c\'\n";
+		std::cerr << "p is greater than \'c\'\n";
 
 		return false;
 	}
 
-	if (T1.size() > c) {
+	if (T1_weight > c) {
 		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
 		std::cerr << "The size of T1 is greater than \'c\'\n";
 
 		return false;
 	}
 
-	if (T2.size() > c) {
+	if (T2_weight > c) {
 		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
 		std::cerr << "The size of T2 is greater than \'c\'\n";
 
 		return false;
 	}
 
-	if (T2.size() + T1.size() > c) {
+	if (T2_weight + T1_weight > c) {
 		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
 		std::cerr << "The size of T2 + T1 is greater than \'c\'\n";
 
 		return false;
 	}
 
-	if (B1.size() > c) {
+	if (B1.weight() > c) {
 		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
 		std::cerr << "The size of B1 is greater than \'c\'\n";
 
 		return false;
 	}
 
-	if (B2.size() > c) {
+	if (B2.weight() > 2 * c) {
 		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
-		std::cerr << "The size of B2 is greater than \'c\'\n";
+		std::cerr << "The size of B2 is greater than \'2c\'\n";
 
 		return false;
 	}
 
-	return true;
-}
+	if (T1_weight + B1.weight() > c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The size of T1 + B1 is greater than \'c\'\n";
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::foundNowhere(const T *elem) {
-	assert(elem);
+		return false;
+	}
 
-	// Didn't find it anywhere
+	if (T1_weight + T2_weight + B1.weight() + B2.weight() > 2 * c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The size of all lists is greater than \'2c\'\n";
 
-	// If the lists are full
-	if (T1.size() + T2.size() == c) {
-		ListIt iterator_;
+		return false;
+	}
 
-		if (T1.size() != 0) {
-			iterator_ = std::prev(T1.end());
-			deleteFromT1(&(*iterator_));
-		} else {
-			iterator_ = std::prev(T2.end());
-			deleteFromT2(&(*iterator_));
-		}
+	return true;
+}
 
+template<class T, class KeyT, class Weigher>
+inline typename ARCache<T, KeyT, Weigher>::Node* ARCache<T, KeyT, Weigher>::foundNowhere(
+		const KeyT &key, uint32_t fingerprint, size_t weight) {
+	// Didn't find it anywhere
+	if (T1_weight + B1.weight() + weight > c) {
+		// T1 + B1 is full: forget the oldest ghosts of B1 first
+		while (T1_weight + B1.weight() + weight > c && !B1.empty())
+			deleteFromB1();
+
+		// T1 takes the whole cache, B1 is empty
+		while (T1_weight + B1.weight() + weight > c)
+			dropFromT1();
+
+		replace(false, weight);
+	} else {
+		size_t total_ = T1_weight + T2_weight + B1.weight() + B2.weight();
+
+		if (total_ + weight > c) {
+			// The history is full
+			while (T1_weight + T2_weight + B1.weight() + B2.weight() + weight > 2 * c
+					&& !B2.empty())
+				deleteFromB2();
+
+			replace(false, weight);
+		}
 	}
 
-	T1.push_front(*elem);
-	hash_T1[elem->id] = T1.begin();
+	Node *node = newNode(key, fingerprint, weight, LIST_T1);
 
-	p++;
+	// Forgetting B1 may have freed less than the new entry weighs
+	trimGhosts();
 
-	setLists();
+	return node;
 }
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::foundT1(const T *elem) {
-	assert(elem);
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::foundT1(Node *node) {
+	assert(node);
 
 	// We found the element in T1, should move it to the top of T2
-	auto pair_ = hash_T1.find(elem->id);
-
-	if (pair_ == hash_T1.end()) {
-		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
-		std::cerr << "Can't find the element " << elem << " in T1!\n";
-
-		exit(-1);
-	}
-
-	T2.push_front(*elem);
-	hash_T2[elem->id] = T2.begin();
-
-	T1.erase(pair_->second);
-	hash_T1.erase(elem->id);
-
-	p--;
-
-	setLists();
+	removeList(node);
+	pushList(LIST_T2, node);
 }
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::foundT2(const T *elem) {
-	assert(elem);
+template<class T, class KeyT, class Weigher>
+inline void ARCache<T, KeyT, Weigher>::foundT2(Node *node) {
+	assert(node);
 
-	auto pair_ = hash_T2.find(elem->id);
+	T2.move_to_front(node);
+}
 
-	if (pair_ == hash_T2.end()) {
-		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
-		std::cerr << "Can't find the element " << elem << " in T2!\n";
+template<class T, class KeyT, class Weigher>
+inline typename ARCache<T, KeyT, Weigher>::Node* ARCache<T, KeyT, Weigher>::foundB1(
+		const KeyT &key, uint32_t fingerprint, size_t weight) {
+	// Found it in B1 - T1 should be bigger
+	size_t delta_ = weight * std::max<size_t>(1, B2.weight() / B1.weight());
+	p = std::min(c, p + delta_);
 
-		exit(-1);
-	}
+	// 'replace' doesn't look at the ghosts, so the ghost is forgotten first
+	B1.remove(fingerprint);
+	replace(false, weight);
 
-	T2.push_front(*elem);
+	Node *node = newNode(key, fingerprint, weight, LIST_T2);
 
-	T2.erase(pair_->second);
-	hash_T2[elem->id] = T2.begin();
+	// The element may be heavier than its ghost was
+	trimGhosts();
 
-	setLists();
+	return node;
 }
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::foundB1() {
-	// Found it in B1
-	assert(B1.size() != 0);
-
-	float temp_ = B2.size() / B1.size();
-	temp_ = std::abs(temp_);
-
-	p = std::min(c, p + std::max(1, static_cast<int>(temp_)));
-
-	setLists();
-}
+template<class T, class KeyT, class Weigher>
+inline typename ARCache<T, KeyT, Weigher>::Node* ARCache<T, KeyT, Weigher>::foundB2(
+		const KeyT &key, uint32_t fingerprint, size_t weight) {
+	// Found it in B2 - T2 should be bigger
+	size_t delta_ = weight * std::max<size_t>(1, B1.weight() / B2.weight());
+	p = (p > delta_) ? p - delta_ : 0;
 
-template<class T, class KeyT>
-inline void ARCache<T, KeyT>::foundB2() {
-	// Found it in B2
-	assert(B2.size() != 0);
+	B2.remove(fingerprint);
+	replace(true, weight);
 
-	float temp_ = B1.size() / B2.size();
-	temp_ = std::abs(temp_);
+	Node *node = newNode(key, fingerprint, weight, LIST_T2);
 
-	p = std::max(0, p - std::max(static_cast<int>(temp_), 1));
+	trimGhosts();
 
-	setLists();
+	return node;
 }
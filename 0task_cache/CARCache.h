@@ -0,0 +1,642 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "arcTelemetry.h"
+#include "hashMix.h"
+#include "intrusiveList.h"
+#include "slabPool.h"
+
+namespace detail {
+
+//! The number of the calling thread, it picks the reader slot of CARCache
+inline size_t carReaderId() {
+	static std::atomic<size_t> next_id(0);
+	thread_local size_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+
+	return id;
+}
+
+}
+
+//! @brief CAR (Clock with Adaptive Replacement) cache algorithm. It adapts 'p'
+//! and keeps "ghost" lists the same way ARC does, but T1 and T2 are clocks:
+//! a hit only sets the reference bit of the entry, and the entries are
+//! reordered only by the clock hand on a miss.
+//!
+//! 'lookup' hits without any lock: the index is an open addressing table of
+//! atomic pointers that readers probe while misses (serialized by the mutex)
+//! change it. A node leaves the index only when its ghost is forgotten, then
+//! it is retired and reused for another key only after every reader that could
+//! still see it is done (epochs: a reader announces the epoch in its own slot
+//! of a cache line, so readers of different threads share no written memory).
+//! A reader that probes while the index is being changed may miss the key,
+//! then it takes the mutex and looks again, so a hit is never lost.
+//! 'get_or_load' and 'insert' always take the mutex, the references they return
+//! are valid until the next miss of any thread
+//! @param T - the type of the currently caching data
+//! @param T1 - the clock of recent cache entries
+//! @param T2 - the clock of frequent cache entries
+//! @param B1 - the LRU list of "ghost" entries removed from T1
+//! @param B2 - the LRU list of "ghost" entries removed from T2
+template<class T, class KeyT = int> class CARCache {
+	//! The list the node is linked into
+	enum listId {
+		LIST_T1, LIST_T2, LIST_B1, LIST_B2
+	};
+
+	struct Node {
+		//! The key and its hash are not changed while the node is in the index
+		KeyT key;
+		uint64_t hash;
+		//! Cached element, empty for "ghost" entries
+		std::optional<T> elem;
+		//! True in T1 and T2 (read by readers without the mutex)
+		std::atomic<bool> resident;
+		//! Reference bit, set on every hit
+		std::atomic<bool> ref;
+
+		Node *prev;
+		Node *next;
+
+		listId list;
+	};
+
+	//! The epoch announced by one reader, 0 if it is not reading
+	struct alignas(64) readerSlot {
+		std::atomic<uint64_t> epoch;
+	};
+
+	//! Threads are spread over this many reader slots
+	static constexpr size_t max_readers = 64;
+	//! Retired nodes are reclaimed when there are that many of them
+	static constexpr size_t reclaim_batch = 32;
+
+	//! Clocks: the hand points to the front, new entries are put to the back
+	intrusiveList<Node> T1;
+	intrusiveList<Node> T2;
+	//! Ghost lists: MRU at the front, LRU at the back
+	intrusiveList<Node> B1;
+	intrusiveList<Node> B2;
+
+	//! Open addressing with linear probing, at most half full
+	std::unique_ptr<std::atomic<Node*>[]> table;
+	size_t mask;
+	slabPool<Node> slab;
+
+	std::unique_ptr<readerSlot[]> readers;
+	std::atomic<uint64_t> global_epoch;
+	//! Nodes removed from the index with the epoch of their removal
+	std::vector<std::pair<Node*, uint64_t>> retired;
+
+	//! Misses and all the changes of the lists take it
+	std::mutex lock;
+
+	size_t c;
+	size_t p;
+
+	//! Keeps the element when the cache has zero size
+	std::optional<T> uncached;
+
+	std::function<void(const KeyT&, T&&, evictionReason)> evict_listener;
+
+	//! The node of the key in the index (resident or a ghost), nullptr if
+	//! there is none. Readers may miss a node that is being moved
+	Node* findNode(const KeyT &key) const;
+	//! Link the new node into the index
+	void indexInsert(Node *node);
+	//! Unlink the node from the index moving back the nodes probed after it
+	void indexErase(Node *node);
+
+	//! Set the reference bit of the resident key without the mutex
+	//! @return false on a miss or if the reader slot is taken
+	bool hit(const KeyT &key);
+	//! A free node for the new key (reclaimed or from the slab)
+	Node* acquireNode();
+	//! Remove the node from the index, it is reused when no reader sees it
+	void retireNode(Node *node);
+	//! Give the retired nodes no reader can see back to the slab
+	void reclaim();
+
+	//! Make place for the missed key and put the element into its node
+	//! @param node - the ghost node of the key or nullptr
+	T& admit(const KeyT &key, Node *node, T &&elem);
+	//! Turn the clocks until an entry without the reference bit is found and
+	//! move it to the corresponding ghost list
+	void replace();
+	//! Hand the element of the node that leaves the cache to the listener
+	void evictNode(Node *node);
+	//! Keep the element of the cache of zero size for the caller, the listener
+	//! gets a copy as evicted at once
+	T& keepUncached(const KeyT &key, T &&elem);
+	//! Forget LRU element of B_i
+	void deleteFromB1();
+	void deleteFromB2();
+
+	bool isOK();
+public:
+	CARCache(size_t cache_size);
+
+	CARCache(const CARCache &rhs) = delete;
+	CARCache& operator=(const CARCache &rhs) = delete;
+
+	//! Print all the lists that CAR uses (for debug only)
+	void printLists();
+	//! Looks if the given element is in the cache and doing CAR algorithm
+	//! (the element is copied into the cache on a miss). Safe to call from many
+	//! threads, a hit takes no lock
+	bool lookup(const T *elem);
+
+	//! @brief Returns the cached element of the key. On a miss the element is
+	//! loaded with 'loader(key)' (called exactly once, without the mutex) and
+	//! moved into the cache
+	//! @return reference valid until the next miss of any thread
+	template<class Loader>
+	T& get_or_load(const KeyT &key, Loader loader);
+	//! Move the element into the cache (replacing the cached one), counts as an access
+	T& insert(const KeyT &key, T &&elem);
+
+	//! Call 'listener(key, elem, EVICT_CAPACITY)' for every element evicted to
+	//! make place, right before it is forgotten (the element may be moved out).
+	//! A cache of zero size reports every element at once (with a copy of it).
+	//! The listener runs under the mutex and must not access this cache
+	void setEvictionListener(
+			std::function<void(const KeyT&, T&&, evictionReason)> listener);
+};
+
+template<class T, class KeyT>
+inline CARCache<T, KeyT>::CARCache(size_t cache_size) :
+		mask(0), slab(2 * cache_size), readers(new readerSlot[max_readers]), global_epoch(
+				1), c(cache_size), p(0) {
+	size_t size_ = 8;
+	while (size_ < 4 * cache_size)
+		size_ <<= 1;
+
+	table.reset(new std::atomic<Node*>[size_]);
+	mask = size_ - 1;
+
+	for (size_t i = 0; i < size_; i++)
+		table[i].store(nullptr, std::memory_order_relaxed);
+
+	for (size_t i = 0; i < max_readers; i++)
+		readers[i].epoch.store(0, std::memory_order_relaxed);
+
+	retired.reserve(2 * reclaim_batch);
+}
+
+template<class T, class KeyT>
+inline typename CARCache<T, KeyT>::Node* CARCache<T, KeyT>::findNode(
+		const KeyT &key) const {
+	uint64_t hash_ = hashKey(key);
+	size_t slot_ = hash_ & mask;
+
+	// Bounded: a reader may race with nodes moving back
+	for (size_t i = 0; i <= mask; i++) {
+		Node *node = table[slot_].load(std::memory_order_acquire);
+
+		if (node == nullptr)
+			return nullptr;
+
+		if (node->hash == hash_ && node->key == key)
+			return node;
+
+		slot_ = (slot_ + 1) & mask;
+	}
+
+	return nullptr;
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::indexInsert(Node *node) {
+	size_t slot_ = node->hash & mask;
+
+	while (table[slot_].load(std::memory_order_relaxed) != nullptr)
+		slot_ = (slot_ + 1) & mask;
+
+	// Readers see the key and the hash of the node it points to
+	table[slot_].store(node, std::memory_order_release);
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::indexErase(Node *node) {
+	size_t slot_ = node->hash & mask;
+
+	while (table[slot_].load(std::memory_order_relaxed) != node)
+		slot_ = (slot_ + 1) & mask;
+
+	table[slot_].store(nullptr, std::memory_order_release);
+
+	// Linear probing: the following nodes that can't be found through
+	// the empty slot any more are moved into it
+	for (size_t next_ = (slot_ + 1) & mask;; next_ = (next_ + 1) & mask) {
+		Node *moved_ = table[next_].load(std::memory_order_relaxed);
+
+		if (moved_ == nullptr)
+			break;
+
+		size_t home_ = moved_->hash & mask;
+
+		bool reachable_ =
+				(slot_ <= next_) ?
+						(slot_ < home_ && home_ <= next_) :
+						(slot_ < home_ || home_ <= next_);
+
+		if (!reachable_) {
+			table[slot_].store(moved_, std::memory_order_release);
+			table[next_].store(nullptr, std::memory_order_release);
+			slot_ = next_;
+		}
+	}
+}
+
+template<class T, class KeyT>
+inline bool CARCache<T, KeyT>::hit(const KeyT &key) {
+	std::atomic<uint64_t> &epoch_ = readers[detail::carReaderId()
+			% max_readers].epoch;
+	uint64_t idle_ = 0;
+
+	// Another thread reads with this slot, the mutex is taken instead
+	// Either 'reclaim' sees the epoch, or it has passed the slot already and
+	// the reader sees the nodes it reclaims unlinked (acquires its release)
+	if (!epoch_.compare_exchange_strong(idle_, global_epoch.load(),
+			std::memory_order_acq_rel))
+		return false;
+
+	Node *node = findNode(key);
+	bool hit_ = node != nullptr && node->resident.load(std::memory_order_acquire);
+
+	if (hit_)
+		node->ref.store(true, std::memory_order_relaxed);
+
+	epoch_.store(0, std::memory_order_release);
+
+	return hit_;
+}
+
+template<class T, class KeyT>
+inline typename CARCache<T, KeyT>::Node* CARCache<T, KeyT>::acquireNode() {
+	Node *node = slab.acquire();
+
+	if (node == nullptr) {
+		reclaim();
+		node = slab.acquire();
+	}
+
+	// Readers hold the retired nodes
+	if (node == nullptr) {
+		slab.grow(reclaim_batch);
+		node = slab.acquire();
+	}
+
+	assert(node);
+
+	return node;
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::retireNode(Node *node) {
+	indexErase(node);
+
+	// Readers that start after the new epoch can't find the node
+	retired.emplace_back(node, global_epoch.fetch_add(1));
+
+	if (retired.size() >= reclaim_batch)
+		reclaim();
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::reclaim() {
+	uint64_t oldest_ = std::numeric_limits<uint64_t>::max();
+
+	// Read-modify-write: it is ordered with the announcing readers
+	for (size_t i = 0; i < max_readers; i++) {
+		uint64_t epoch_ = readers[i].epoch.fetch_add(0,
+				std::memory_order_acq_rel);
+
+		if (epoch_ != 0)
+			oldest_ = std::min(oldest_, epoch_);
+	}
+
+	// Nodes are retired in the order of epochs
+	size_t reclaimed_ = 0;
+
+	while (reclaimed_ < retired.size() && retired[reclaimed_].second < oldest_)
+		slab.release(retired[reclaimed_++].first);
+
+	retired.erase(retired.begin(), retired.begin() + reclaimed_);
+}
+
+template<class T, class KeyT>
+inline bool CARCache<T, KeyT>::lookup(const T *elem) {
+	assert(elem);
+
+	if (c == 0)
+		return false;
+
+	if (hit(elem->id))
+		return true;
+
+	std::lock_guard<std::mutex> guard_(lock);
+
+	Node *node = findNode(elem->id);
+
+	// Another thread has loaded it, or the reader missed a moving node
+	if (node != nullptr && node->resident.load(std::memory_order_relaxed)) {
+		node->ref.store(true, std::memory_order_relaxed);
+		return true;
+	}
+
+	admit(elem->id, node, T(*elem));
+
+	return false;
+}
+
+template<class T, class KeyT>
+template<class Loader>
+inline T& CARCache<T, KeyT>::get_or_load(const KeyT &key, Loader loader) {
+	if (c == 0)
+		return keepUncached(key, loader(key));
+
+	{
+		std::lock_guard<std::mutex> guard_(lock);
+
+		Node *node = findNode(key);
+
+		if (node != nullptr && node->resident.load(std::memory_order_relaxed)) {
+			node->ref.store(true, std::memory_order_relaxed);
+			return *node->elem;
+		}
+	}
+
+	// Load without the mutex, so hits of other threads don't wait for it
+	T elem_ = loader(key);
+
+	std::lock_guard<std::mutex> guard_(lock);
+
+	// The ghost may have been forgotten while loading
+	Node *node = findNode(key);
+
+	if (node != nullptr && node->resident.load(std::memory_order_relaxed)) {
+		node->ref.store(true, std::memory_order_relaxed);
+		return *node->elem;
+	}
+
+	return admit(key, node, std::move(elem_));
+}
+
+template<class T, class KeyT>
+inline T& CARCache<T, KeyT>::insert(const KeyT &key, T &&elem) {
+	if (c == 0)
+		return keepUncached(key, std::move(elem));
+
+	std::lock_guard<std::mutex> guard_(lock);
+
+	Node *node = findNode(key);
+
+	if (node != nullptr && node->resident.load(std::memory_order_relaxed)) {
+		node->ref.store(true, std::memory_order_relaxed);
+		*node->elem = std::move(elem);
+
+		return *node->elem;
+	}
+
+	return admit(key, node, std::move(elem));
+}
+
+template<class T, class KeyT>
+inline T& CARCache<T, KeyT>::admit(const KeyT &key, Node *node, T &&elem) {
+	if (!isOK()) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "Wrong size of the list!\n";
+		exit(-1);
+	}
+
+	if (T1.size() + T2.size() == c) {
+		replace();
+
+		// Keep the history bounded
+		if (node == nullptr) {
+			if (T1.size() + B1.size() == c)
+				deleteFromB1();
+			else if (T1.size() + T2.size() + B1.size() + B2.size() == 2 * c)
+				deleteFromB2();
+		}
+	}
+
+	if (node == nullptr) {
+		// Didn't find it anywhere
+		node = acquireNode();
+
+		node->key = key;
+		node->hash = hashKey(key);
+		node->resident.store(false, std::memory_order_relaxed);
+		node->list = LIST_T1;
+
+		indexInsert(node);
+	} else if (node->list == LIST_B1) {
+		// Found it in B1 - T1 should be bigger
+		size_t delta_ = std::max<size_t>(1, B2.size() / B1.size());
+		p = std::min(c, p + delta_);
+
+		B1.remove(node);
+		node->list = LIST_T2;
+	} else {
+		// Found it in B2 - T2 should be bigger
+		size_t delta_ = std::max<size_t>(1, B1.size() / B2.size());
+		p = (p > delta_) ? p - delta_ : 0;
+
+		B2.remove(node);
+		node->list = LIST_T2;
+	}
+
+	node->elem.emplace(std::move(elem));
+	node->ref.store(false, std::memory_order_relaxed);
+	node->resident.store(true, std::memory_order_release);
+
+	if (node->list == LIST_T1)
+		T1.push_back(node);
+	else
+		T2.push_back(node);
+
+	return *node->elem;
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::replace() {
+	while (true) {
+		if (T1.size() >= std::max<size_t>(1, p)) {
+			Node *node = T1.front();
+			T1.remove(node);
+
+			if (!node->ref.load(std::memory_order_relaxed)) {
+				// Demote the head of T1 to the top of B1
+				node->resident.store(false, std::memory_order_relaxed);
+				evictNode(node);
+				node->elem.reset();
+
+				node->list = LIST_B1;
+				B1.push_front(node);
+
+				return;
+			}
+
+			// Referenced entry of T1 becomes frequent
+			node->ref.store(false, std::memory_order_relaxed);
+
+			node->list = LIST_T2;
+			T2.push_back(node);
+		} else {
+			Node *node = T2.front();
+			T2.remove(node);
+
+			if (!node->ref.load(std::memory_order_relaxed)) {
+				// Demote the head of T2 to the top of B2
+				node->resident.store(false, std::memory_order_relaxed);
+				evictNode(node);
+				node->elem.reset();
+
+				node->list = LIST_B2;
+				B2.push_front(node);
+
+				return;
+			}
+
+			// Give the referenced entry one more turn of the clock
+			node->ref.store(false, std::memory_order_relaxed);
+			T2.push_back(node);
+		}
+	}
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::evictNode(Node *node) {
+	assert(node);
+
+	if (evict_listener)
+		evict_listener(node->key, std::move(*node->elem), EVICT_CAPACITY);
+}
+
+template<class T, class KeyT>
+inline T& CARCache<T, KeyT>::keepUncached(const KeyT &key, T &&elem) {
+	uncached.emplace(std::move(elem));
+
+	if (evict_listener)
+		evict_listener(key, T(*uncached), EVICT_CAPACITY);
+
+	return *uncached;
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::deleteFromB1() {
+	Node *node = B1.back();
+	assert(node);
+
+	B1.remove(node);
+	retireNode(node);
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::deleteFromB2() {
+	Node *node = B2.back();
+	assert(node);
+
+	B2.remove(node);
+	retireNode(node);
+}
+
+template<class T, class KeyT>
+inline bool CARCache<T, KeyT>::isOK() {
+	if (p > c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "p is greater than \'c\'\n";
+
+		return false;
+	}
+
+	if (T2.size() + T1.size() > c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The size of T2 + T1 is greater than \'c\'\n";
+
+		return false;
+	}
+
+	if (T1.size() + B1.size() > c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The size of T1 + B1 is greater than \'c\'\n";
+
+		return false;
+	}
+
+	if (T1.size() + T2.size() + B1.size() + B2.size() > 2 * c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The size of all lists is greater than \'2c\'\n";
+
+		return false;
+	}
+
+	return true;
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::printLists() {
+	std::lock_guard<std::mutex> guard_(lock);
+
+	std::cout << "================\n";
+
+	// Clocks are printed from the hand
+	std::cout << "T1: ";
+	for (Node *node = T1.front(); node != nullptr; node = node->next) {
+		std::cout << node->elem->data << (node->ref ? "* " : " ");
+	}
+
+	std::cout << "\n";
+
+	std::cout << "T2: ";
+	for (Node *node = T2.front(); node != nullptr; node = node->next) {
+		std::cout << node->elem->data << (node->ref ? "* " : " ");
+	}
+
+	std::cout << "\n";
+
+	std::cout << "B1: ";
+	for (Node *node = B1.front(); node != nullptr; node = node->next) {
+		std::cout << node->key << " ";
+	}
+
+	std::cout << "\n";
+
+	std::cout << "B2: ";
+	for (Node *node = B2.front(); node != nullptr; node = node->next) {
+		std::cout << node->key << " ";
+	}
+
+	std::cout << "\n";
+
+	std::cout << "c = " << c << "\n";
+	std::cout << "p = " << p << "\n";
+	std::cout << "T1.size() = " << T1.size() << "\n";
+	std::cout << "T2.size() = " << T2.size() << "\n";
+	std::cout << "B1.size() = " << B1.size() << "\n";
+	std::cout << "B2.size() = " << B2.size() << "\n";
+
+	std::cout << "================\n";
+}
+
+template<class T, class KeyT>
+inline void CARCache<T, KeyT>::setEvictionListener(
+		std::function<void(const KeyT&, T&&, evictionReason)> listener) {
+	std::lock_guard<std::mutex> guard_(lock);
+
+	evict_listener = std::move(listener);
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cassert>
+#include <iostream>
+#include <optional>
+#include <unordered_map>
+
+#include "cachePolicy.h"
+#include "intrusiveList.h"
+#include "slabPool.h"
+
+//! @brief Least Frequently Used cache: on a miss the entry with the least amount
+//! of accesses is evicted (the least recent one among equal). Entries are kept
+//! in buckets of equal frequency, the buckets are sorted by frequency, so every
+//! access and eviction is O(1)
+//! @param T - the type of the currently caching data
+template<class T, class KeyT = int>
+class LFUCache: public policyBase<LFUCache<T, KeyT>, T, KeyT> {
+	friend class policyBase<LFUCache<T, KeyT>, T, KeyT>;
+
+	struct Bucket;
+
+	struct Node {
+		KeyT key;
+		std::optional<T> elem;
+
+		Node *prev;
+		Node *next;
+
+		Bucket *bucket;
+	};
+
+	//! All entries accessed 'freq' times, MRU at the front
+	struct Bucket {
+		size_t freq;
+		intrusiveList<Node> nodes;
+
+		Bucket *prev;
+		Bucket *next;
+	};
+
+	//! Buckets from the least frequency to the greatest
+	intrusiveList<Bucket> buckets;
+
+	std::unordered_map<KeyT, Node*> index;
+	slabPool<Node> slab;
+	//! There can't be more non-empty buckets than entries
+	slabPool<Bucket> bucket_slab;
+
+	size_t c;
+
+	//! Link the node into the bucket of 'freq' that must follow 'pos'
+	//! (or be the first one if 'pos' is nullptr), the bucket is created if needed
+	void putToBucket(Node *node, Bucket *pos, size_t freq);
+	//! Unlink the node from its bucket, the empty bucket is freed
+	void removeFromBucket(Node *node);
+
+	size_t capacity() const;
+	Node* findNode(const KeyT &key);
+	bool isResident(Node *node) const;
+	std::optional<T>& touch(Node *node);
+	std::optional<T>& admit(const KeyT &key, Node *node);
+public:
+	LFUCache(size_t cache_size);
+
+	//! Print all buckets (for debug only)
+	void printList();
+};
+
+template<class T, class KeyT>
+inline LFUCache<T, KeyT>::LFUCache(size_t cache_size) :
+		slab(cache_size), bucket_slab(cache_size + 1), c(cache_size) {
+	index.reserve(cache_size);
+}
+
+template<class T, class KeyT>
+inline void LFUCache<T, KeyT>::putToBucket(Node *node, Bucket *pos,
+		size_t freq) {
+	Bucket *bucket_ = (pos != nullptr) ? pos->next : buckets.front();
+
+	if (bucket_ == nullptr || bucket_->freq != freq) {
+		bucket_ = bucket_slab.acquire();
+		assert(bucket_);
+
+		bucket_->freq = freq;
+
+		if (pos != nullptr)
+			buckets.insert_after(pos, bucket_);
+		else
+			buckets.push_front(bucket_);
+	}
+
+	bucket_->nodes.push_front(node);
+	node->bucket = bucket_;
+}
+
+template<class T, class KeyT>
+inline void LFUCache<T, KeyT>::removeFromBucket(Node *node) {
+	Bucket *bucket_ = node->bucket;
+
+	bucket_->nodes.remove(node);
+	node->bucket = nullptr;
+
+	if (bucket_->nodes.empty()) {
+		buckets.remove(bucket_);
+		bucket_slab.release(bucket_);
+	}
+}
+
+template<class T, class KeyT>
+inline size_t LFUCache<T, KeyT>::capacity() const {
+	return c;
+}
+
+template<class T, class KeyT>
+inline typename LFUCache<T, KeyT>::Node* LFUCache<T, KeyT>::findNode(
+		const KeyT &key) {
+	auto hit = index.find(key);
+
+	if (hit == index.end())
+		return nullptr;
+
+	return hit->second;
+}
+
+template<class T, class KeyT>
+inline bool LFUCache<T, KeyT>::isResident(Node*) const {
+	return true;
+}
+
+template<class T, class KeyT>
+inline std::optional<T>& LFUCache<T, KeyT>::touch(Node *node) {
+	assert(node);
+
+	Bucket *bucket_ = node->bucket;
+	size_t freq_ = bucket_->freq + 1;
+
+	// The next bucket goes after the current one, unless the node was the last in it
+	Bucket *pos_ = (bucket_->nodes.size() == 1) ? bucket_->prev : bucket_;
+
+	removeFromBucket(node);
+	putToBucket(node, pos_, freq_);
+
+	return node->elem;
+}
+
+template<class T, class KeyT>
+inline std::optional<T>& LFUCache<T, KeyT>::admit(const KeyT &key, Node*) {
+	if (index.size() == c) {
+		// The least recent entry of the least frequency
+		Node *victim_ = buckets.front()->nodes.back();
+
+		removeFromBucket(victim_);
+		index.erase(victim_->key);
+
+		this->evicted(victim_->key, victim_->elem);
+		victim_->elem.reset();
+		slab.release(victim_);
+	}
+
+	Node *node = slab.acquire();
+	assert(node);
+
+	node->key = key;
+	putToBucket(node, nullptr, 1);
+	index.emplace(key, node);
+
+	return node->elem;
+}
+
+template<class T, class KeyT>
+inline void LFUCache<T, KeyT>::printList() {
+	std::cout << "LFU:\n";
+	for (Bucket *bucket = buckets.front(); bucket != nullptr;
+			bucket = bucket->next) {
+		std::cout << bucket->freq << ": ";
+		for (Node *node = bucket->nodes.front(); node != nullptr;
+				node = node->next) {
+			std::cout << node->key << " ";
+		}
+		std::cout << "\n";
+	}
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <optional>
+#include <unordered_map>
+
+#include "cachePolicy.h"
+#include "intrusiveList.h"
+#include "slabPool.h"
+
+//! @brief LIRS (Low Inter-reference Recency Set) cache. Entries with small
+//! reuse distance (LIR) take most of the cache, the rest of it (1%) is kept
+//! for entries with large reuse distance (HIR), which are evicted first
+//! @param T - the type of the currently caching data
+//! @param S - the stack of recently accessed entries (LIR, resident and
+//! non-resident HIR), its bottom is always a LIR entry
+//! @param Q - the FIFO of resident HIR entries
+//! @param ghosts - non-resident HIR entries in S, the oldest ones are
+//! forgotten so there are not more than c of them
+template<class T, class KeyT = int>
+class LIRSCache: public policyBase<LIRSCache<T, KeyT>, T, KeyT> {
+	friend class policyBase<LIRSCache<T, KeyT>, T, KeyT>;
+
+	enum entryState {
+		LIR, HIR_RESIDENT, HIR_NONRESIDENT
+	};
+
+	struct Node {
+		KeyT key;
+		//! Cached element, empty for non-resident entries
+		std::optional<T> elem;
+
+		//! Links of the stack S
+		Node *prev;
+		Node *next;
+		//! Links of Q (resident HIR) or of the ghost list (non-resident HIR)
+		Node *queue_prev;
+		Node *queue_next;
+
+		entryState state;
+		bool in_stack;
+	};
+
+	using queueList = intrusiveList<Node, &Node::queue_prev, &Node::queue_next>;
+
+	//! The top of the stack is at the front
+	intrusiveList<Node> S;
+	//! New entries at the front, evicted from the back
+	queueList Q;
+	queueList ghosts;
+
+	std::unordered_map<KeyT, Node*> index;
+	slabPool<Node> slab;
+
+	size_t c;
+	//! The amount of LIR entries
+	size_t Llirs;
+	size_t lir_count;
+
+	//! Remove HIR entries from the bottom of S, so it ends with a LIR entry
+	void pruneStack();
+	//! Turn the bottom LIR entry into a resident HIR one if there are too many LIR entries
+	void demoteBottom();
+	//! Evict the oldest resident HIR entry (or LIR if there are no HIR ones)
+	void evict();
+	//! Put the node to the top of S
+	void pushStack(Node *node);
+	//! Forget the node completely
+	void dropNode(Node *node);
+
+	size_t capacity() const;
+	Node* findNode(const KeyT &key);
+	bool isResident(Node *node) const;
+	std::optional<T>& touch(Node *node);
+	std::optional<T>& admit(const KeyT &key, Node *node);
+public:
+	LIRSCache(size_t cache_size);
+
+	//! Print S and Q (for debug only)
+	void printLists();
+};
+
+template<class T, class KeyT>
+inline LIRSCache<T, KeyT>::LIRSCache(size_t cache_size) :
+		slab(2 * cache_size + 1), c(cache_size), lir_count(0) {
+	size_t hirs_ = std::max<size_t>(1, cache_size / 100);
+	Llirs = (cache_size > hirs_) ? cache_size - hirs_ : cache_size;
+
+	index.reserve(2 * cache_size + 1);
+}
+
+template<class T, class KeyT>
+inline void LIRSCache<T, KeyT>::pushStack(Node *node) {
+	if (node->in_stack)
+		S.move_to_front(node);
+	else
+		S.push_front(node);
+
+	node->in_stack = true;
+}
+
+template<class T, class KeyT>
+inline void LIRSCache<T, KeyT>::pruneStack() {
+	while (!S.empty() && S.back()->state != LIR) {
+		Node *node = S.back();
+
+		S.remove(node);
+		node->in_stack = false;
+
+		// Non-resident entries are kept only while they are in S
+		if (node->state == HIR_NONRESIDENT) {
+			ghosts.remove(node);
+			dropNode(node);
+		}
+	}
+}
+
+template<class T, class KeyT>
+inline void LIRSCache<T, KeyT>::demoteBottom() {
+	if (lir_count <= Llirs)
+		return;
+
+	Node *node = S.back();
+	assert(node && node->state == LIR);
+
+	S.remove(node);
+	node->in_stack = false;
+
+	node->state = HIR_RESIDENT;
+	lir_count--;
+	Q.push_front(node);
+
+	pruneStack();
+}
+
+template<class T, class KeyT>
+inline void LIRSCache<T, KeyT>::evict() {
+	Node *node = Q.back();
+
+	if (node == nullptr) {
+		// All resident entries are LIR, take the bottom of S
+		node = S.back();
+		assert(node && node->state == LIR);
+
+		S.remove(node);
+		node->in_stack = false;
+		lir_count--;
+
+		this->evicted(node->key, node->elem);
+		dropNode(node);
+		pruneStack();
+
+		return;
+	}
+
+	Q.remove(node);
+	this->evicted(node->key, node->elem);
+
+	if (!node->in_stack) {
+		dropNode(node);
+		return;
+	}
+
+	// Remember it while it is in S
+	node->state = HIR_NONRESIDENT;
+	node->elem.reset();
+	ghosts.push_front(node);
+
+	if (ghosts.size() > c) {
+		Node *ghost_ = ghosts.back();
+
+		ghosts.remove(ghost_);
+		S.remove(ghost_);
+		dropNode(ghost_);
+	}
+}
+
+template<class T, class KeyT>
+inline void LIRSCache<T, KeyT>::dropNode(Node *node) {
+	index.erase(node->key);
+
+	node->elem.reset();
+	node->in_stack = false;
+	slab.release(node);
+}
+
+template<class T, class KeyT>
+inline size_t LIRSCache<T, KeyT>::capacity() const {
+	return c;
+}
+
+template<class T, class KeyT>
+inline typename LIRSCache<T, KeyT>::Node* LIRSCache<T, KeyT>::findNode(
+		const KeyT &key) {
+	auto hit = index.find(key);
+
+	if (hit == index.end())
+		return nullptr;
+
+	return hit->second;
+}
+
+template<class T, class KeyT>
+inline bool LIRSCache<T, KeyT>::isResident(Node *node) const {
+	return node->state != HIR_NONRESIDENT;
+}
+
+template<class T, class KeyT>
+inline std::optional<T>& LIRSCache<T, KeyT>::touch(Node *node) {
+	assert(node);
+
+	if (node->state == LIR) {
+		bool bottom_ = (S.back() == node);
+
+		pushStack(node);
+
+		if (bottom_)
+			pruneStack();
+	} else if (node->in_stack) {
+		// Resident HIR with small reuse distance becomes LIR
+		Q.remove(node);
+
+		node->state = LIR;
+		lir_count++;
+		pushStack(node);
+
+		demoteBottom();
+	} else {
+		pushStack(node);
+		Q.move_to_front(node);
+	}
+
+	return node->elem;
+}
+
+template<class T, class KeyT>
+inline std::optional<T>& LIRSCache<T, KeyT>::admit(const KeyT &key,
+		Node *node) {
+	if (node != nullptr) {
+		// Non-resident HIR in S has small reuse distance - it becomes LIR.
+		// It is put on the top of S first, so evicting can't forget it
+		ghosts.remove(node);
+
+		node->state = LIR;
+		lir_count++;
+		pushStack(node);
+
+		if (index.size() - ghosts.size() > c)
+			evict();
+
+		demoteBottom();
+
+		return node->elem;
+	}
+
+	if (index.size() - ghosts.size() >= c)
+		evict();
+
+	node = slab.acquire();
+	assert(node);
+
+	node->key = key;
+	node->in_stack = false;
+	index.emplace(key, node);
+
+	if (lir_count < Llirs) {
+		node->state = LIR;
+		lir_count++;
+		pushStack(node);
+	} else {
+		node->state = HIR_RESIDENT;
+		pushStack(node);
+		Q.push_front(node);
+	}
+
+	return node->elem;
+}
+
+template<class T, class KeyT>
+inline void LIRSCache<T, KeyT>::printLists() {
+	std::cout << "================\n";
+
+	std::cout << "S: ";
+	for (Node *node = S.front(); node != nullptr; node = node->next) {
+		std::cout << node->key
+				<< (node->state == LIR ?
+						"(L) " : (node->state == HIR_RESIDENT ? "(H) " : "(h) "));
+	}
+
+	std::cout << "\n";
+
+	std::cout << "Q: ";
+	for (Node *node = Q.front(); node != nullptr; node = node->queue_next) {
+		std::cout << node->key << " ";
+	}
+
+	std::cout << "\n";
+	std::cout << "================\n";
+}
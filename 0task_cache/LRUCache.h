@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cassert>
+#include <iostream>
+#include <optional>
+#include <unordered_map>
+
+#include "cachePolicy.h"
+#include "intrusiveList.h"
+#include "slabPool.h"
+
+//! @brief Least Recently Used cache: on a miss the entry that wasn't accessed
+//! for the longest time is evicted
+//! @param T - the type of the currently caching data
+template<class T, class KeyT = int>
+class LRUCache: public policyBase<LRUCache<T, KeyT>, T, KeyT> {
+	friend class policyBase<LRUCache<T, KeyT>, T, KeyT>;
+
+	struct Node {
+		KeyT key;
+		std::optional<T> elem;
+
+		Node *prev;
+		Node *next;
+	};
+
+	//! MRU at the front, LRU at the back
+	intrusiveList<Node> lru;
+
+	std::unordered_map<KeyT, Node*> index;
+	slabPool<Node> slab;
+
+	size_t c;
+
+	size_t capacity() const;
+	Node* findNode(const KeyT &key);
+	bool isResident(Node *node) const;
+	std::optional<T>& touch(Node *node);
+	std::optional<T>& admit(const KeyT &key, Node *node);
+public:
+	LRUCache(size_t cache_size);
+
+	//! Print the list from MRU to LRU (for debug only)
+	void printList();
+};
+
+template<class T, class KeyT>
+inline LRUCache<T, KeyT>::LRUCache(size_t cache_size) :
+		slab(cache_size), c(cache_size) {
+	index.reserve(cache_size);
+}
+
+template<class T, class KeyT>
+inline size_t LRUCache<T, KeyT>::capacity() const {
+	return c;
+}
+
+template<class T, class KeyT>
+inline typename LRUCache<T, KeyT>::Node* LRUCache<T, KeyT>::findNode(
+		const KeyT &key) {
+	auto hit = index.find(key);
+
+	if (hit == index.end())
+		return nullptr;
+
+	return hit->second;
+}
+
+template<class T, class KeyT>
+inline bool LRUCache<T, KeyT>::isResident(Node*) const {
+	return true;
+}
+
+template<class T, class KeyT>
+inline std::optional<T>& LRUCache<T, KeyT>::touch(Node *node) {
+	assert(node);
+
+	lru.move_to_front(node);
+
+	return node->elem;
+}
+
+template<class T, class KeyT>
+inline std::optional<T>& LRUCache<T, KeyT>::admit(const KeyT &key, Node*) {
+	if (lru.size() == c) {
+		Node *victim_ = lru.back();
+
+		lru.remove(victim_);
+		index.erase(victim_->key);
+
+		this->evicted(victim_->key, victim_->elem);
+		victim_->elem.reset();
+		slab.release(victim_);
+	}
+
+	Node *node = slab.acquire();
+	assert(node);
+
+	node->key = key;
+	lru.push_front(node);
+	index.emplace(key, node);
+
+	return node->elem;
+}
+
+template<class T, class KeyT>
+inline void LRUCache<T, KeyT>::printList() {
+	std::cout << "LRU: ";
+	for (Node *node = lru.front(); node != nullptr; node = node->next) {
+		std::cout << node->key << " ";
+	}
+	std::cout << "\n";
+}
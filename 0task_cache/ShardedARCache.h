@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cassert>
+#include <exception>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ARCache.h"
+#include "hashMix.h"
+
+//! @brief Hit statistics of one shard
+struct shardStats {
+	size_t hits;
+	size_t lookups;
+	//! Misses that called the loader
+	size_t loads;
+	//! Misses that waited for the load of another thread instead
+	size_t coalesced;
+};
+
+//! @brief Thread safe ARC cache: keys are hashed to one of N independent ARC
+//! caches (shards), each one has its own lock and adapts its own 'p'. Threads
+//! working with different shards never wait for each other.
+//!
+//! Loads are single-flight: the first thread that misses a key installs a
+//! pending load and calls the loader without the lock, the other threads that
+//! miss the same key meanwhile wait for its shared future instead of loading
+//! the key again. So a hot key that misses costs the backend one load whatever
+//! the amount of threads
+//! @param T - the type of the currently caching data
+template<class T, class KeyT = int> class ShardedARCache {
+	//! Aligned to the cache line, so locks of the neighbour shards don't share it
+	struct alignas(64) Shard {
+		std::mutex lock;
+		ARCache<T, KeyT> cache;
+		//! Keys being loaded by some thread, the others wait for the result
+		std::unordered_map<KeyT, std::shared_future<T>> pending;
+
+		size_t hits;
+		size_t lookups;
+		size_t loads;
+		size_t coalesced;
+
+		Shard(size_t cache_size);
+	};
+
+	std::vector<std::unique_ptr<Shard>> shards;
+	size_t shards_count;
+
+	Shard& getShard(const KeyT &key);
+public:
+	//! @param cache_size - the total size of the cache, split evenly between shards
+	//! @param shards_amount - the amount of shards
+	ShardedARCache(size_t cache_size, size_t shards_amount = 16);
+
+	//! Looks if the given element is in the cache and doing ARC algorithm
+	bool lookup(const T *elem);
+	//! @brief Returns the copy of the cached element of the key. On a miss the
+	//! element is loaded with 'loader(key)' by this thread, or by the thread
+	//! that is loading the key already (then this one waits for it). An
+	//! exception of the loader is thrown in all the threads waiting for it
+	//! @param loader - callable taking the key and returning T
+	template<class Loader>
+	T get_or_load(const KeyT &key, Loader loader);
+
+	size_t shards_size() const;
+	//! Hit statistics of the given shard
+	shardStats getStats(size_t shard);
+	//! Hit statistics of all shards together
+	shardStats getTotalStats();
+	//! Print hit statistics of all shards
+	void printStats();
+};
+
+template<class T, class KeyT>
+inline ShardedARCache<T, KeyT>::Shard::Shard(size_t cache_size) :
+		cache(cache_size), hits(0), lookups(0), loads(0), coalesced(0) {
+}
+
+template<class T, class KeyT>
+inline ShardedARCache<T, KeyT>::ShardedARCache(size_t cache_size,
+		size_t shards_amount) :
+		shards(shards_amount), shards_count(shards_amount) {
+	assert(shards_count != 0);
+
+	// Shards get equal parts, the first ones take the remainder
+	for (size_t i = 0; i < shards_count; i++) {
+		size_t size_ = cache_size / shards_count
+				+ (i < cache_size % shards_count ? 1 : 0);
+
+		shards[i].reset(new Shard(size_));
+	}
+}
+
+template<class T, class KeyT>
+inline typename ShardedARCache<T, KeyT>::Shard& ShardedARCache<T, KeyT>::getShard(
+		const KeyT &key) {
+	// High bits of the mixed hash, the shard cache uses its own hash of the key
+	uint64_t hash_ = hashKey(key);
+
+	return *shards[(hash_ >> 32) % shards_count];
+}
+
+template<class T, class KeyT>
+inline bool ShardedARCache<T, KeyT>::lookup(const T *elem) {
+	assert(elem);
+
+	Shard &shard_ = getShard(elem->id);
+	std::lock_guard<std::mutex> guard_(shard_.lock);
+
+	bool hit_ = shard_.cache.lookup(elem);
+
+	shard_.lookups++;
+	if (hit_)
+		shard_.hits++;
+
+	return hit_;
+}
+
+template<class T, class KeyT>
+template<class Loader>
+inline T ShardedARCache<T, KeyT>::get_or_load(const KeyT &key,
+		Loader loader) {
+	Shard &shard_ = getShard(key);
+	std::unique_lock<std::mutex> guard_(shard_.lock);
+
+	shard_.lookups++;
+
+	T *elem_ = shard_.cache.find(key);
+
+	if (elem_ != nullptr) {
+		shard_.hits++;
+		return *elem_;
+	}
+
+	auto pending_ = shard_.pending.find(key);
+
+	if (pending_ != shard_.pending.end()) {
+		shard_.coalesced++;
+
+		// Wait without the lock, the loading thread needs it to finish
+		std::shared_future<T> future_ = pending_->second;
+		guard_.unlock();
+
+		return future_.get();
+	}
+
+	std::promise<T> promise_;
+
+	shard_.loads++;
+	shard_.pending.emplace(key, promise_.get_future().share());
+
+	// The backend is called without the lock
+	guard_.unlock();
+
+	try {
+		T loaded_ = loader(key);
+
+		guard_.lock();
+		shard_.cache.insert(key, T(loaded_));
+		shard_.pending.erase(key);
+		guard_.unlock();
+
+		promise_.set_value(loaded_);
+
+		return loaded_;
+	} catch (...) {
+		if (!guard_.owns_lock())
+			guard_.lock();
+
+		shard_.pending.erase(key);
+		guard_.unlock();
+
+		promise_.set_exception(std::current_exception());
+		throw;
+	}
+}
+
+template<class T, class KeyT>
+inline size_t ShardedARCache<T, KeyT>::shards_size() const {
+	return shards_count;
+}
+
+template<class T, class KeyT>
+inline shardStats ShardedARCache<T, KeyT>::getStats(size_t shard) {
+	assert(shard < shards_count);
+
+	Shard &shard_ = *shards[shard];
+	std::lock_guard<std::mutex> guard_(shard_.lock);
+
+	return shardStats { shard_.hits, shard_.lookups, shard_.loads,
+			shard_.coalesced };
+}
+
+template<class T, class KeyT>
+inline shardStats ShardedARCache<T, KeyT>::getTotalStats() {
+	shardStats total_ { 0, 0, 0, 0 };
+
+	for (size_t i = 0; i < shards_count; i++) {
+		shardStats stats_ = getStats(i);
+
+		total_.hits += stats_.hits;
+		total_.lookups += stats_.lookups;
+		total_.loads += stats_.loads;
+		total_.coalesced += stats_.coalesced;
+	}
+
+	return total_;
+}
+
+template<class T, class KeyT>
+inline void ShardedARCache<T, KeyT>::printStats() {
+	std::cout << "================\n";
+
+	for (size_t i = 0; i < shards_count; i++) {
+		shardStats stats_ = getStats(i);
+		float percent_ =
+				stats_.lookups ?
+						((float) stats_.hits) * 100.f / stats_.lookups : 0.f;
+
+		std::cout << "Shard " << i << ": hits - " << stats_.hits
+				<< ", lookups - " << stats_.lookups << " ("
+				<< std::setprecision(3) << percent_ << "%), loads - "
+				<< stats_.loads << ", coalesced misses - " << stats_.coalesced
+				<< "\n";
+	}
+
+	std::cout << "================\n";
+}
@@ -0,0 +1,626 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+
+#include "hashMix.h"
+#include "intrusiveList.h"
+
+//! @brief ARC cache of a capacity known at compile time that never touches the
+//! heap: the nodes, the elements and the hash index are arrays inside the
+//! object. It is meant for small caches (up to about a thousand entries)
+//! accessed in tight loops, where allocating and hashing into the structures
+//! of ARCache costs more than the work itself.
+//!
+//! The replacement is the same as in ARCache with unit weights. Unlike ARCache
+//! the ghosts are nodes with whole keys: T1, T2, B1 and B2 together never have
+//! more than 2c keys, so all of them live in one directory of 2c nodes, and
+//! evicting an entry into its ghost list just moves its node (the element slot
+//! is freed). One open addressing table of node positions finds a key in any
+//! list. There are no weights, TTLs nor telemetry.
+//!
+//! The object is big (about 2c nodes and c elements), so it shouldn't be put
+//! on a small stack. Nodes are linked by pointers, the cache can't be copied
+//! @param T - the type of the currently caching data
+//! @param Capacity - the amount of entries (c)
+template<class T, class KeyT = int, size_t Capacity = 64>
+class StaticARCache {
+	static_assert(Capacity > 0, "The cache must have at least one entry");
+	static_assert(Capacity <= (size_t(1) << 24),
+			"Positions of nodes are kept in 32 bits");
+
+	//! The list the node is linked into
+	enum listId {
+		LIST_T1, LIST_T2, LIST_B1, LIST_B2, LIST_FREE
+	};
+
+	struct Node {
+		KeyT key;
+
+		Node *prev;
+		Node *next;
+
+		listId list;
+		//! The slot in 'elems' of the resident node
+		uint32_t elem;
+	};
+
+	//! The smallest power of two not less than 'n'
+	static constexpr size_t roundUp(size_t n) {
+		size_t size_ = 1;
+
+		while (size_ < n)
+			size_ <<= 1;
+
+		return size_;
+	}
+
+	static constexpr size_t nodes_count = 2 * Capacity;
+	//! The table is at most half full
+	static constexpr size_t table_size = roundUp(2 * nodes_count);
+	static constexpr size_t table_mask = table_size - 1;
+
+	static constexpr size_t c = Capacity;
+
+	Node nodes[nodes_count];
+	std::optional<T> elems[Capacity];
+
+	//! Position of the node + 1 for every key of all lists, 0 for empty slots
+	uint32_t table[table_size];
+
+	//! Free slots of 'elems', 'free_elems_count' of them on the top
+	uint32_t free_elems[Capacity];
+	size_t free_elems_count;
+
+	intrusiveList<Node> T1;
+	intrusiveList<Node> T2;
+	intrusiveList<Node> B1;
+	intrusiveList<Node> B2;
+	intrusiveList<Node> free_nodes;
+
+	size_t p;
+
+	//! The slot of the key or the empty slot where it should be
+	size_t findSlot(const KeyT &key) const;
+	//! Empty the slot moving back the keys probed after it
+	void eraseSlot(size_t slot);
+	//! The node of the key in any list, nullptr if there is none
+	Node* findNode(const KeyT &key);
+
+	intrusiveList<Node>& listOf(listId list);
+	//! Link the node at the MRU end of the list
+	void pushList(listId list, Node *node);
+	//! Unlink the node from its list
+	void removeList(Node *node);
+
+	//! Take a free node and an element slot, link the node into the list
+	//! and the index
+	Node* newNode(const KeyT &key, listId list);
+	//! Give the element slot of the node back (it becomes a ghost or is dropped)
+	void freeElem(Node *node);
+	//! Forget the node: unlink it from the index and return it to the free list
+	void dropNode(Node *node);
+
+	//! Free place in the cache moving LRU entries of T1 or T2 (depending on 'p')
+	//! to the corresponding ghost lists
+	//! @param in_B2 - true if the requested element was found in B2
+	void replace(bool in_B2);
+	//! True if 'replace' takes the entry from T1 (and from T2 otherwise)
+	bool replaceFromT1(bool in_B2) const;
+	//! Move LRU element of T_i to the top of B_i
+	void deleteFromT1();
+	void deleteFromT2();
+	//! Forget LRU element of T1 completely (when T1 takes the whole cache)
+	void dropFromT1();
+	//! Forget LRU element of B_i
+	void deleteFromB1();
+	void deleteFromB2();
+	//! Forget the oldest ghosts while all lists have more than 2c keys
+	void trimGhosts();
+
+	//! Move the resident node according to ARC on a hit
+	void touch(Node *node);
+	//! Make place for the missed key and link its node into T1 or T2
+	//! (T2 if the key is a ghost), the caller puts the element into the node's slot
+	Node* admit(const KeyT &key);
+
+	Node* foundNowhere(const KeyT &key);
+	void foundT1(Node *node);
+	void foundT2(Node *node);
+	Node* foundB1(Node *node);
+	Node* foundB2(Node *node);
+
+	bool isOK();
+public:
+	StaticARCache();
+
+	StaticARCache(const StaticARCache &rhs) = delete;
+	StaticARCache& operator=(const StaticARCache &rhs) = delete;
+
+	//! Print all the lists that ARC uses (for debug only)
+	void printLists();
+	//! Looks if the given element is in the cache and doing ARC algorithm
+	//! (the element is copied into the cache on a miss)
+	bool lookup(const T *elem);
+
+	//! @brief Returns the cached element of the key. On a miss the element is
+	//! loaded with 'loader(key)' (called exactly once) and moved into the cache
+	//! @param loader - callable taking the key and returning T
+	//! @return reference valid until the next access to the cache
+	template<class Loader>
+	T& get_or_load(const KeyT &key, Loader loader);
+	//! Move the element into the cache (replacing the cached one), counts as an access
+	T& insert(const KeyT &key, T &&elem);
+
+	//! Returns the cached element of the key doing ARC algorithm for a hit,
+	//! nullptr on a miss (the cache is not changed then)
+	T* find(const KeyT &key);
+
+	//! The amount of resident entries
+	size_t size() const;
+};
+
+template<class T, class KeyT, size_t Capacity>
+inline StaticARCache<T, KeyT, Capacity>::StaticARCache() :
+		free_elems_count(Capacity), p(0) {
+	std::fill(table, table + table_size, 0);
+
+	for (size_t i = 0; i < Capacity; i++)
+		free_elems[i] = Capacity - 1 - i;
+
+	for (size_t i = 0; i < nodes_count; i++) {
+		nodes[i].list = LIST_FREE;
+		free_nodes.push_back(&nodes[i]);
+	}
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline size_t StaticARCache<T, KeyT, Capacity>::findSlot(
+		const KeyT &key) const {
+	size_t slot_ = hashKey(key) & table_mask;
+
+	while (table[slot_] != 0 && !(nodes[table[slot_] - 1].key == key))
+		slot_ = (slot_ + 1) & table_mask;
+
+	return slot_;
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::eraseSlot(size_t slot) {
+	table[slot] = 0;
+
+	// Linear probing: the following keys that can't be found through
+	// the empty slot any more are moved into it (as in ghostList)
+	for (size_t next_ = (slot + 1) & table_mask; table[next_] != 0;
+			next_ = (next_ + 1) & table_mask) {
+		size_t home_ = hashKey(nodes[table[next_] - 1].key) & table_mask;
+
+		bool reachable_ =
+				(slot <= next_) ?
+						(slot < home_ && home_ <= next_) :
+						(slot < home_ || home_ <= next_);
+
+		if (!reachable_) {
+			table[slot] = table[next_];
+			table[next_] = 0;
+			slot = next_;
+		}
+	}
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline typename StaticARCache<T, KeyT, Capacity>::Node* StaticARCache<T, KeyT,
+		Capacity>::findNode(const KeyT &key) {
+	if (!isOK()) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "Wrong size of the list!\n";
+		exit(-1);
+	}
+
+	size_t slot_ = findSlot(key);
+
+	if (table[slot_] == 0)
+		return nullptr;
+
+	return &nodes[table[slot_] - 1];
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline intrusiveList<typename StaticARCache<T, KeyT, Capacity>::Node>& StaticARCache<
+		T, KeyT, Capacity>::listOf(listId list) {
+	switch (list) {
+	case LIST_T1:
+		return T1;
+	case LIST_T2:
+		return T2;
+	case LIST_B1:
+		return B1;
+	case LIST_B2:
+		return B2;
+	default:
+		return free_nodes;
+	}
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::pushList(listId list,
+		Node *node) {
+	assert(node);
+
+	node->list = list;
+	listOf(list).push_front(node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::removeList(Node *node) {
+	assert(node);
+
+	listOf(node->list).remove(node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline typename StaticARCache<T, KeyT, Capacity>::Node* StaticARCache<T, KeyT,
+		Capacity>::newNode(const KeyT &key, listId list) {
+	// T1, T2, B1 and B2 never have more than 2c keys together
+	assert(!free_nodes.empty() && free_elems_count != 0);
+
+	Node *node = free_nodes.back();
+
+	free_nodes.remove(node);
+
+	node->key = key;
+	node->elem = free_elems[--free_elems_count];
+
+	pushList(list, node);
+
+	table[findSlot(key)] = node - nodes + 1;
+
+	return node;
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::freeElem(Node *node) {
+	assert(node);
+
+	elems[node->elem].reset();
+	free_elems[free_elems_count++] = node->elem;
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::dropNode(Node *node) {
+	assert(node);
+
+	eraseSlot(findSlot(node->key));
+
+	node->list = LIST_FREE;
+	free_nodes.push_back(node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline bool StaticARCache<T, KeyT, Capacity>::lookup(const T *elem) {
+	assert(elem);
+
+	Node *node = findNode(elem->id);
+
+	if (node != nullptr && (node->list == LIST_T1 || node->list == LIST_T2)) {
+		touch(node);
+		return true;
+	}
+
+	node = admit(elem->id);
+	elems[node->elem].emplace(*elem);
+
+	return false;
+}
+
+template<class T, class KeyT, size_t Capacity>
+template<class Loader>
+inline T& StaticARCache<T, KeyT, Capacity>::get_or_load(const KeyT &key,
+		Loader loader) {
+	Node *node = findNode(key);
+
+	if (node != nullptr && (node->list == LIST_T1 || node->list == LIST_T2)) {
+		touch(node);
+		return *elems[node->elem];
+	}
+
+	// Load before touching the lists, so a throwing loader changes nothing
+	T elem_ = loader(key);
+
+	node = admit(key);
+	elems[node->elem].emplace(std::move(elem_));
+
+	return *elems[node->elem];
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline T& StaticARCache<T, KeyT, Capacity>::insert(const KeyT &key,
+		T &&elem) {
+	Node *node = findNode(key);
+
+	if (node != nullptr && (node->list == LIST_T1 || node->list == LIST_T2)) {
+		touch(node);
+		*elems[node->elem] = std::move(elem);
+
+		return *elems[node->elem];
+	}
+
+	node = admit(key);
+	elems[node->elem].emplace(std::move(elem));
+
+	return *elems[node->elem];
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline T* StaticARCache<T, KeyT, Capacity>::find(const KeyT &key) {
+	Node *node = findNode(key);
+
+	if (node == nullptr || node->list == LIST_B1 || node->list == LIST_B2)
+		return nullptr;
+
+	touch(node);
+
+	return &*elems[node->elem];
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline size_t StaticARCache<T, KeyT, Capacity>::size() const {
+	return T1.size() + T2.size();
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::touch(Node *node) {
+	assert(node);
+
+	if (node->list == LIST_T1)
+		foundT1(node);
+	else
+		foundT2(node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline typename StaticARCache<T, KeyT, Capacity>::Node* StaticARCache<T, KeyT,
+		Capacity>::admit(const KeyT &key) {
+	Node *node = findNode(key);
+
+	if (node == nullptr)
+		return foundNowhere(key);
+
+	if (node->list == LIST_B1)
+		return foundB1(node);
+
+	return foundB2(node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::replace(bool in_B2) {
+	// Loops until there is a free place in the cache
+	while (T1.size() + T2.size() + 1 > c) {
+		if (replaceFromT1(in_B2))
+			deleteFromT1();
+		else
+			deleteFromT2();
+	}
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline bool StaticARCache<T, KeyT, Capacity>::replaceFromT1(bool in_B2) const {
+	if (!T1.empty() && (T1.size() > p || (in_B2 && T1.size() == p)))
+		return true;
+
+	return T2.empty();
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::printLists() {
+	std::cout << "================\n";
+
+	const char *names_[] = { "T1", "T2", "B1", "B2" };
+	listId lists_[] = { LIST_T1, LIST_T2, LIST_B1, LIST_B2 };
+
+	for (size_t i = 0; i < 4; i++) {
+		std::cout << names_[i] << ": ";
+
+		for (Node *node = listOf(lists_[i]).front(); node != nullptr;
+				node = node->next)
+			std::cout << node->key << " ";
+
+		std::cout << "\n";
+	}
+
+	std::cout << "c = " << c << "\n";
+	std::cout << "p = " << p << "\n";
+	std::cout << "T1.size() = " << T1.size() << "\n";
+	std::cout << "T2.size() = " << T2.size() << "\n";
+	std::cout << "B1.size() = " << B1.size() << "\n";
+	std::cout << "B2.size() = " << B2.size() << "\n";
+
+	std::cout << "================\n";
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::deleteFromT1() {
+	Node *node = T1.back();
+	assert(node);
+
+	// The node stays in the index, only its element is forgotten
+	removeList(node);
+	freeElem(node);
+	pushList(LIST_B1, node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::deleteFromT2() {
+	Node *node = T2.back();
+	assert(node);
+
+	removeList(node);
+	freeElem(node);
+	pushList(LIST_B2, node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::dropFromT1() {
+	Node *node = T1.back();
+	assert(node);
+
+	removeList(node);
+	freeElem(node);
+	dropNode(node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::deleteFromB1() {
+	Node *node = B1.back();
+	assert(node);
+
+	removeList(node);
+	dropNode(node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::deleteFromB2() {
+	Node *node = B2.back();
+	assert(node);
+
+	removeList(node);
+	dropNode(node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::trimGhosts() {
+	while (T1.size() + T2.size() + B1.size() + B2.size() > 2 * c
+			&& !(B1.empty() && B2.empty())) {
+		if (!B2.empty())
+			deleteFromB2();
+		else
+			deleteFromB1();
+	}
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline bool StaticARCache<T, KeyT, Capacity>::isOK() {
+	if (p > c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "p is greater than \'c\'\n";
+
+		return false;
+	}
+
+	if (T2.size() + T1.size() > c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The size of T2 + T1 is greater than \'c\'\n";
+
+		return false;
+	}
+
+	if (T1.size() + B1.size() > c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The size of T1 + B1 is greater than \'c\'\n";
+
+		return false;
+	}
+
+	if (T1.size() + T2.size() + B1.size() + B2.size() > 2 * c) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The size of all lists is greater than \'2c\'\n";
+
+		return false;
+	}
+
+	return true;
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline typename StaticARCache<T, KeyT, Capacity>::Node* StaticARCache<T, KeyT,
+		Capacity>::foundNowhere(const KeyT &key) {
+	// Didn't find it anywhere
+	if (T1.size() + B1.size() + 1 > c) {
+		// T1 + B1 is full: forget the oldest ghosts of B1 first
+		while (T1.size() + B1.size() + 1 > c && !B1.empty())
+			deleteFromB1();
+
+		// T1 takes the whole cache, B1 is empty
+		while (T1.size() + B1.size() + 1 > c)
+			dropFromT1();
+
+		replace(false);
+	} else {
+		size_t total_ = T1.size() + T2.size() + B1.size() + B2.size();
+
+		if (total_ + 1 > c) {
+			// The history is full
+			while (T1.size() + T2.size() + B1.size() + B2.size() + 1 > 2 * c
+					&& !B2.empty())
+				deleteFromB2();
+
+			replace(false);
+		}
+	}
+
+	Node *node = newNode(key, LIST_T1);
+
+	trimGhosts();
+
+	return node;
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::foundT1(Node *node) {
+	assert(node);
+
+	// We found the element in T1, should move it to the top of T2
+	removeList(node);
+	pushList(LIST_T2, node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline void StaticARCache<T, KeyT, Capacity>::foundT2(Node *node) {
+	assert(node);
+
+	T2.move_to_front(node);
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline typename StaticARCache<T, KeyT, Capacity>::Node* StaticARCache<T, KeyT,
+		Capacity>::foundB1(Node *node) {
+	assert(node);
+
+	// Found it in B1 - T1 should be bigger
+	size_t delta_ = std::max<size_t>(1, B2.size() / B1.size());
+	p = std::min(c, p + delta_);
+
+	// The ghost node becomes the resident one, 'replace' doesn't look at it
+	removeList(node);
+	replace(false);
+
+	assert(free_elems_count != 0);
+
+	node->elem = free_elems[--free_elems_count];
+	pushList(LIST_T2, node);
+
+	return node;
+}
+
+template<class T, class KeyT, size_t Capacity>
+inline typename StaticARCache<T, KeyT, Capacity>::Node* StaticARCache<T, KeyT,
+		Capacity>::foundB2(Node *node) {
+	assert(node);
+
+	// Found it in B2 - T2 should be bigger
+	size_t delta_ = std::max<size_t>(1, B1.size() / B2.size());
+	p = (p > delta_) ? p - delta_ : 0;
+
+	removeList(node);
+	replace(true);
+
+	assert(free_elems_count != 0);
+
+	node->elem = free_elems[--free_elems_count];
+	pushList(LIST_T2, node);
+
+	return node;
+}
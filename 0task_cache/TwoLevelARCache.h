@@ -0,0 +1,277 @@
+#pragma once
+
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <utility>
+
+#include "ARCache.h"
+
+//! @brief How the levels of TwoLevelARCache share the keys
+enum hierarchyPolicy {
+	//! A key is in one level at most: an L2 hit moves the entry up to L1,
+	//! an entry evicted from L1 is demoted into L2. The total capacity is
+	//! the sum of the levels
+	HIERARCHY_EXCLUSIVE,
+	//! Every key of L1 is in L2 too: an L2 hit copies the entry up, an entry
+	//! evicted from L2 is invalidated in L1. The total capacity is L2
+	HIERARCHY_INCLUSIVE
+};
+
+//! @brief Hit statistics of one level
+struct levelStats {
+	size_t hits;
+	//! Accesses that reached the level (L2 sees only the misses of L1)
+	size_t lookups;
+	//! Entries that came into the level from the other one
+	//! (demoted from L1 into L2 or moved up from L2 into L1)
+	size_t transfers;
+};
+
+//! @brief Small L1 ARC cache in front of a big L2 ARC cache. Both levels
+//! are plain ARCache objects with their own 'p' and ghosts, the hierarchy
+//! moves entries between them through the eviction handler of ARCache, so
+//! an entry is counted once and every level adapts only to the accesses it
+//! really sees: L1 to all of them, L2 to the misses of L1 and to the demoted
+//! entries. An entry moved to the other level leaves no ghost behind (it was
+//! not evicted), so its return is not taken for a ghost hit.
+//!
+//! Not thread safe, the caller locks the hierarchy (or every thread has one)
+//! @param T - the type of the currently caching data
+template<class T, class KeyT = int> class TwoLevelARCache {
+	ARCache<T, KeyT> L1;
+	ARCache<T, KeyT> L2;
+
+	hierarchyPolicy policy;
+
+	//! Exclusive mode: the keys moved up from L2 on a hit (as many as L1 may
+	//! keep), they go back into T2 of L2 when demoted
+	ghostList promoted;
+	size_t promoted_max;
+
+	levelStats stats[2];
+
+	//! Look the key up in L1, then in L2, then load it
+	//! @param hit - true is written if the key was found in any level
+	template<class Loader>
+	T& access(const KeyT &key, Loader loader, bool &hit);
+	//! Take the element from L2 (or load it) on a miss of L1
+	template<class Loader>
+	T& fill(const KeyT &key, Loader loader, bool &hit);
+public:
+	//! @param l1_size, l2_size - the sizes of the levels (an exclusive
+	//! hierarchy with 'l1_size' 0 works as L2 alone)
+	TwoLevelARCache(size_t l1_size, size_t l2_size, hierarchyPolicy policy =
+			HIERARCHY_EXCLUSIVE);
+
+	TwoLevelARCache(const TwoLevelARCache &rhs) = delete;
+	TwoLevelARCache& operator=(const TwoLevelARCache &rhs) = delete;
+
+	//! Looks if the given element is in any level
+	//! (the element is copied into the cache on a miss)
+	bool lookup(const T *elem);
+	//! Returns the cached element of the key, on a miss of both levels it is
+	//! loaded with 'loader(key)' once and put into L1
+	template<class Loader>
+	T& get_or_load(const KeyT &key, Loader loader);
+	//! Move the element into the cache (replacing the cached one), counts as an access
+	T& insert(const KeyT &key, T &&elem);
+
+	hierarchyPolicy getPolicy() const;
+	//! Hit statistics of the level (0 - L1, 1 - L2)
+	levelStats getStats(size_t level) const;
+	//! @brief ARC state and event counters of the level (0 - L1, 1 - L2).
+	//! In the exclusive mode the accesses of L2 are its hits on the misses of
+	//! L1 and the demotions: a demoted key is a miss of L2 (a ghost hit if L2
+	//! evicted it before), except the keys L2 itself handed up, they go back
+	//! into T2 without an access. In the inclusive mode L2 counts the misses
+	//! of L1 only
+	arcSnapshot levelSnapshot(size_t level) const;
+	//! Print hit statistics of both levels
+	void printStats() const;
+};
+
+template<class T, class KeyT>
+inline TwoLevelARCache<T, KeyT>::TwoLevelARCache(size_t l1_size,
+		size_t l2_size, hierarchyPolicy policy) :
+		L1(l1_size), L2(l2_size), policy(policy), promoted_max(l1_size), stats {
+				{ 0, 0, 0 }, { 0, 0, 0 } } {
+	if (policy == HIERARCHY_EXCLUSIVE) {
+		L1.setEvictionHandler([this](const KeyT &key, T &&elem) {
+			stats[1].transfers++;
+
+			if (promoted.remove(ghostList::fingerprint(hashKey(key))) != 0)
+				L2.insertFrequent(key, std::move(elem));
+			else
+				L2.insert(key, std::move(elem));
+		});
+	} else {
+		// L1 may keep only what L2 keeps, L1 didn't evict the key itself
+		// so it is not a ghost there
+		L2.setEvictionHandler([this](const KeyT &key, T&&) {
+			L1.extract(key, false);
+		});
+	}
+}
+
+template<class T, class KeyT>
+template<class Loader>
+inline T& TwoLevelARCache<T, KeyT>::fill(const KeyT &key, Loader loader,
+		bool &hit) {
+	stats[1].lookups++;
+
+	if (policy == HIERARCHY_EXCLUSIVE && promoted_max != 0) {
+		// The hit is an access of L2, then the entry moves up without leaving
+		// a ghost: its demotion later must not look like a ghost hit of L2
+		std::optional<T> elem_;
+
+		if (L2.find(key) != nullptr)
+			elem_ = L2.extract(key, false);
+
+		if (elem_) {
+			hit = true;
+			stats[1].hits++;
+			stats[0].transfers++;
+
+			promoted.push_front(ghostList::fingerprint(hashKey(key)), 1);
+			if (promoted.size() > promoted_max)
+				promoted.pop_back();
+
+			return L1.insert(key, std::move(*elem_));
+		}
+
+		// Evicting from L1 for the new entry demotes into L2
+		return L1.insert(key, loader(key));
+	}
+
+	bool loaded_ = false;
+	T &elem_ = L2.get_or_load(key, [&](const KeyT &key_) {
+		loaded_ = true;
+		return loader(key_);
+	});
+
+	if (!loaded_) {
+		hit = true;
+		stats[1].hits++;
+	}
+
+	// An exclusive L1 of zero size keeps nothing, the entry stays in L2
+	if (policy == HIERARCHY_EXCLUSIVE)
+		return elem_;
+
+	if (!loaded_)
+		stats[0].transfers++;
+
+	return L1.insert(key, T(elem_));
+}
+
+template<class T, class KeyT>
+inline bool TwoLevelARCache<T, KeyT>::lookup(const T *elem) {
+	assert(elem);
+
+	bool hit_ = false;
+
+	access(elem->id, [&](const KeyT&) {
+		return *elem;
+	}, hit_);
+
+	return hit_;
+}
+
+template<class T, class KeyT>
+template<class Loader>
+inline T& TwoLevelARCache<T, KeyT>::get_or_load(const KeyT &key,
+		Loader loader) {
+	bool hit_ = false;
+
+	return access(key, loader, hit_);
+}
+
+template<class T, class KeyT>
+template<class Loader>
+inline T& TwoLevelARCache<T, KeyT>::access(const KeyT &key, Loader loader,
+		bool &hit) {
+	stats[0].lookups++;
+
+	T *elem_ = L1.find(key);
+
+	if (elem_ != nullptr) {
+		hit = true;
+		stats[0].hits++;
+
+		return *elem_;
+	}
+
+	return fill(key, loader, hit);
+}
+
+template<class T, class KeyT>
+inline T& TwoLevelARCache<T, KeyT>::insert(const KeyT &key, T &&elem) {
+	stats[0].lookups++;
+
+	T *elem_ = L1.find(key);
+
+	if (elem_ != nullptr) {
+		stats[0].hits++;
+
+		if (policy == HIERARCHY_INCLUSIVE)
+			L2.insert(key, T(elem));
+
+		*elem_ = std::move(elem);
+		return *elem_;
+	}
+
+	if (policy == HIERARCHY_EXCLUSIVE && promoted_max == 0)
+		return L2.insert(key, std::move(elem));
+
+	if (policy == HIERARCHY_EXCLUSIVE) {
+		// The old element in L2 is not valid any more
+		L2.extract(key, false);
+
+		return L1.insert(key, std::move(elem));
+	}
+
+	L2.insert(key, T(elem));
+
+	return L1.insert(key, std::move(elem));
+}
+
+template<class T, class KeyT>
+inline hierarchyPolicy TwoLevelARCache<T, KeyT>::getPolicy() const {
+	return policy;
+}
+
+template<class T, class KeyT>
+inline levelStats TwoLevelARCache<T, KeyT>::getStats(size_t level) const {
+	assert(level < 2);
+
+	return stats[level];
+}
+
+template<class T, class KeyT>
+inline arcSnapshot TwoLevelARCache<T, KeyT>::levelSnapshot(
+		size_t level) const {
+	assert(level < 2);
+
+	return (level == 0) ? L1.snapshot() : L2.snapshot();
+}
+
+template<class T, class KeyT>
+inline void TwoLevelARCache<T, KeyT>::printStats() const {
+	std::cout << "================\n";
+
+	for (size_t i = 0; i < 2; i++) {
+		float percent_ =
+				stats[i].lookups ?
+						((float) stats[i].hits) * 100.f / stats[i].lookups :
+						0.f;
+
+		std::cout << "L" << i + 1 << ": hits - " << stats[i].hits
+				<< ", lookups - " << stats[i].lookups << " ("
+				<< std::setprecision(3) << percent_ << "%), transfers in - "
+				<< stats[i].transfers << "\n";
+	}
+
+	std::cout << "================\n";
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <optional>
+#include <unordered_map>
+
+#include "cachePolicy.h"
+#include "intrusiveList.h"
+#include "slabPool.h"
+
+//! @brief 2Q cache (full version): new entries go to the FIFO A1in, entries
+//! pushed out of A1in are remembered by keys in the FIFO A1out, and only
+//! the entries accessed again while they are in A1out get to the LRU Am
+//! @param T - the type of the currently caching data
+//! @param A1in - FIFO of resident entries accessed once (c / 4 entries)
+//! @param A1out - FIFO of "ghost" entries removed from A1in (c / 2 entries)
+//! @param Am - LRU list of resident frequent entries
+template<class T, class KeyT = int>
+class TwoQCache: public policyBase<TwoQCache<T, KeyT>, T, KeyT> {
+	friend class policyBase<TwoQCache<T, KeyT>, T, KeyT>;
+
+	//! The list the node is linked into
+	enum listId {
+		LIST_A1IN, LIST_A1OUT, LIST_AM
+	};
+
+	struct Node {
+		KeyT key;
+		//! Cached element, empty for "ghost" entries
+		std::optional<T> elem;
+
+		Node *prev;
+		Node *next;
+
+		listId list;
+	};
+
+	//! New entries at the front, old ones at the back
+	intrusiveList<Node> A1in;
+	intrusiveList<Node> A1out;
+	intrusiveList<Node> Am;
+
+	std::unordered_map<KeyT, Node*> index;
+	slabPool<Node> slab;
+
+	size_t c;
+	size_t Kin;
+	size_t Kout;
+
+	//! Free one place in the cache if it is full
+	void reclaim();
+	//! Forget the node completely
+	void dropNode(Node *node);
+
+	size_t capacity() const;
+	Node* findNode(const KeyT &key);
+	bool isResident(Node *node) const;
+	std::optional<T>& touch(Node *node);
+	std::optional<T>& admit(const KeyT &key, Node *node);
+public:
+	TwoQCache(size_t cache_size);
+
+	//! Print all the lists that 2Q uses (for debug only)
+	void printLists();
+};
+
+template<class T, class KeyT>
+inline TwoQCache<T, KeyT>::TwoQCache(size_t cache_size) :
+		slab(cache_size + std::max<size_t>(1, cache_size / 2) + 1), c(
+				cache_size), Kin(std::max<size_t>(1, cache_size / 4)), Kout(
+				std::max<size_t>(1, cache_size / 2)) {
+	index.reserve(cache_size + Kout + 1);
+}
+
+template<class T, class KeyT>
+inline void TwoQCache<T, KeyT>::reclaim() {
+	if (A1in.size() + Am.size() < c)
+		return;
+
+	if (A1in.size() > Kin || Am.empty()) {
+		// Remember the oldest entry of A1in in A1out
+		Node *node = A1in.back();
+
+		A1in.remove(node);
+		this->evicted(node->key, node->elem);
+		node->elem.reset();
+
+		node->list = LIST_A1OUT;
+		A1out.push_front(node);
+
+		if (A1out.size() > Kout) {
+			Node *ghost_ = A1out.back();
+
+			A1out.remove(ghost_);
+			dropNode(ghost_);
+		}
+	} else {
+		Node *node = Am.back();
+
+		Am.remove(node);
+		this->evicted(node->key, node->elem);
+		dropNode(node);
+	}
+}
+
+template<class T, class KeyT>
+inline void TwoQCache<T, KeyT>::dropNode(Node *node) {
+	index.erase(node->key);
+
+	node->elem.reset();
+	slab.release(node);
+}
+
+template<class T, class KeyT>
+inline size_t TwoQCache<T, KeyT>::capacity() const {
+	return c;
+}
+
+template<class T, class KeyT>
+inline typename TwoQCache<T, KeyT>::Node* TwoQCache<T, KeyT>::findNode(
+		const KeyT &key) {
+	auto hit = index.find(key);
+
+	if (hit == index.end())
+		return nullptr;
+
+	return hit->second;
+}
+
+template<class T, class KeyT>
+inline bool TwoQCache<T, KeyT>::isResident(Node *node) const {
+	return node->list != LIST_A1OUT;
+}
+
+template<class T, class KeyT>
+inline std::optional<T>& TwoQCache<T, KeyT>::touch(Node *node) {
+	assert(node);
+
+	// Entries of A1in stay where they are - correlated accesses don't count
+	if (node->list == LIST_AM)
+		Am.move_to_front(node);
+
+	return node->elem;
+}
+
+template<class T, class KeyT>
+inline std::optional<T>& TwoQCache<T, KeyT>::admit(const KeyT &key,
+		Node *node) {
+	// Take the ghost out first, so reclaiming can't forget it
+	if (node != nullptr)
+		A1out.remove(node);
+
+	reclaim();
+
+	if (node != nullptr) {
+		// Found it in A1out - it is frequent
+		node->list = LIST_AM;
+		Am.push_front(node);
+
+		return node->elem;
+	}
+
+	node = slab.acquire();
+	assert(node);
+
+	node->key = key;
+	node->list = LIST_A1IN;
+	A1in.push_front(node);
+
+	index.emplace(key, node);
+
+	return node->elem;
+}
+
+template<class T, class KeyT>
+inline void TwoQCache<T, KeyT>::printLists() {
+	std::cout << "================\n";
+
+	std::cout << "A1in: ";
+	for (Node *node = A1in.front(); node != nullptr; node = node->next) {
+		std::cout << node->key << " ";
+	}
+
+	std::cout << "\n";
+
+	std::cout << "A1out: ";
+	for (Node *node = A1out.front(); node != nullptr; node = node->next) {
+		std::cout << node->key << " ";
+	}
+
+	std::cout << "\n";
+
+	std::cout << "Am: ";
+	for (Node *node = Am.front(); node != nullptr; node = node->next) {
+		std::cout << node->key << " ";
+	}
+
+	std::cout << "\n";
+	std::cout << "================\n";
+}
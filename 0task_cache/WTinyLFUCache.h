@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <optional>
+
+#include "ARCache.h"
+#include "countMinSketch.h"
+#include "flatHashMap.h"
+#include "hashMix.h"
+#include "intrusiveList.h"
+#include "slabPool.h"
+
+//! @brief W-TinyLFU admission in front of ARC. New entries go to a small window
+//! LRU (1% of the cache), the entry pushed out of the window is a candidate for
+//! the main ARC cache: it is admitted only if ARC doesn't need to evict anything
+//! for it, or if the sketch says that it is accessed at least as often as the
+//! entry ARC would evict (ARC resists scans itself, a tie costs it at most a
+//! one-hit victim). So one-hit wonders of scans die in the window and don't
+//! push hot entries out of ARC.
+//!
+//! Use it instead of plain ARC when the frequency of keys is stable (zipf-like
+//! traffic, with or without scans) or when a loop slightly bigger than the
+//! cache repeats. Plain ARC is better when the popular keys keep shifting
+//! (the sketch remembers the old ones) and when the hot set is uniform
+//! (then the window only takes 1% of the room from it)
+//! @param T - the type of the currently caching data
+//! @param window - LRU list of the newest entries, MRU at the front
+//! @param main - ARC cache of the admitted entries
+//! @param sketch - recent frequencies of all accessed keys (resident or not)
+template<class T, class KeyT = int>
+class WTinyLFUCache {
+	struct Node {
+		KeyT key;
+		std::optional<T> elem;
+
+		Node *prev;
+		Node *next;
+	};
+
+	intrusiveList<Node> window;
+	flatHashMap<KeyT, Node*> window_index;
+	slabPool<Node> window_slab;
+	size_t window_size;
+
+	ARCache<T, KeyT> main;
+	countMinSketch sketch;
+
+	//! Keeps the element when the cache has zero size
+	std::optional<T> uncached;
+
+	//! Gets the candidates ARC doesn't admit (ARC reports its own evictions)
+	std::function<void(const KeyT&, T&&, evictionReason)> evict_listener;
+
+	//! Count the access in the sketch and return the resident element
+	//! (updating the window or ARC on a hit), nullptr on a miss
+	T* access(const KeyT &key);
+	//! Put the missed element into the window, its LRU entry goes to ARC
+	//! if it wins against the ARC victim
+	T& admit(const KeyT &key, T &&elem);
+	//! Take the LRU entry out of the window and offer it to ARC
+	void evictCandidate();
+	//! Keep the element of the cache of zero size for the caller, the listener
+	//! gets a copy as evicted at once
+	T& keepUncached(const KeyT &key, T &&elem);
+public:
+	WTinyLFUCache(size_t cache_size);
+
+	//! Print the window and ARC lists (for debug only)
+	void printLists();
+	//! Looks if the given element is in the cache
+	//! (the element is copied into the cache on a miss)
+	bool lookup(const T *elem);
+	//! Returns the cached element of the key, on a miss it is loaded
+	//! with 'loader(key)' once and moved into the cache
+	template<class Loader>
+	T& get_or_load(const KeyT &key, Loader loader);
+	//! Move the element into the cache (replacing the cached one), counts as an access
+	T& insert(const KeyT &key, T &&elem);
+
+	//! Call 'listener(key, elem, EVICT_CAPACITY)' for every element that leaves
+	//! the cache: a candidate of the window ARC rejects or an entry ARC evicts.
+	//! The listener must not access this cache
+	void setEvictionListener(
+			std::function<void(const KeyT&, T&&, evictionReason)> listener);
+};
+
+template<class T, class KeyT>
+inline WTinyLFUCache<T, KeyT>::WTinyLFUCache(size_t cache_size) :
+		window_slab((cache_size != 0) ? std::max<size_t>(1, cache_size / 100) : 0), window_size(
+				window_slab.max_size()), main(cache_size - window_size), sketch(
+				cache_size) {
+	window_index.reserve(window_size);
+}
+
+template<class T, class KeyT>
+inline T* WTinyLFUCache<T, KeyT>::access(const KeyT &key) {
+	sketch.increment(hashKey(key));
+
+	auto hit = window_index.find(key);
+
+	if (hit != window_index.end()) {
+		Node *node = hit->second;
+
+		window.move_to_front(node);
+		return &*node->elem;
+	}
+
+	return main.find(key);
+}
+
+template<class T, class KeyT>
+inline void WTinyLFUCache<T, KeyT>::evictCandidate() {
+	Node *candidate_ = window.back();
+	assert(candidate_);
+
+	window.remove(candidate_);
+	window_index.erase(candidate_->key);
+
+	const KeyT *victim_ = main.victim();
+
+	if (victim_ == nullptr
+			|| sketch.frequency(hashKey(candidate_->key))
+					>= sketch.frequency(hashKey(*victim_)))
+		main.insert(candidate_->key, std::move(*candidate_->elem));
+	else if (evict_listener)
+		evict_listener(candidate_->key, std::move(*candidate_->elem),
+				EVICT_CAPACITY);
+
+	candidate_->elem.reset();
+	window_slab.release(candidate_);
+}
+
+template<class T, class KeyT>
+inline T& WTinyLFUCache<T, KeyT>::keepUncached(const KeyT &key, T &&elem) {
+	uncached.emplace(std::move(elem));
+
+	if (evict_listener)
+		evict_listener(key, T(*uncached), EVICT_CAPACITY);
+
+	return *uncached;
+}
+
+template<class T, class KeyT>
+inline T& WTinyLFUCache<T, KeyT>::admit(const KeyT &key, T &&elem) {
+	if (window.size() == window_size)
+		evictCandidate();
+
+	Node *node = window_slab.acquire();
+	assert(node);
+
+	node->key = key;
+	node->elem.emplace(std::move(elem));
+
+	window.push_front(node);
+	window_index.emplace(key, node);
+
+	return *node->elem;
+}
+
+template<class T, class KeyT>
+inline bool WTinyLFUCache<T, KeyT>::lookup(const T *elem) {
+	if (window_size == 0)
+		return false;
+
+	if (access(elem->id) != nullptr)
+		return true;
+
+	admit(elem->id, T(*elem));
+
+	return false;
+}
+
+template<class T, class KeyT>
+template<class Loader>
+inline T& WTinyLFUCache<T, KeyT>::get_or_load(const KeyT &key,
+		Loader loader) {
+	if (window_size == 0)
+		return keepUncached(key, loader(key));
+
+	T *elem_ = access(key);
+
+	if (elem_ != nullptr)
+		return *elem_;
+
+	return admit(key, loader(key));
+}
+
+template<class T, class KeyT>
+inline T& WTinyLFUCache<T, KeyT>::insert(const KeyT &key, T &&elem) {
+	if (window_size == 0)
+		return keepUncached(key, std::move(elem));
+
+	T *elem_ = access(key);
+
+	if (elem_ != nullptr) {
+		*elem_ = std::move(elem);
+		return *elem_;
+	}
+
+	return admit(key, std::move(elem));
+}
+
+template<class T, class KeyT>
+inline void WTinyLFUCache<T, KeyT>::printLists() {
+	std::cout << "Window: ";
+	for (Node *node = window.front(); node != nullptr; node = node->next) {
+		std::cout << node->key << " ";
+	}
+	std::cout << "\n";
+
+	main.printLists();
+}
+
+template<class T, class KeyT>
+inline void WTinyLFUCache<T, KeyT>::setEvictionListener(
+		std::function<void(const KeyT&, T&&, evictionReason)> listener) {
+	main.setEvictionListener(listener);
+	evict_listener = std::move(listener);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+//! @brief Header of the ARCache snapshot file (see ARCache::save). It is
+//! followed by the records of T1 and T2 from the MRU end to the LRU one:
+//! the key, the element (both as they are in memory), the weight and the
+//! remaining TTL (8 bytes each, 0 - no TTL), and then by the ghosts of B1
+//! and B2 from the newest to the oldest: the fingerprint and the weight
+//! (4 bytes each). Records are packed, the numbers are in the byte order
+//! of the machine - the snapshot is restored by the same build
+struct arcFileHeader {
+	//! "ARCS"
+	char magic[4];
+	uint32_t version;
+	uint32_t key_size;
+	uint32_t elem_size;
+
+	uint64_t c;
+	uint64_t p;
+
+	uint64_t T1_count;
+	uint64_t T2_count;
+	uint64_t B1_count;
+	uint64_t B2_count;
+};
+
+static_assert(sizeof(arcFileHeader) == 64, "The header must be packed");
+
+namespace detail {
+	const char arc_magic[4] = { 'A', 'R', 'C', 'S' };
+	const uint32_t arc_version = 1;
+
+	//! The size of the record of a ghost entry
+	const size_t ghost_record_size = 2 * sizeof(uint32_t);
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+//! @brief Events counted by ARCache
+enum telemetryEvent {
+	EVENT_HIT_T1,
+	EVENT_HIT_T2,
+	//! Misses of keys found in the ghost lists (counted as misses too)
+	EVENT_GHOST_B1,
+	EVENT_GHOST_B2,
+	EVENT_MISS,
+	//! Resident entries that left the cache to make place
+	EVENT_EVICTION,
+	//! Resident entries that left the cache because their TTL ran out
+	EVENT_EXPIRATION,
+	EVENT_COUNT
+};
+
+//! @brief Why the entry left the cache
+enum evictionReason {
+	//! Evicted to make place, its key became a ghost
+	EVICT_CAPACITY,
+	//! Evicted to make place without becoming a ghost: the history is full
+	//! (T1 takes the whole cache), so the ghost is trimmed at once
+	EVICT_GHOST_TRIM,
+	//! Its TTL ran out
+	EVICT_TTL
+};
+
+inline const char* reasonName(evictionReason reason) {
+	switch (reason) {
+	case EVICT_CAPACITY:
+		return "capacity";
+	case EVICT_GHOST_TRIM:
+		return "ghost trim";
+	case EVICT_TTL:
+		return "ttl";
+	}
+
+	return "unknown";
+}
+
+//! @brief The state of ARCache at some moment
+struct arcSnapshot {
+	size_t accesses;
+	size_t hits_T1;
+	size_t hits_T2;
+	size_t ghost_hits_B1;
+	size_t ghost_hits_B2;
+	size_t misses;
+	size_t evictions;
+	size_t expirations;
+
+	size_t c;
+	size_t p;
+	size_t T1_size;
+	size_t T2_size;
+	size_t B1_size;
+	size_t B2_size;
+
+	//! Sampled values of 'p': {the number of the access, p}
+	std::vector<std::pair<size_t, size_t>> p_history;
+};
+
+//! @brief Write the snapshot as one JSON object (without a line break)
+inline void writeJSON(std::ostream &out, const arcSnapshot &snapshot) {
+	out << "{\"accesses\": " << snapshot.accesses << ", \"hits_T1\": "
+			<< snapshot.hits_T1 << ", \"hits_T2\": " << snapshot.hits_T2
+			<< ", \"ghost_hits_B1\": " << snapshot.ghost_hits_B1
+			<< ", \"ghost_hits_B2\": " << snapshot.ghost_hits_B2
+			<< ", \"misses\": " << snapshot.misses << ", \"evictions\": "
+			<< snapshot.evictions << ", \"expirations\": "
+			<< snapshot.expirations << ", \"c\": " << snapshot.c << ", \"p\": "
+			<< snapshot.p << ", \"T1\": " << snapshot.T1_size << ", \"T2\": "
+			<< snapshot.T2_size << ", \"B1\": " << snapshot.B1_size
+			<< ", \"B2\": " << snapshot.B2_size << ", \"p_history\": [";
+
+	for (size_t i = 0; i < snapshot.p_history.size(); i++) {
+		out << (i ? ", " : "") << "[" << snapshot.p_history[i].first << ", "
+				<< snapshot.p_history[i].second << "]";
+	}
+
+	out << "]}";
+}
+
+//! @brief Counters of ARCache events and the history of 'p'. Every thread
+//! counts into its own cache line, the lines are summed up only on read,
+//! so recording an event never contends with other threads. The history
+//! keeps at most 'history_capacity' samples: when it is full every other
+//! sample is dropped and 'p' is sampled twice less often
+class arcTelemetry {
+	static constexpr size_t slots_count = 32;
+	static constexpr size_t history_capacity = 1024;
+
+	struct alignas(64) Slot {
+		std::atomic<size_t> events[EVENT_COUNT];
+	};
+
+	//! Threads are spread over the slots by the order they first count in
+	std::unique_ptr<Slot[]> slots;
+
+	//! Accesses of the cache, they are serialized by the cache's owner
+	size_t accesses;
+	//! A power of two, so sampling costs a mask instead of a division
+	size_t sample_period;
+	std::vector<std::pair<size_t, size_t>> p_history;
+
+	std::ostream *dump;
+	size_t dump_period;
+	size_t next_dump;
+
+	static size_t threadSlot();
+public:
+	arcTelemetry();
+
+	void record(telemetryEvent event);
+	//! Count the finished access and sample 'p'
+	//! @return true if it is time to dump the snapshot
+	bool access(size_t p);
+
+	//! The amount of events of all threads
+	size_t count(telemetryEvent event) const;
+	size_t accesses_count() const;
+	const std::vector<std::pair<size_t, size_t>>& history() const;
+
+	//! Dump the snapshot into 'out' every 'period' accesses (nullptr stops dumping)
+	void setDump(std::ostream *out, size_t period);
+	std::ostream* dumpStream() const;
+};
+
+inline arcTelemetry::arcTelemetry() :
+		slots(new Slot[slots_count]), accesses(0), sample_period(1), dump(
+				nullptr), dump_period(0), next_dump(0) {
+	for (size_t i = 0; i < slots_count; i++) {
+		for (auto &event : slots[i].events)
+			event.store(0, std::memory_order_relaxed);
+	}
+
+	p_history.reserve(history_capacity);
+}
+
+inline size_t arcTelemetry::threadSlot() {
+	static std::atomic<size_t> next_thread(0);
+	thread_local size_t slot_ = next_thread.fetch_add(1) % slots_count;
+
+	return slot_;
+}
+
+inline void arcTelemetry::record(telemetryEvent event) {
+	slots[threadSlot()].events[event].fetch_add(1, std::memory_order_relaxed);
+}
+
+inline bool arcTelemetry::access(size_t p) {
+	accesses++;
+
+	if ((accesses & (sample_period - 1)) == 0) {
+		if (p_history.size() == history_capacity) {
+			// Keep every other sample
+			for (size_t i = 0; i < history_capacity / 2; i++)
+				p_history[i] = p_history[2 * i + 1];
+
+			p_history.resize(history_capacity / 2);
+			sample_period *= 2;
+		}
+
+		// The samples kept are at the multiples of the new period
+		if ((accesses & (sample_period - 1)) == 0)
+			p_history.emplace_back(accesses, p);
+	}
+
+	if (dump == nullptr || accesses != next_dump)
+		return false;
+
+	next_dump += dump_period;
+
+	return true;
+}
+
+inline size_t arcTelemetry::count(telemetryEvent event) const {
+	size_t count_ = 0;
+
+	for (size_t i = 0; i < slots_count; i++)
+		count_ += slots[i].events[event].load(std::memory_order_relaxed);
+
+	return count_;
+}
+
+inline size_t arcTelemetry::accesses_count() const {
+	return accesses;
+}
+
+inline const std::vector<std::pair<size_t, size_t>>& arcTelemetry::history() const {
+	return p_history;
+}
+
+inline void arcTelemetry::setDump(std::ostream *out, size_t period) {
+	dump = (period != 0) ? out : nullptr;
+	dump_period = period;
+	next_dump = accesses + period;
+}
+
+inline std::ostream* arcTelemetry::dumpStream() const {
+	return dump;
+}
@@ -0,0 +1,381 @@
+// Replays accesses through every cache policy in front of a simulated backend
+// (backingStore) and reports the effective access time and the operations of
+// the backend, not only the hit ratio: with writes and batched write-back two
+// policies of the same hit ratio may cost the backend very differently.
+//
+// A part of the accesses are writes (chosen by the hash of the position, so
+// all policies see the same writes). Writes allocate the element in the cache;
+// in the write-through mode they go to the backend at once, in the write-back
+// mode the element is written when it leaves the cache, by batches of '-f'.
+// The time is simulated from the model, nothing sleeps.
+//
+// Usage: backendBench <trace | gen:workload> [-c cache_size]... [-p policy]...
+//     [-w write_fraction] [-m back|through] [-r read_ns] [-W write_ns]
+//     [-b bytes_per_ns] [-h hit_ns] [-e elem_bytes] [-f flush_batch]
+//     [-n memory_size] [-s seed] [-l label] [-o report.json]
+// The backend is Memory of '-n' elements with ids from 1, other keys read as
+// elements made up from the key and only the written ones are kept. Belady is
+// not run.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ARCache.h"
+#include "CARCache.h"
+#include "LFUCache.h"
+#include "LIRSCache.h"
+#include "LRUCache.h"
+#include "TwoQCache.h"
+#include "WTinyLFUCache.h"
+#include "backingStore.h"
+#include "cacheData.h"
+#include "cachePolicy.h"
+#include "hashMix.h"
+#include "jsonString.h"
+#include "Memory.h"
+#include "trace.h"
+#include "workloadGen.h"
+
+namespace {
+
+//! Keys replayed at once
+const size_t chunk = 1 << 16;
+const size_t default_memory_size = 100000;
+
+struct backendOptions {
+	backendModel model;
+	writePolicy mode;
+	double write_fraction;
+	int memory_size;
+};
+
+struct backendResult {
+	std::string policy;
+	size_t cache_size;
+	backendStats stats;
+};
+
+//! @brief The trace read like workloadGenerator
+template<class KeyT>
+class traceSource {
+	const trace<KeyT> &accesses;
+	size_t position;
+public:
+	size_t size;
+
+	traceSource(const trace<KeyT> &accesses_);
+
+	size_t read(KeyT *keys, size_t count);
+	void reset();
+};
+
+template<class KeyT>
+traceSource<KeyT>::traceSource(const trace<KeyT> &accesses_) :
+		accesses(accesses_), position(0), size(accesses_.size) {
+}
+
+template<class KeyT>
+size_t traceSource<KeyT>::read(KeyT *keys, size_t count) {
+	size_t read_ = std::min(count, size - position);
+
+	std::copy(accesses.keys + position, accesses.keys + position + read_, keys);
+	position += read_;
+
+	return read_;
+}
+
+template<class KeyT>
+void traceSource<KeyT>::reset() {
+	position = 0;
+}
+
+//! The same accesses are writes for every policy
+bool isWrite(size_t position, double write_fraction) {
+	return (mixHash(position) >> 11) * (1.0 / (uint64_t(1) << 53))
+			< write_fraction;
+}
+
+//! Replay all accesses of the source through the policy in front of a new backend
+template<class Cache, class KeyT, class Source>
+backendResult runPolicy(const std::string &policy, size_t cache_size,
+		Source &source, const backendOptions &options) {
+	using elemT = cacheData<KeyT, KeyT>;
+
+	static_assert(isCachePolicy<Cache, elemT, KeyT>::value,
+			"The cache must have the common interface of policies");
+
+	// Every run writes its own memory
+	Memory<elemT> memory_(options.memory_size);
+
+	for (int i = 0; i < memory_.size; i++) {
+		memory_.data[i].id = i + 1;
+		memory_.data[i].data = i + 1;
+	}
+
+	backingStore<elemT, KeyT> store_(memory_, options.model);
+	Cache cache_(cache_size);
+	storeFrontend<Cache, elemT, KeyT> frontend_(cache_, store_, options.mode);
+
+	std::vector<KeyT> keys_(chunk);
+	size_t position_ = 0;
+	elemT elem_;
+
+	source.reset();
+
+	for (size_t count_; (count_ = source.read(keys_.data(), keys_.size())) != 0;) {
+		for (size_t i = 0; i < count_; i++, position_++) {
+			if (isWrite(position_, options.write_fraction)) {
+				elem_.id = keys_[i];
+				elem_.data = position_;
+
+				frontend_.write(keys_[i], elem_);
+			} else
+				frontend_.read(keys_[i]);
+		}
+	}
+
+	frontend_.finish();
+
+	return backendResult { policy, cache_size, store_.getStats() };
+}
+
+template<class KeyT, class Source>
+bool run(const std::string &policy, size_t cache_size, Source &source,
+		const backendOptions &options, backendResult &result) {
+	using elemT = cacheData<KeyT, KeyT>;
+
+	if (policy == "arc")
+		result = runPolicy<ARCache<elemT, KeyT>, KeyT>(policy, cache_size,
+				source, options);
+	else if (policy == "car")
+		result = runPolicy<CARCache<elemT, KeyT>, KeyT>(policy, cache_size,
+				source, options);
+	else if (policy == "wtinylfu_arc")
+		result = runPolicy<WTinyLFUCache<elemT, KeyT>, KeyT>(policy,
+				cache_size, source, options);
+	else if (policy == "lru")
+		result = runPolicy<LRUCache<elemT, KeyT>, KeyT>(policy, cache_size,
+				source, options);
+	else if (policy == "lfu")
+		result = runPolicy<LFUCache<elemT, KeyT>, KeyT>(policy, cache_size,
+				source, options);
+	else if (policy == "2q")
+		result = runPolicy<TwoQCache<elemT, KeyT>, KeyT>(policy, cache_size,
+				source, options);
+	else if (policy == "lirs")
+		result = runPolicy<LIRSCache<elemT, KeyT>, KeyT>(policy, cache_size,
+				source, options);
+	else
+		return false;
+
+	return true;
+}
+
+void writeReport(std::ostream &out, const std::string &label,
+		const std::string &trace_name, const backendOptions &options,
+		const std::vector<backendResult> &results) {
+	const backendModel &model_ = options.model;
+
+	out << "{\n";
+	out << "  \"label\": " << jsonString(label) << ",\n";
+	out << "  \"trace\": " << jsonString(trace_name) << ",\n";
+	out << "  \"mode\": \""
+			<< (options.mode == WRITE_BACK ? "write_back" : "write_through")
+			<< "\",\n";
+	out << "  \"write_fraction\": " << options.write_fraction << ",\n";
+	out << "  \"model\": {\"hit_ns\": " << model_.hit_ns
+			<< ", \"read_latency_ns\": " << model_.read_latency_ns
+			<< ", \"write_latency_ns\": " << model_.write_latency_ns
+			<< ", \"bytes_per_ns\": " << model_.bandwidth << ", \"elem_bytes\": "
+			<< model_.elem_bytes << ", \"flush_batch\": " << model_.flush_batch
+			<< "},\n";
+	out << "  \"results\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const backendResult &result_ = results[i];
+		const backendStats &stats_ = result_.stats;
+		double hit_ratio_ =
+				stats_.accesses ? (double) stats_.hits / stats_.accesses : 0;
+
+		out << "    {\"policy\": " << jsonString(result_.policy)
+				<< ", \"cache_size\": " << result_.cache_size
+				<< ", \"accesses\": " << stats_.accesses
+				<< ", \"hits\": " << stats_.hits << ", \"hit_ratio\": "
+				<< std::setprecision(6) << hit_ratio_
+				<< ", \"ns_per_access\": " << stats_.nsPerAccess()
+				<< ", \"backend_reads\": " << stats_.reads
+				<< ", \"backend_writes\": " << stats_.writes
+				<< ", \"write_requests\": " << stats_.write_requests << "}"
+				<< (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n";
+	out << "}\n";
+}
+
+//! Run all the policies for all cache sizes and write the report
+template<class KeyT, class Source>
+int runAll(Source &source, const std::string &trace_name,
+		const std::vector<size_t> &cache_sizes,
+		const std::vector<std::string> &policies, const backendOptions &options,
+		const std::string &label, const std::string &report_name) {
+	std::vector<backendResult> results;
+
+	for (size_t cache_size : cache_sizes) {
+		for (const std::string &policy : policies) {
+			backendResult result_;
+
+			run<KeyT>(policy, cache_size, source, options, result_);
+			results.push_back(result_);
+
+			const backendStats &stats_ = result_.stats;
+
+			std::cerr << std::setw(12) << policy << " c=" << cache_size
+					<< ": hit ratio " << std::setprecision(4)
+					<< (stats_.accesses ?
+							(double) stats_.hits * 100. / stats_.accesses : 0)
+					<< "%, " << stats_.nsPerAccess() << " ns/access, "
+					<< stats_.reads << " reads, " << stats_.writes
+					<< " writes in " << stats_.write_requests << " requests\n";
+		}
+	}
+
+	if (report_name.empty()) {
+		writeReport(std::cout, label, trace_name, options, results);
+	} else {
+		std::ofstream report(report_name);
+		writeReport(report, label, trace_name, options, results);
+	}
+
+	return 0;
+}
+
+template<class KeyT>
+int runTrace(const std::string &trace_name, std::vector<size_t> cache_sizes,
+		const std::vector<std::string> &policies, const backendOptions &options,
+		const std::string &label, const std::string &report_name) {
+	trace<KeyT> accesses;
+
+	if (!accesses.open(trace_name.c_str())) {
+		std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+		return -1;
+	}
+
+	if (cache_sizes.empty())
+		cache_sizes.push_back(accesses.cache_size);
+
+	traceSource<KeyT> source_(accesses);
+
+	return runAll<KeyT>(source_, trace_name, cache_sizes, policies, options,
+			label, report_name);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	const std::vector<std::string> all_policies = { "arc", "car",
+			"wtinylfu_arc", "lru", "lfu", "2q", "lirs" };
+
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0]
+				<< " <trace | gen:workload> [-c cache_size]... [-p policy]... [-w write_fraction] [-m back|through] [-r read_ns] [-W write_ns] [-b bytes_per_ns] [-h hit_ns] [-e elem_bytes] [-f flush_batch] [-n memory_size] [-s seed] [-l label] [-o report.json]\n";
+		return -1;
+	}
+
+	std::string trace_name = argv[1];
+	std::string label = "";
+	std::string report_name = "";
+	std::vector<size_t> cache_sizes;
+	std::vector<std::string> policies;
+	uint64_t seed = 1;
+
+	backendOptions options { backendModel(), WRITE_BACK, 0.2,
+			(int) default_memory_size };
+
+	for (int i = 2; i + 1 < argc; i += 2) {
+		const char *value_ = argv[i + 1];
+
+		if (!std::strcmp(argv[i], "-c"))
+			cache_sizes.push_back(std::stoul(value_));
+		else if (!std::strcmp(argv[i], "-p"))
+			policies.push_back(value_);
+		else if (!std::strcmp(argv[i], "-w"))
+			options.write_fraction = std::stod(value_);
+		else if (!std::strcmp(argv[i], "-m") && !std::strcmp(value_, "back"))
+			options.mode = WRITE_BACK;
+		else if (!std::strcmp(argv[i], "-m") && !std::strcmp(value_, "through"))
+			options.mode = WRITE_THROUGH;
+		else if (!std::strcmp(argv[i], "-r"))
+			options.model.read_latency_ns = std::stod(value_);
+		else if (!std::strcmp(argv[i], "-W"))
+			options.model.write_latency_ns = std::stod(value_);
+		else if (!std::strcmp(argv[i], "-b"))
+			options.model.bandwidth = std::stod(value_);
+		else if (!std::strcmp(argv[i], "-h"))
+			options.model.hit_ns = std::stod(value_);
+		else if (!std::strcmp(argv[i], "-e"))
+			options.model.elem_bytes = std::stoul(value_);
+		else if (!std::strcmp(argv[i], "-f"))
+			options.model.flush_batch = std::max(1ul, std::stoul(value_));
+		else if (!std::strcmp(argv[i], "-n"))
+			options.memory_size = std::stoi(value_);
+		else if (!std::strcmp(argv[i], "-s"))
+			seed = std::stoull(value_);
+		else if (!std::strcmp(argv[i], "-l"))
+			label = value_;
+		else if (!std::strcmp(argv[i], "-o"))
+			report_name = value_;
+		else {
+			std::cerr << "Error! Unknown option " << argv[i] << " " << value_
+					<< "\n";
+			return -1;
+		}
+	}
+
+	if (options.model.bandwidth <= 0) {
+		std::cerr << "Error! The bandwidth must be positive\n";
+		return -1;
+	}
+
+	if (policies.empty())
+		policies = all_policies;
+
+	for (const std::string &policy : policies) {
+		if (std::find(all_policies.begin(), all_policies.end(), policy)
+				== all_policies.end()) {
+			std::cerr << "Error! Unknown policy " << policy << "\n";
+			return -1;
+		}
+	}
+
+	if (trace_name.compare(0, 4, "gen:") == 0) {
+		std::vector<workloadPhase> phases;
+
+		if (!parseWorkload(trace_name.substr(4), phases))
+			return -1;
+
+		if (cache_sizes.empty()) {
+			std::cerr << "Error! The cache size of the workload is not given\n";
+			return -1;
+		}
+
+		workloadGenerator<long long> source_(phases, seed);
+
+		return runAll<long long>(source_, trace_name, cache_sizes, policies,
+				options, label, report_name);
+	}
+
+	if (traceKeyWidth(trace_name.c_str()) == 8)
+		return runTrace<long long>(trace_name, cache_sizes, policies, options,
+				label, report_name);
+
+	return runTrace<int>(trace_name, cache_sizes, policies, options, label,
+			report_name);
+}
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "arcTelemetry.h"
+#include "flatHashMap.h"
+#include "Memory.h"
+
+//! @brief Cost model of the backend, all times are in nanoseconds of the
+//! simulated clock (nothing sleeps)
+struct backendModel {
+	//! The cost of a cache hit
+	double hit_ns;
+	//! The fixed cost of one read and of one write request
+	double read_latency_ns;
+	double write_latency_ns;
+	//! Bytes per nanosecond (= GB/s)
+	double bandwidth;
+	//! The bytes moved per element
+	size_t elem_bytes;
+	//! Write-back: dirty elements are written by batches of this size,
+	//! a batch pays the write latency once
+	size_t flush_batch;
+
+	backendModel();
+};
+
+inline backendModel::backendModel() :
+		hit_ns(50), read_latency_ns(100000), write_latency_ns(100000), bandwidth(
+				1), elem_bytes(4096), flush_batch(32) {
+}
+
+//! @brief How the writes reach the backend
+enum writePolicy {
+	//! Every write goes to the backend at once
+	WRITE_THROUGH,
+	//! Writes only mark the cached element dirty, it is written when evicted
+	WRITE_BACK
+};
+
+//! @brief Operations of the backend and the simulated time spent
+struct backendStats {
+	size_t accesses;
+	size_t hits;
+	//! Elements read and written by the backend
+	size_t reads;
+	size_t writes;
+	//! Write requests (a batch of write-back is one request)
+	size_t write_requests;
+	double total_ns;
+
+	//! The effective access time
+	double nsPerAccess() const;
+};
+
+inline double backendStats::nsPerAccess() const {
+	return accesses ? total_ns / accesses : 0;
+}
+
+//! @brief Backing store simulator in front of Memory. The elements of the
+//! memory are found by their ids, the keys the memory doesn't have read as
+//! elements with 'id' and 'data' set to the key and only the written ones
+//! are kept, so the store serves workloads of any amount of keys. Every
+//! request is charged to the simulated clock by the model: the latency of
+//! the request plus the bytes over the bandwidth
+//! @param T - the type of elements with 'id' and 'data' (like cacheData)
+template<class T, class KeyT = int>
+class backingStore {
+	Memory<T> &memory;
+	backendModel model;
+
+	//! Position of every element of the memory by its id
+	flatHashMap<KeyT, size_t> index;
+	//! The written elements the memory doesn't have
+	flatHashMap<KeyT, T> extra;
+
+	//! Written elements waiting for the batch to fill up. Their values are
+	//! in the store already, only the cost of the batch is not charged yet
+	size_t pending;
+
+	backendStats stats;
+
+	//! The current element of the key
+	T element(const KeyT &key) const;
+	//! The place of the key's element, kept from now on
+	T& stored(const KeyT &key);
+public:
+	backingStore(Memory<T> &memory, const backendModel &model);
+
+	backingStore(const backingStore &rhs) = delete;
+	backingStore& operator=(const backingStore &rhs) = delete;
+
+	//! Read the element with one request
+	T read(const KeyT &key);
+	//! Write the element with one request
+	void write(const KeyT &key, const T &elem);
+	//! Queue the element for the batched write, the batch is written when full
+	void queueWrite(const KeyT &key, const T &elem);
+	//! Write the queued batch now
+	void flush();
+
+	//! Count the access of the cache in front of the store
+	void access(bool hit);
+
+	const backendModel& getModel() const;
+	const backendStats& getStats() const;
+};
+
+template<class T, class KeyT>
+inline backingStore<T, KeyT>::backingStore(Memory<T> &memory,
+		const backendModel &model) :
+		memory(memory), model(model), pending(0), stats { 0, 0, 0, 0, 0, 0 } {
+	index.reserve(memory.size);
+
+	for (int i = 0; i < memory.size; i++)
+		index.emplace(memory.data[i].id, i);
+}
+
+template<class T, class KeyT>
+inline T backingStore<T, KeyT>::element(const KeyT &key) const {
+	auto position_ = index.find(key);
+
+	if (position_ != index.end())
+		return memory.data[position_->second];
+
+	auto extra_ = extra.find(key);
+
+	if (extra_ != extra.end())
+		return extra_->second;
+
+	T elem_;
+	elem_.id = key;
+	elem_.data = key;
+
+	return elem_;
+}
+
+template<class T, class KeyT>
+inline T& backingStore<T, KeyT>::stored(const KeyT &key) {
+	auto position_ = index.find(key);
+
+	if (position_ != index.end())
+		return memory.data[position_->second];
+
+	return extra[key];
+}
+
+template<class T, class KeyT>
+inline T backingStore<T, KeyT>::read(const KeyT &key) {
+	stats.reads++;
+	stats.total_ns += model.read_latency_ns + model.elem_bytes / model.bandwidth;
+
+	return element(key);
+}
+
+template<class T, class KeyT>
+inline void backingStore<T, KeyT>::write(const KeyT &key, const T &elem) {
+	stats.writes++;
+	stats.write_requests++;
+	stats.total_ns += model.write_latency_ns + model.elem_bytes / model.bandwidth;
+
+	stored(key) = elem;
+}
+
+template<class T, class KeyT>
+inline void backingStore<T, KeyT>::queueWrite(const KeyT &key, const T &elem) {
+	stored(key) = elem;
+
+	if (++pending >= model.flush_batch)
+		flush();
+}
+
+template<class T, class KeyT>
+inline void backingStore<T, KeyT>::flush() {
+	if (pending == 0)
+		return;
+
+	// One request for the whole batch, the bytes are not batched
+	stats.writes += pending;
+	stats.write_requests++;
+	stats.total_ns += model.write_latency_ns
+			+ pending * model.elem_bytes / model.bandwidth;
+
+	pending = 0;
+}
+
+template<class T, class KeyT>
+inline void backingStore<T, KeyT>::access(bool hit) {
+	stats.accesses++;
+	stats.hits += hit;
+	stats.total_ns += model.hit_ns;
+}
+
+template<class T, class KeyT>
+inline const backendModel& backingStore<T, KeyT>::getModel() const {
+	return model;
+}
+
+template<class T, class KeyT>
+inline const backendStats& backingStore<T, KeyT>::getStats() const {
+	return stats;
+}
+
+//! @brief Read-through cache of any policy in front of backingStore. Misses are
+//! read from the store; writes allocate the element in the cache without
+//! reading it and either go to the store at once (write-through) or make the
+//! element dirty (write-back).
+//!
+//! A dirty element is written back when it leaves the cache: the frontend is
+//! the eviction listener of the cache and queues the evicted element for the
+//! batched write-back. Only the keys of the dirty elements are kept here (the
+//! values are in the cache), so they are never more than the cache keeps.
+//! A written element the cache doesn't keep at all is written through.
+//! 'finish' writes back the rest
+//! @param Cache - the policy with the common interface (see cachePolicy.h)
+//! and 'setEvictionListener'
+template<class Cache, class T, class KeyT = int>
+class storeFrontend {
+	Cache &cache;
+	backingStore<T, KeyT> &store;
+	writePolicy policy;
+
+	//! The keys of the dirty elements and the position of every key there
+	std::vector<KeyT> dirty_keys;
+	flatHashMap<KeyT, size_t> dirty;
+
+	//! The key being written and whether the cache didn't keep its element
+	const KeyT *writing;
+	bool write_dropped;
+
+	void markDirty(const KeyT &key);
+	//! @return true if the key was dirty
+	bool markClean(const KeyT &key);
+	//! Write back the element leaving the cache if it is dirty
+	void evicted(const KeyT &key, T &&elem);
+public:
+	storeFrontend(Cache &cache, backingStore<T, KeyT> &store,
+			writePolicy policy);
+
+	storeFrontend(const storeFrontend &rhs) = delete;
+	storeFrontend& operator=(const storeFrontend &rhs) = delete;
+
+	//! Read the element through the cache
+	//! @return true on a hit
+	bool read(const KeyT &key, T *elem = nullptr);
+	//! Write the element through the cache
+	//! @return true on a hit
+	bool write(const KeyT &key, const T &elem);
+	//! Write back all the dirty elements
+	void finish();
+
+	size_t dirtyCount() const;
+};
+
+template<class Cache, class T, class KeyT>
+inline storeFrontend<Cache, T, KeyT>::storeFrontend(Cache &cache,
+		backingStore<T, KeyT> &store, writePolicy policy) :
+		cache(cache), store(store), policy(policy), writing(nullptr), write_dropped(
+				false) {
+	cache.setEvictionListener(
+			[this](const KeyT &key, T &&elem, evictionReason) {
+				evicted(key, std::move(elem));
+			});
+}
+
+template<class Cache, class T, class KeyT>
+inline void storeFrontend<Cache, T, KeyT>::markDirty(const KeyT &key) {
+	if (dirty.emplace(key, dirty_keys.size()).second)
+		dirty_keys.push_back(key);
+}
+
+template<class Cache, class T, class KeyT>
+inline bool storeFrontend<Cache, T, KeyT>::markClean(const KeyT &key) {
+	auto dirty_ = dirty.find(key);
+
+	if (dirty_ == dirty.end())
+		return false;
+
+	// The last key takes the place of the removed one
+	size_t position_ = dirty_->second;
+
+	dirty_keys[position_] = dirty_keys.back();
+	dirty[dirty_keys[position_]] = position_;
+
+	dirty_keys.pop_back();
+	dirty.erase(key);
+
+	return true;
+}
+
+template<class Cache, class T, class KeyT>
+inline void storeFrontend<Cache, T, KeyT>::evicted(const KeyT &key,
+		T &&elem) {
+	if (writing != nullptr && key == *writing)
+		write_dropped = true;
+
+	if (markClean(key))
+		store.queueWrite(key, elem);
+}
+
+template<class Cache, class T, class KeyT>
+inline bool storeFrontend<Cache, T, KeyT>::read(const KeyT &key, T *elem) {
+	bool hit_ = true;
+
+	T &cached_ = cache.get_or_load(key, [&](const KeyT &key_) {
+		hit_ = false;
+
+		return store.read(key_);
+	});
+
+	store.access(hit_);
+
+	if (elem != nullptr)
+		*elem = cached_;
+
+	return hit_;
+}
+
+template<class Cache, class T, class KeyT>
+inline bool storeFrontend<Cache, T, KeyT>::write(const KeyT &key,
+		const T &elem) {
+	bool hit_ = true;
+
+	writing = &key;
+	write_dropped = false;
+
+	// The whole element is written, so a miss doesn't read it
+	T &cached_ = cache.get_or_load(key, [&](const KeyT&) {
+		hit_ = false;
+
+		return elem;
+	});
+
+	writing = nullptr;
+
+	cached_ = elem;
+	store.access(hit_);
+
+	// The cache that didn't keep the element (it has zero size or the element
+	// is too heavy) reported it as evicted, so it can't be written back later
+	if (policy == WRITE_THROUGH || write_dropped)
+		store.write(key, elem);
+	else
+		markDirty(key);
+
+	return hit_;
+}
+
+template<class Cache, class T, class KeyT>
+inline void storeFrontend<Cache, T, KeyT>::finish() {
+	// The dirty elements are resident, looking them up doesn't load anything
+	for (const KeyT &key : dirty_keys) {
+		T &cached_ = cache.get_or_load(key, [&](const KeyT &key_) {
+			return store.read(key_);
+		});
+
+		store.queueWrite(key, cached_);
+	}
+
+	dirty_keys.clear();
+	dirty.clear();
+	store.flush();
+}
+
+template<class Cache, class T, class KeyT>
+inline size_t storeFrontend<Cache, T, KeyT>::dirtyCount() const {
+	return dirty_keys.size();
+}
@@ -1,8 +1,12 @@
 #pragma once
 
-#include <list>
-#include <unordered_map>
+#include <cassert>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <vector>
 
+#include "flatHashMap.h"
 #include "Memory.h"
 
 template<class U, class KeyT = int>
@@ -21,24 +25,87 @@ inline beladyData<U, KeyT>::beladyData() :
 		data(0), id(0), next_usage(-1) {
 }
 
+//! @brief Belady's optimal cache: on a miss it evicts the element whose next
+//! usage is the farthest in the future. Next usages are precomputed in one
+//! reverse pass over the access order, and the cached elements are kept in an
+//! indexed max-heap by their next usage, so the victim is found in O(log c)
+//! @param T - the type of the currently caching data
 template<class T, class KeyT = int>
 class beladyCache {
-	std::list<T> data;
+	struct Slot {
+		KeyT key;
+		//! The position of the next access to the key (-1 if there is none)
+		long next_usage;
 
-	typedef typename std::list<T>::iterator ListIt;
-	std::unordered_map<KeyT, ListIt> hash_data;
+		std::optional<T> elem;
+	};
+
+	//! Cached elements, each one takes a fixed slot
+	std::vector<Slot> data;
+
+	//! Max-heap of slots by the next usage of their elements
+	std::vector<int> heap;
+	//! Position of each slot in the heap
+	std::vector<int> heap_pos;
+
+	flatHashMap<KeyT, int> hash_data;
 
 	int cache_size;
 	int mem_size;
 
+	//! The position in the access order for 'get_or_load' and 'insert'
 	int cur_elem;
 
+	//! The access order is either the memory of 'beladyData' elements
+	//! or the array of keys with the next usages kept inside the cache
 	Memory<beladyData<int, KeyT>> *access_order;
+	const KeyT *access_keys;
+	std::vector<int> next_usages;
+
+	//! Keeps the element when the cache has zero size
+	std::optional<T> uncached;
+
+	//! The priority of the slot in the heap ("never used" is the farthest)
+	long priority(int slot) const;
+	void swapHeap(int i, int j);
+	void siftUp(int i);
+	void siftDown(int i);
+
+	//! The slot of the cached key, -1 if it's not in the cache
+	int findSlot(const KeyT &key);
+	//! Update the next usage of the cached key
+	void touch(int slot, long next_usage);
+	//! Take a free slot or the slot of the victim for the missed key,
+	//! the caller puts the element into it
+	int admit(const KeyT &key, long next_usage);
+	//! Take the next access from the access order, it must be the given key
+	long nextAccess(const KeyT &key);
+
+	//! Predict the next usage of all accesses going from the end of the access
+	//! order and remembering the last seen position of each key
+	//! @param key_at - returns the key of the i-th access
+	//! @param set_next - sets the next usage of the i-th access
+	template<class KeyAt, class SetNext>
+	void predictUsages(KeyAt key_at, SetNext set_next);
 public:
 	beladyCache(int c_size, Memory<beladyData<int, KeyT>> *mem,
 			int access_times);
+	//! The access order is given by keys only (for example a mapped trace),
+	//! the keys are not copied and must live as long as the cache
+	beladyCache(int c_size, const KeyT *keys, int access_times);
 
+	//! Looks if the given element (taken from the access order) is in the cache
 	bool lookup(const T *elem);
+
+	//! @brief Replay the next access of the access order (it must be an access
+	//! to 'key'). On a miss the element is loaded with 'loader(key)' (called
+	//! exactly once) and moved into the cache
+	//! @return reference valid until the next access to the cache
+	template<class Loader>
+	T& get_or_load(const KeyT &key, Loader loader);
+	//! Move the element into the cache as the next access of the access order
+	T& insert(const KeyT &key, T &&elem);
+
 	void printList();
 	void printMem();
 };
@@ -46,86 +113,252 @@ public:
 template<class T, class KeyT>
 inline beladyCache<T, KeyT>::beladyCache(int c_size,
 		Memory<beladyData<int, KeyT>> *mem, int access_times) :
-		cache_size(c_size), cur_elem(0), mem_size(access_times), access_order(
-				mem) {
+		cache_size(c_size), mem_size(access_times), cur_elem(0), access_order(
+				mem), access_keys(nullptr) {
+	data.reserve(cache_size);
+	heap.reserve(cache_size);
+	heap_pos.reserve(cache_size);
+	hash_data.reserve(cache_size);
+
 	// Predict the next usage of all elements (-1 if wasn't used)
-	for (int i = 0; i < mem_size - 1; i++) {
-		auto elem_id = access_order->data[i].id;
-
-		for (int j = i + 1; j < mem_size; j++) {
-			// Found the element
-			if (elem_id == access_order->data[j].id) {
-				access_order->data[i].next_usage = j;
-				break;
-			}
+	predictUsages([&](int i) -> const KeyT& {
+		return access_order->data[i].id;
+	}, [&](int i, int next_usage) {
+		access_order->data[i].next_usage = next_usage;
+	});
+}
+
+template<class T, class KeyT>
+inline beladyCache<T, KeyT>::beladyCache(int c_size, const KeyT *keys,
+		int access_times) :
+		cache_size(c_size), mem_size(access_times), cur_elem(0), access_order(
+				nullptr), access_keys(keys), next_usages(access_times) {
+	assert(keys || access_times == 0);
+
+	data.reserve(cache_size);
+	heap.reserve(cache_size);
+	heap_pos.reserve(cache_size);
+	hash_data.reserve(cache_size);
+
+	predictUsages([&](int i) -> const KeyT& {
+		return access_keys[i];
+	}, [&](int i, int next_usage) {
+		next_usages[i] = next_usage;
+	});
+}
+
+template<class T, class KeyT>
+template<class KeyAt, class SetNext>
+inline void beladyCache<T, KeyT>::predictUsages(KeyAt key_at,
+		SetNext set_next) {
+	flatHashMap<KeyT, int> last_usage;
+
+	for (int i = mem_size - 1; i >= 0; i--) {
+		const KeyT &elem_id = key_at(i);
+		auto found = last_usage.find(elem_id);
+
+		if (found != last_usage.end()) {
+			set_next(i, found->second);
+			found->second = i;
+		} else {
+			set_next(i, -1);
+			last_usage.emplace(elem_id, i);
 		}
 	}
 }
 
 template<class T, class KeyT>
-inline bool beladyCache<T, KeyT>::lookup(const T *elem) {
-	assert(elem);
+inline long beladyCache<T, KeyT>::priority(int slot) const {
+	if (data[slot].next_usage == -1)
+		return std::numeric_limits<long>::max();
+
+	return data[slot].next_usage;
+}
 
-	auto hit = hash_data.find(elem->id);
+template<class T, class KeyT>
+inline void beladyCache<T, KeyT>::swapHeap(int i, int j) {
+	std::swap(heap[i], heap[j]);
 
-	if (hit == hash_data.end()) {
-		// Element is not in the cache
+	heap_pos[heap[i]] = i;
+	heap_pos[heap[j]] = j;
+}
 
-		if (data.size() < cache_size) {
-			data.push_front(*elem);
-			hash_data[elem->id] = data.begin();
+template<class T, class KeyT>
+inline void beladyCache<T, KeyT>::siftUp(int i) {
+	while (i > 0) {
+		int parent_ = (i - 1) / 2;
 
-			return false;
-		}
+		if (priority(heap[parent_]) >= priority(heap[i]))
+			break;
 
-		int father_usage = -1;
-		ListIt father_it = data.end();
-
-		for (auto i = data.begin(); i != data.end(); i = std::next(i)) {
-			if (i->next_usage == -1) {
-				// Never gonna
-				father_usage = 0;
-				father_it = i;
-				break;
-			}
-
-			if (i->next_usage > father_usage) {
-				father_usage = i->next_usage;
-				father_it = i;
-			}
-		}
+		swapHeap(i, parent_);
+		i = parent_;
+	}
+}
+
+template<class T, class KeyT>
+inline void beladyCache<T, KeyT>::siftDown(int i) {
+	int size_ = heap.size();
 
-		// std::cout << "Father - " << father_usage << "\n";
+	while (true) {
+		int largest_ = i;
+		int left_ = 2 * i + 1;
+		int right_ = 2 * i + 2;
 
-		if (father_usage == -1) {
-			// None of the elements will be used
-			father_it = data.begin();
-		}
+		if (left_ < size_ && priority(heap[left_]) > priority(heap[largest_]))
+			largest_ = left_;
+		if (right_ < size_ && priority(heap[right_]) > priority(heap[largest_]))
+			largest_ = right_;
+
+		if (largest_ == i)
+			break;
+
+		swapHeap(i, largest_);
+		i = largest_;
+	}
+}
+
+template<class T, class KeyT>
+inline int beladyCache<T, KeyT>::findSlot(const KeyT &key) {
+	auto hit = hash_data.find(key);
+
+	if (hit == hash_data.end())
+		return -1;
+
+	return hit->second;
+}
+
+template<class T, class KeyT>
+inline void beladyCache<T, KeyT>::touch(int slot, long next_usage) {
+	data[slot].next_usage = next_usage;
+
+	// The next usage only moves forward
+	siftUp(heap_pos[slot]);
+}
+
+template<class T, class KeyT>
+inline int beladyCache<T, KeyT>::admit(const KeyT &key, long next_usage) {
+	if ((int) data.size() < cache_size) {
+		int slot_ = data.size();
+
+		data.push_back(Slot { key, next_usage, std::nullopt });
+		heap.push_back(slot_);
+		heap_pos.push_back(slot_);
+		hash_data[key] = slot_;
 
-		// Insert the element
-		ListIt new_it = data.insert(father_it, *elem);
-		hash_data[elem->id] = new_it;
+		siftUp(slot_);
 
-		// Delete the previous element from the cache
-		hash_data.erase(father_it->id);
-		data.erase(father_it);
+		return slot_;
+	}
+
+	// The element that won't be used for the longest time
+	int father_slot = heap[0];
+
+	hash_data.erase(data[father_slot].key);
+
+	data[father_slot].key = key;
+	data[father_slot].next_usage = next_usage;
+	data[father_slot].elem.reset();
+	hash_data[key] = father_slot;
+
+	siftDown(0);
+
+	return father_slot;
+}
+
+template<class T, class KeyT>
+inline long beladyCache<T, KeyT>::nextAccess(const KeyT &key) {
+	if (cur_elem >= mem_size
+			|| !((access_order ?
+					access_order->data[cur_elem].id : access_keys[cur_elem])
+					== key)) {
+		std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+		std::cerr << "The access doesn't follow the access order!\n";
+
+		exit(-1);
+	}
+
+	if (access_order)
+		return access_order->data[cur_elem++].next_usage;
 
+	return next_usages[cur_elem++];
+}
+
+template<class T, class KeyT>
+inline bool beladyCache<T, KeyT>::lookup(const T *elem) {
+	assert(elem);
+
+	if (cache_size <= 0)
 		return false;
-	} else {
-		// It is in the cache
-		int next_ = hit->second->next_usage;
 
-		hit->second->next_usage = access_order->data[next_].next_usage;
+	int slot_ = findSlot(elem->id);
 
+	if (slot_ != -1) {
+		touch(slot_, elem->next_usage);
 		return true;
 	}
+
+	slot_ = admit(elem->id, elem->next_usage);
+	data[slot_].elem.emplace(*elem);
+
+	return false;
+}
+
+template<class T, class KeyT>
+template<class Loader>
+inline T& beladyCache<T, KeyT>::get_or_load(const KeyT &key, Loader loader) {
+	long next_usage_ = nextAccess(key);
+
+	if (cache_size <= 0) {
+		uncached.emplace(loader(key));
+		return *uncached;
+	}
+
+	int slot_ = findSlot(key);
+
+	if (slot_ != -1) {
+		touch(slot_, next_usage_);
+		return *data[slot_].elem;
+	}
+
+	// Load before touching the cache, so a throwing loader changes nothing
+	T elem_ = loader(key);
+
+	slot_ = admit(key, next_usage_);
+	data[slot_].elem.emplace(std::move(elem_));
+
+	return *data[slot_].elem;
+}
+
+template<class T, class KeyT>
+inline T& beladyCache<T, KeyT>::insert(const KeyT &key, T &&elem) {
+	long next_usage_ = nextAccess(key);
+
+	if (cache_size <= 0) {
+		uncached.emplace(std::move(elem));
+		return *uncached;
+	}
+
+	int slot_ = findSlot(key);
+
+	if (slot_ != -1) {
+		touch(slot_, next_usage_);
+		*data[slot_].elem = std::move(elem);
+
+		return *data[slot_].elem;
+	}
+
+	slot_ = admit(key, next_usage_);
+	data[slot_].elem.emplace(std::move(elem));
+
+	return *data[slot_].elem;
 }
 
 template<class T, class KeyT>
 inline void beladyCache<T, KeyT>::printList() {
 	std::cout << "Belady cache:\n";
-	for (auto elem : data) {
-		std::cout << elem.data << "\n";
+	for (int slot : heap) {
+		std::cout << data[slot].key << "\n";
 	}
 	std::cout << "\n";
 	std::cout << "===============\n";
@@ -136,8 +369,14 @@ inline void beladyCache<T, KeyT>::printMem() {
 	std::cout << "Belady cache:\n";
 
 	for (int i = 0; i < mem_size; i++) {
-		std::cout << "Elem: " << access_order->data[i].data << "\n";
-		std::cout << "Next usage: " << access_order->data[i].next_usage << "\n";
+		if (access_order) {
+			std::cout << "Elem: " << access_order->data[i].data << "\n";
+			std::cout << "Next usage: " << access_order->data[i].next_usage
+					<< "\n";
+		} else {
+			std::cout << "Key: " << access_keys[i] << "\n";
+			std::cout << "Next usage: " << next_usages[i] << "\n";
+		}
 	}
 	std::cout << "\n";
 	std::cout << "===============\n";
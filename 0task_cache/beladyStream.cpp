@@ -0,0 +1,426 @@
+// Computes the optimal (Belady) hit ratio of traces bigger than the memory.
+// The trace is read by chunks and never kept whole:
+//  - with the unbounded lookahead the next usage of every access is found in
+//    a backward pass over the binary trace and spilled into a temporary file,
+//    then the trace and the next usages are replayed forward together (a text
+//    trace is converted into a temporary binary one first);
+//  - with the lookahead of 'window' accesses the next usages are found in a
+//    sliding window while the trace is replayed, so the policy sees only the
+//    next 'window' accesses like a real prefetcher would.
+// All cache sizes are replayed in the same pass. The memory is O(window + the
+// sum of cache sizes + max_keys): the backward pass keeps the last usage of
+// at most 'max_keys' distinct keys, the keys of a bigger trace are split by
+// their hash into several backward passes (each reads the whole trace again).
+//
+// Usage: beladyStream <trace> [-c cache_size]... [-w window]... [-k max_keys]
+//                     [-o report.json]
+// Without '-c' the cache size written in the trace is used, 'max_keys' is
+// 2^22 by default.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "flatHashMap.h"
+#include "hashMix.h"
+#include "jsonString.h"
+#include "streamingBelady.h"
+#include "trace.h"
+
+namespace {
+
+//! Accesses read from the trace at once
+const size_t chunk_size = 1 << 16;
+//! Distinct keys the backward pass keeps by default
+const size_t default_max_keys = 1 << 22;
+//! The most backward passes the keys are split into
+const uint64_t max_parts = 1 << 20;
+
+struct streamResult {
+	std::string policy;
+	size_t cache_size;
+	//! 0 - unbounded
+	size_t window;
+	size_t hits;
+};
+
+long peakRSS() {
+	struct rusage usage_;
+	getrusage(RUSAGE_SELF, &usage_);
+
+	return usage_.ru_maxrss;
+}
+
+template<class KeyT>
+std::vector<beladySimulator<KeyT>> makeSimulators(
+		const std::vector<size_t> &cache_sizes) {
+	std::vector<beladySimulator<KeyT>> simulators_;
+
+	for (size_t cache_size : cache_sizes)
+		simulators_.emplace_back(cache_size);
+
+	return simulators_;
+}
+
+//! The backward pass of the key when the keys are split into 'parts' (a power
+//! of 2), the high bits of the hash are used: the map of the pass indexes
+//! its keys by the low ones
+template<class KeyT>
+uint64_t partOf(const KeyT &key, uint64_t parts) {
+	return (hashKey(key) >> 40) & (parts - 1);
+}
+
+//! Write the next usage of every access of the keys of 'part' into 'spill'
+//! (unknown_usage for the last access of a key), reading the trace backward
+//! by chunks. The first part writes all accesses, the others update theirs
+//! @param fits - false is written if the part has more than 'max_keys' keys
+//! @return false on an error of reading or writing
+template<class KeyT>
+bool spillPart(traceReader<KeyT> &reader, FILE *spill, uint64_t part,
+		uint64_t parts, size_t max_keys, bool &fits) {
+	flatHashMap<KeyT, uint64_t> last_usage;
+	std::vector<KeyT> keys_(chunk_size);
+	std::vector<uint64_t> next_usages_(chunk_size);
+
+	fits = true;
+
+	for (size_t end_ = reader.size; end_ > 0;) {
+		size_t begin_ = (end_ > chunk_size) ? end_ - chunk_size : 0;
+		size_t count_ = end_ - begin_;
+
+		if (!reader.seek(begin_) || reader.read(keys_.data(), count_) != count_
+				|| fseeko(spill, begin_ * sizeof(uint64_t), SEEK_SET) != 0)
+			return false;
+
+		if (part != 0
+				&& (fread(next_usages_.data(), sizeof(uint64_t), count_, spill)
+						!= count_
+						|| fseeko(spill, begin_ * sizeof(uint64_t), SEEK_SET)
+								!= 0))
+			return false;
+
+		for (size_t i = count_; i-- > 0;) {
+			if (parts > 1 && partOf(keys_[i], parts) != part) {
+				if (part == 0)
+					next_usages_[i] = unknown_usage;
+
+				continue;
+			}
+
+			auto last_ = last_usage.emplace(keys_[i], begin_ + i);
+
+			next_usages_[i] = last_.second ? unknown_usage : last_.first->second;
+			last_.first->second = begin_ + i;
+		}
+
+		if (last_usage.size() > max_keys) {
+			fits = false;
+			return true;
+		}
+
+		if (fwrite(next_usages_.data(), sizeof(uint64_t), count_, spill)
+				!= count_)
+			return false;
+
+		end_ = begin_;
+	}
+
+	return true;
+}
+
+//! Write the next usage of every access into 'spill', the keys are split into
+//! as few backward passes as keep at most 'max_keys' keys each
+template<class KeyT>
+bool spillNextUsages(traceReader<KeyT> &reader, FILE *spill,
+		size_t max_keys) {
+	for (uint64_t parts_ = 1; parts_ <= max_parts; parts_ *= 2) {
+		bool fits_ = true;
+
+		for (uint64_t part_ = 0; fits_ && part_ < parts_; part_++) {
+			if (!spillPart(reader, spill, part_, parts_, max_keys, fits_))
+				return false;
+		}
+
+		if (fits_)
+			return true;
+	}
+
+	std::cerr << "Error! The keys don't fit " << max_keys
+			<< " in a backward pass\n";
+
+	return false;
+}
+
+//! Convert the text trace into the temporary binary one and open 'reader' on
+//! it, the file is removed at once (the opened one stays readable)
+template<class KeyT>
+bool openAsBinary(const std::string &trace_name, traceReader<KeyT> &reader) {
+	const char *dir_ = std::getenv("TMPDIR");
+	std::string path_ = std::string(dir_ ? dir_ : "/tmp")
+			+ "/beladyStreamXXXXXX";
+	int fd_ = mkstemp(&path_[0]);
+
+	if (fd_ < 0)
+		return false;
+
+	close(fd_);
+
+	traceReader<KeyT> text_;
+	traceWriter<KeyT> writer_;
+	std::vector<KeyT> keys_(chunk_size);
+	bool converted_ = text_.open(trace_name.c_str())
+			&& writer_.open(path_.c_str(), sizeof(KeyT), text_.cache_size);
+
+	while (converted_) {
+		size_t count_ = text_.read(keys_.data(), chunk_size);
+
+		if (count_ == 0)
+			break;
+
+		converted_ = writer_.write(keys_.data(), count_);
+	}
+
+	converted_ = writer_.close() && converted_ && reader.open(path_.c_str());
+	unlink(path_.c_str());
+
+	return converted_;
+}
+
+//! Replay the trace with the unbounded lookahead
+template<class KeyT>
+bool runUnbounded(const std::string &trace_name,
+		const std::vector<size_t> &cache_sizes, size_t max_keys,
+		std::vector<streamResult> &results) {
+	traceReader<KeyT> reader_;
+	bool opened_ =
+			traceKeyWidth(trace_name.c_str()) != 0 ?
+					reader_.open(trace_name.c_str()) :
+					openAsBinary(trace_name, reader_);
+
+	if (!opened_) {
+		std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+		return false;
+	}
+
+	// The file is removed when it's closed
+	std::unique_ptr<FILE, int (*)(FILE*)> spill_(std::tmpfile(), &std::fclose);
+
+	if (!spill_ || !spillNextUsages(reader_, spill_.get(), max_keys)) {
+		std::cerr << "Error! Can't spill the next usages of " << trace_name
+				<< "\n";
+		return false;
+	}
+
+	std::vector<beladySimulator<KeyT>> simulators_ = makeSimulators<KeyT>(
+			cache_sizes);
+	std::vector<KeyT> keys_(chunk_size);
+	std::vector<uint64_t> next_usages_(chunk_size);
+
+	reader_.seek(0);
+	std::rewind(spill_.get());
+
+	for (uint64_t position_ = 0; position_ < reader_.size;) {
+		size_t count_ = reader_.read(keys_.data(), chunk_size);
+
+		if (count_ == 0
+				|| fread(next_usages_.data(), sizeof(uint64_t), count_,
+						spill_.get()) != count_) {
+			std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+			return false;
+		}
+
+		for (auto &simulator : simulators_) {
+			for (size_t i = 0; i < count_; i++)
+				simulator.access(keys_[i], position_ + i, next_usages_[i]);
+		}
+
+		position_ += count_;
+	}
+
+	for (size_t i = 0; i < cache_sizes.size(); i++) {
+		results.push_back(streamResult { "belady", cache_sizes[i], 0,
+				simulators_[i].hitsCount() });
+	}
+
+	return true;
+}
+
+//! Replay the trace with the lookahead of 'window' accesses
+template<class KeyT>
+bool runWindow(const std::string &trace_name,
+		const std::vector<size_t> &cache_sizes, size_t window,
+		std::vector<streamResult> &results) {
+	traceReader<KeyT> reader_;
+
+	if (!reader_.open(trace_name.c_str())) {
+		std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+		return false;
+	}
+
+	std::vector<beladySimulator<KeyT>> simulators_ = makeSimulators<KeyT>(
+			cache_sizes);
+	// A window longer than the trace is the unbounded lookahead
+	lookaheadWindow<KeyT> lookahead_(std::min(window, reader_.size));
+	std::vector<KeyT> keys_(chunk_size);
+
+	auto replayOldest = [&]() {
+		KeyT key_;
+		uint64_t next_usage_;
+		uint64_t position_ = lookahead_.take(key_, next_usage_);
+
+		for (auto &simulator : simulators_)
+			simulator.access(key_, position_, next_usage_);
+	};
+
+	for (uint64_t position_ = 0; position_ < reader_.size;) {
+		size_t count_ = reader_.read(keys_.data(), chunk_size);
+
+		if (count_ == 0) {
+			std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+			return false;
+		}
+
+		for (size_t i = 0; i < count_; i++) {
+			if (lookahead_.full())
+				replayOldest();
+
+			// Cached keys may learn their next usage only now
+			if (lookahead_.push(keys_[i])) {
+				for (auto &simulator : simulators_)
+					simulator.reschedule(keys_[i], position_ + i);
+			}
+		}
+
+		position_ += count_;
+	}
+
+	while (lookahead_.size() > 0)
+		replayOldest();
+
+	for (size_t i = 0; i < cache_sizes.size(); i++) {
+		results.push_back(streamResult { "belady_w" + std::to_string(window),
+				cache_sizes[i], window, simulators_[i].hitsCount() });
+	}
+
+	return true;
+}
+
+void writeReport(std::ostream &out, const std::string &trace_name,
+		size_t accesses, const std::vector<streamResult> &results) {
+	out << "{\n";
+	out << "  \"trace\": " << jsonString(trace_name) << ",\n";
+	out << "  \"accesses\": " << accesses << ",\n";
+	out << "  \"peak_rss_kb\": " << peakRSS() << ",\n";
+	out << "  \"results\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const streamResult &result_ = results[i];
+		double hit_ratio_ = accesses ? (double) result_.hits / accesses : 0;
+
+		out << "    {\"policy\": " << jsonString(result_.policy)
+				<< ", \"cache_size\": " << result_.cache_size << ", \"window\": "
+				<< result_.window
+				<< ", \"hits\": " << result_.hits << ", \"hit_ratio\": "
+				<< std::setprecision(6) << hit_ratio_ << "}"
+				<< (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n";
+	out << "}\n";
+}
+
+template<class KeyT>
+int runStream(const std::string &trace_name, std::vector<size_t> cache_sizes,
+		const std::vector<size_t> &windows, size_t max_keys,
+		const std::string &report_name) {
+	traceReader<KeyT> reader_;
+
+	if (!reader_.open(trace_name.c_str())) {
+		std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+		return -1;
+	}
+
+	if (cache_sizes.empty())
+		cache_sizes.push_back(reader_.cache_size);
+
+	std::vector<streamResult> results;
+
+	if (!runUnbounded<KeyT>(trace_name, cache_sizes, max_keys, results))
+		return -1;
+
+	for (size_t window : windows) {
+		if (!runWindow<KeyT>(trace_name, cache_sizes, window, results))
+			return -1;
+	}
+
+	for (const streamResult &result_ : results) {
+		std::cerr << std::setw(16) << result_.policy << " c="
+				<< result_.cache_size << ": hit ratio " << std::setprecision(4)
+				<< (reader_.size ?
+						(double) result_.hits * 100. / reader_.size : 0)
+				<< "%\n";
+	}
+
+	if (report_name.empty()) {
+		writeReport(std::cout, trace_name, reader_.size, results);
+	} else {
+		std::ofstream report(report_name);
+		writeReport(report, trace_name, reader_.size, results);
+	}
+
+	return 0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0]
+				<< " <trace> [-c cache_size]... [-w window]... [-k max_keys]"
+				<< " [-o report.json]\n";
+		return -1;
+	}
+
+	std::string trace_name = argv[1];
+	std::string report_name = "";
+	std::vector<size_t> cache_sizes;
+	std::vector<size_t> windows;
+	size_t max_keys = default_max_keys;
+
+	for (int i = 2; i + 1 < argc; i += 2) {
+		if (!std::strcmp(argv[i], "-c"))
+			cache_sizes.push_back(std::stoul(argv[i + 1]));
+		else if (!std::strcmp(argv[i], "-w"))
+			windows.push_back(std::stoul(argv[i + 1]));
+		else if (!std::strcmp(argv[i], "-k"))
+			max_keys = std::stoul(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "-o"))
+			report_name = argv[i + 1];
+		else {
+			std::cerr << "Error! Unknown option " << argv[i] << "\n";
+			return -1;
+		}
+	}
+
+	if (max_keys == 0) {
+		std::cerr << "Error! The backward pass needs room for a key\n";
+		return -1;
+	}
+
+	if (traceKeyWidth(trace_name.c_str()) == 8)
+		return runStream<long long>(trace_name, cache_sizes, windows, max_keys,
+				report_name);
+
+	return runStream<int>(trace_name, cache_sizes, windows, max_keys,
+			report_name);
+}
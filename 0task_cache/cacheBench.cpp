@@ -0,0 +1,612 @@
+// Replays an access trace through every cache policy and writes a report with
+// hit ratio, time per lookup, allocations per lookup and peak RSS of the process
+//
+// The trace is either the text one or the binary one (see traceConvert)
+//
+// Usage: cacheBench <trace> [-c cache_size]... [-p policy]... [-j threads] [-l label] [-o report.json]
+// Without '-c' the cache size written in the trace is used, without '-p'
+// all policies are run. Peak RSS is the high-water mark of the whole process,
+// run one policy per process to measure it separately.
+//
+// With '-j' the (policy x cache size) runs are spread over a pool of threads.
+// The trace is loaded once and shared read-only, every run keeps its own cache,
+// so the sweep takes about as long as its slowest run. Allocations are counted
+// per thread, so they stay exact; time per lookup may grow when the runs
+// compete for the memory bandwidth.
+//
+// Instead of the trace a synthetic workload may be given as 'gen:<phases>'
+// (see parseWorkload in workloadGen.h), '-s' sets its seed. Every run generates
+// the keys by chunks itself, so workloads of billions of accesses take no
+// memory; only the generation is not timed. Belady needs the whole future and
+// is not run on workloads (see beladyStream), '-c' is required.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "ARCache.h"
+#include "beladyCache.h"
+#include "CARCache.h"
+#include "ShardedARCache.h"
+#include "LFUCache.h"
+#include "LIRSCache.h"
+#include "LRUCache.h"
+#include "TwoQCache.h"
+#include "WTinyLFUCache.h"
+#include "cachePolicy.h"
+#include "jsonString.h"
+#include "Memory.h"
+#include "trace.h"
+#include "workloadGen.h"
+
+namespace {
+
+//! Every run is done by one thread, so its allocations are counted apart
+thread_local size_t alloc_count = 0;
+
+}
+
+// Count all allocations of the program
+void* operator new(size_t size) {
+	alloc_count++;
+
+	void *ptr = std::malloc(size ? size : 1);
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+// GCC doesn't know the replaced operator new uses malloc
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+namespace {
+
+struct benchResult {
+	std::string policy;
+	size_t cache_size;
+	size_t hits;
+	double ns_per_lookup;
+	double allocs_per_lookup;
+	long peak_rss_kb;
+};
+
+long peakRSS() {
+	struct rusage usage_;
+	getrusage(RUSAGE_SELF, &usage_);
+
+	return usage_.ru_maxrss;
+}
+
+//! Run all accesses through the cache. Only lookups are timed, allocations
+//! include the construction of the cache
+//! @param make - creates the cache
+//! @param access - does the i-th access, returns true on a hit
+template<class Make, class Access>
+benchResult replay(const std::string &policy, size_t cache_size,
+		size_t accesses, Make make, Access access) {
+	size_t allocs_before_ = alloc_count;
+	auto cache_ = make();
+
+	size_t hits_ = 0;
+	auto start_ = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < accesses; i++) {
+		if (access(*cache_, i))
+			hits_++;
+	}
+
+	std::chrono::duration<double, std::nano> time_ =
+			std::chrono::steady_clock::now() - start_;
+	size_t allocs_ = alloc_count - allocs_before_;
+
+	double lookups_ = accesses ? accesses : 1;
+
+	return benchResult { policy, cache_size, hits_, time_.count() / lookups_,
+			allocs_ / lookups_, peakRSS() };
+}
+
+//! Replays the trace through the policies. Caches that keep the key as their
+//! element are fed with keys of the trace directly, the others need a copy
+//! of the trace as 'beladyData' elements
+template<class KeyT>
+class benchRunner {
+	using benchData = beladyData<KeyT, KeyT>;
+
+	const trace<KeyT> &accesses;
+	std::unique_ptr<Memory<benchData>> memory;
+	//! The memory is made by the first run that needs it, the others wait
+	std::once_flag memory_once;
+
+	Memory<benchData>& getMemory();
+
+	//! Replay the trace through the policy that keeps keys as its elements
+	template<class Cache>
+	benchResult runPolicy(const std::string &policy, size_t cache_size);
+public:
+	benchRunner(const trace<KeyT> &trace_);
+
+	//! Run one policy by its name, false if there is no such policy.
+	//! Runs may go in parallel threads
+	bool run(const std::string &policy, size_t cache_size,
+			benchResult &result);
+};
+
+template<class KeyT>
+benchRunner<KeyT>::benchRunner(const trace<KeyT> &trace_) :
+		accesses(trace_) {
+}
+
+template<class KeyT>
+Memory<beladyData<KeyT, KeyT>>& benchRunner<KeyT>::getMemory() {
+	std::call_once(memory_once, [&]() {
+		memory.reset(new Memory<benchData>(accesses.size));
+
+		for (size_t i = 0; i < accesses.size; i++) {
+			memory->data[i].id = accesses.keys[i];
+			memory->data[i].data = accesses.keys[i];
+		}
+	});
+
+	return *memory;
+}
+
+template<class KeyT>
+template<class Cache>
+benchResult benchRunner<KeyT>::runPolicy(const std::string &policy,
+		size_t cache_size) {
+	static_assert(isCachePolicy<Cache, KeyT, KeyT>::value,
+			"The cache must have the common interface of policies");
+
+	const KeyT *keys_ = accesses.keys;
+
+	return replay(policy, cache_size, accesses.size, [&]() {
+		return std::make_unique<Cache>(cache_size);
+	}, [&](Cache &cache, size_t i) {
+		return accessKey(cache, keys_[i]);
+	});
+}
+
+template<class KeyT>
+bool benchRunner<KeyT>::run(const std::string &policy, size_t cache_size,
+		benchResult &result) {
+	const KeyT *keys_ = accesses.keys;
+
+	if (policy == "arc") {
+		result = runPolicy<ARCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "arc_batch") {
+		// The trace is looked up in batches, the i-th access takes its result
+		const size_t batch_ = 64;
+		std::unique_ptr<bool[]> hits_(new bool[batch_]);
+
+		result = replay(policy, cache_size, accesses.size, [&]() {
+			return std::make_unique<ARCache<KeyT, KeyT>>(cache_size);
+		}, [&](ARCache<KeyT, KeyT> &cache, size_t i) {
+			if (i % batch_ == 0) {
+				cache.lookup_batch(keys_ + i, std::min(batch_, accesses.size - i),
+						hits_.get(), [](const KeyT &key) {
+							return key;
+						});
+			}
+
+			return hits_[i % batch_];
+		});
+	} else if (policy == "wtinylfu_arc") {
+		result = runPolicy<WTinyLFUCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "lru") {
+		result = runPolicy<LRUCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "lfu") {
+		result = runPolicy<LFUCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "2q") {
+		result = runPolicy<TwoQCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "lirs") {
+		result = runPolicy<LIRSCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "belady") {
+		result = replay(policy, cache_size, accesses.size, [&]() {
+			return std::make_unique<beladyCache<KeyT, KeyT>>(cache_size, keys_,
+					accesses.size);
+		}, [&](beladyCache<KeyT, KeyT> &cache, size_t i) {
+			static_assert(isCachePolicy<beladyCache<KeyT, KeyT>, KeyT, KeyT>::value,
+					"Belady must have the common interface of policies");
+
+			return accessKey(cache, keys_[i]);
+		});
+	} else if (policy == "car") {
+		Memory<benchData> &memory_ = getMemory();
+
+		result = replay(policy, cache_size, accesses.size, [&]() {
+			return std::make_unique<CARCache<benchData, KeyT>>(cache_size);
+		}, [&](CARCache<benchData, KeyT> &cache, size_t i) {
+			return cache.lookup(&memory_.data[i]);
+		});
+	} else if (policy == "sharded_arc") {
+		Memory<benchData> &memory_ = getMemory();
+
+		result = replay(policy, cache_size, accesses.size, [&]() {
+			return std::make_unique<ShardedARCache<benchData, KeyT>>(cache_size);
+		}, [&](ShardedARCache<benchData, KeyT> &cache, size_t i) {
+			return cache.lookup(&memory_.data[i]);
+		});
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+//! Accesses of the workload generated at once
+const size_t workload_chunk = 1 << 16;
+
+//! Replays the synthetic workload through the policies, every run generates
+//! the same stream of keys by chunks (only the lookups are timed)
+template<class KeyT>
+class streamRunner {
+	using benchData = beladyData<KeyT, KeyT>;
+
+	const std::vector<workloadPhase> &phases;
+	uint64_t seed;
+
+	//! Run the workload through the cache
+	//! @param make - creates the cache
+	//! @param access - does the accesses of the chunk, returns the amount of hits
+	template<class Make, class Access>
+	benchResult replayStream(const std::string &policy, size_t cache_size,
+			Make make, Access access);
+	//! Replay the workload through the policy that keeps keys as its elements
+	template<class Cache>
+	benchResult runPolicy(const std::string &policy, size_t cache_size);
+public:
+	streamRunner(const std::vector<workloadPhase> &phases_, uint64_t seed_);
+
+	//! Run one policy by its name, false if there is no such policy
+	//! or it can't replay a stream. Runs may go in parallel threads
+	bool run(const std::string &policy, size_t cache_size,
+			benchResult &result);
+};
+
+template<class KeyT>
+streamRunner<KeyT>::streamRunner(const std::vector<workloadPhase> &phases_,
+		uint64_t seed_) :
+		phases(phases_), seed(seed_) {
+}
+
+template<class KeyT>
+template<class Make, class Access>
+benchResult streamRunner<KeyT>::replayStream(const std::string &policy,
+		size_t cache_size, Make make, Access access) {
+	size_t allocs_before_ = alloc_count;
+	workloadGenerator<KeyT> workload_(phases, seed);
+	std::vector<KeyT> keys_(workload_chunk);
+	auto cache_ = make();
+
+	size_t hits_ = 0;
+	std::chrono::duration<double, std::nano> time_(0);
+
+	for (size_t count_; (count_ = workload_.read(keys_.data(), keys_.size()))
+			!= 0;) {
+		auto start_ = std::chrono::steady_clock::now();
+
+		hits_ += access(*cache_, keys_.data(), count_);
+		time_ += std::chrono::steady_clock::now() - start_;
+	}
+
+	size_t allocs_ = alloc_count - allocs_before_;
+
+	double lookups_ = workload_.size ? workload_.size : 1;
+
+	return benchResult { policy, cache_size, hits_, time_.count() / lookups_,
+			allocs_ / lookups_, peakRSS() };
+}
+
+template<class KeyT>
+template<class Cache>
+benchResult streamRunner<KeyT>::runPolicy(const std::string &policy,
+		size_t cache_size) {
+	static_assert(isCachePolicy<Cache, KeyT, KeyT>::value,
+			"The cache must have the common interface of policies");
+
+	return replayStream(policy, cache_size, [&]() {
+		return std::make_unique<Cache>(cache_size);
+	}, [&](Cache &cache, const KeyT *keys, size_t count) {
+		size_t hits_ = 0;
+
+		for (size_t i = 0; i < count; i++)
+			hits_ += accessKey(cache, keys[i]);
+
+		return hits_;
+	});
+}
+
+template<class KeyT>
+bool streamRunner<KeyT>::run(const std::string &policy, size_t cache_size,
+		benchResult &result) {
+	// Elements of the policies that look up elements are made on the fly
+	auto lookupElements_ = [](auto &cache, const KeyT *keys, size_t count) {
+		size_t hits_ = 0;
+		benchData elem_;
+
+		for (size_t i = 0; i < count; i++) {
+			elem_.id = keys[i];
+			elem_.data = keys[i];
+
+			hits_ += cache.lookup(&elem_);
+		}
+
+		return hits_;
+	};
+
+	if (policy == "arc") {
+		result = runPolicy<ARCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "arc_batch") {
+		std::unique_ptr<bool[]> hits_(new bool[workload_chunk]);
+
+		result = replayStream(policy, cache_size, [&]() {
+			return std::make_unique<ARCache<KeyT, KeyT>>(cache_size);
+		}, [&](ARCache<KeyT, KeyT> &cache, const KeyT *keys, size_t count) {
+			const size_t batch_ = 64;
+			size_t chunk_hits_ = 0;
+
+			for (size_t i = 0; i < count; i += batch_) {
+				cache.lookup_batch(keys + i, std::min(batch_, count - i),
+						hits_.get() + i, [](const KeyT &key) {
+							return key;
+						});
+			}
+
+			for (size_t i = 0; i < count; i++)
+				chunk_hits_ += hits_[i];
+
+			return chunk_hits_;
+		});
+	} else if (policy == "wtinylfu_arc") {
+		result = runPolicy<WTinyLFUCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "lru") {
+		result = runPolicy<LRUCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "lfu") {
+		result = runPolicy<LFUCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "2q") {
+		result = runPolicy<TwoQCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "lirs") {
+		result = runPolicy<LIRSCache<KeyT, KeyT>>(policy, cache_size);
+	} else if (policy == "car") {
+		result = replayStream(policy, cache_size, [&]() {
+			return std::make_unique<CARCache<benchData, KeyT>>(cache_size);
+		}, lookupElements_);
+	} else if (policy == "sharded_arc") {
+		result = replayStream(policy, cache_size, [&]() {
+			return std::make_unique<ShardedARCache<benchData, KeyT>>(cache_size);
+		}, lookupElements_);
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+void writeReport(std::ostream &out, const std::string &label,
+		const std::string &trace_name, size_t accesses,
+		const std::vector<benchResult> &results) {
+	out << "{\n";
+	out << "  \"label\": " << jsonString(label) << ",\n";
+	out << "  \"trace\": " << jsonString(trace_name) << ",\n";
+	out << "  \"accesses\": " << accesses << ",\n";
+	out << "  \"results\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const benchResult &result_ = results[i];
+		double hit_ratio_ = accesses ? (double) result_.hits / accesses : 0;
+
+		out << "    {\"policy\": " << jsonString(result_.policy)
+				<< ", \"cache_size\": " << result_.cache_size << ", \"hits\": "
+				<< result_.hits
+				<< ", \"hit_ratio\": " << std::setprecision(6) << hit_ratio_
+				<< ", \"ns_per_lookup\": " << result_.ns_per_lookup
+				<< ", \"allocs_per_lookup\": " << result_.allocs_per_lookup
+				<< ", \"peak_rss_kb\": " << result_.peak_rss_kb << "}"
+				<< (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n";
+	out << "}\n";
+}
+
+//! Run all the policies for all cache sizes on 'threads' threads
+//! @return the results in the order of cache sizes and policies
+template<class Runner>
+std::vector<benchResult> runAll(Runner &runner,
+		const std::vector<size_t> &cache_sizes,
+		const std::vector<std::string> &policies, size_t threads,
+		size_t accesses) {
+	std::vector<benchResult> results(cache_sizes.size() * policies.size());
+
+	// Runs are taken by the workers one by one, so slow runs don't hold up the others
+	std::atomic<size_t> next_run(0);
+	std::mutex output_lock;
+
+	auto worker_ = [&]() {
+		for (size_t i = next_run++; i < results.size(); i = next_run++) {
+			benchResult &result_ = results[i];
+
+			runner.run(policies[i % policies.size()],
+					cache_sizes[i / policies.size()], result_);
+
+			std::lock_guard<std::mutex> guard_(output_lock);
+
+			std::cerr << std::setw(12) << result_.policy << " c="
+					<< result_.cache_size << ": hit ratio "
+					<< std::setprecision(4)
+					<< (accesses ? (double) result_.hits * 100. / accesses : 0)
+					<< "%, " << result_.ns_per_lookup << " ns/lookup\n";
+		}
+	};
+
+	std::vector<std::thread> workers_;
+
+	for (size_t t = 1; t < std::min(threads, results.size()); t++)
+		workers_.emplace_back(worker_);
+
+	worker_();
+
+	for (auto &worker : workers_)
+		worker.join();
+
+	return results;
+}
+
+//! Run all the policies for all cache sizes on 'threads' threads and write
+//! the report (in the order of cache sizes and policies)
+template<class KeyT>
+int runBench(const std::string &trace_name, std::vector<size_t> cache_sizes,
+		const std::vector<std::string> &policies, size_t threads,
+		const std::string &label, const std::string &report_name) {
+	trace<KeyT> accesses;
+
+	if (!accesses.open(trace_name.c_str())) {
+		std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+		return -1;
+	}
+
+	if (cache_sizes.empty())
+		cache_sizes.push_back(accesses.cache_size);
+
+	benchRunner<KeyT> runner(accesses);
+	std::vector<benchResult> results = runAll(runner, cache_sizes, policies,
+			threads, accesses.size);
+
+	if (report_name.empty()) {
+		writeReport(std::cout, label, trace_name, accesses.size, results);
+	} else {
+		std::ofstream report(report_name);
+		writeReport(report, label, trace_name, accesses.size, results);
+	}
+
+	return 0;
+}
+
+//! The same for the synthetic workload
+int runWorkload(const std::string &workload_name,
+		const std::vector<size_t> &cache_sizes,
+		const std::vector<std::string> &policies, size_t threads, uint64_t seed,
+		const std::string &label, const std::string &report_name) {
+	std::vector<workloadPhase> phases;
+
+	if (!parseWorkload(workload_name.substr(4), phases))
+		return -1;
+
+	if (cache_sizes.empty()) {
+		std::cerr << "Error! The cache size of the workload is not given\n";
+		return -1;
+	}
+
+	if (std::find(policies.begin(), policies.end(), "belady") != policies.end()) {
+		std::cerr << "Error! Belady is not run on workloads, see beladyStream\n";
+		return -1;
+	}
+
+	streamRunner<long long> runner(phases, seed);
+	size_t accesses_ = workloadGenerator<long long>(phases, seed).size;
+	std::vector<benchResult> results = runAll(runner, cache_sizes, policies,
+			threads, accesses_);
+
+	if (report_name.empty()) {
+		writeReport(std::cout, label, workload_name, accesses_, results);
+	} else {
+		std::ofstream report(report_name);
+		writeReport(report, label, workload_name, accesses_, results);
+	}
+
+	return 0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	const std::vector<std::string> all_policies = { "arc",
+			"arc_batch", "wtinylfu_arc", "car", "sharded_arc", "lru", "lfu", "2q", "lirs", "belady" };
+
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0]
+				<< " <trace | gen:workload> [-c cache_size]... [-p policy]... [-j threads] [-s seed] [-l label] [-o report.json]\n";
+		return -1;
+	}
+
+	std::string trace_name = argv[1];
+	std::string label = "";
+	std::string report_name = "";
+	std::vector<size_t> cache_sizes;
+	std::vector<std::string> policies;
+	size_t threads = 1;
+	uint64_t seed = 1;
+
+	for (int i = 2; i + 1 < argc; i += 2) {
+		if (!std::strcmp(argv[i], "-c"))
+			cache_sizes.push_back(std::stoul(argv[i + 1]));
+		else if (!std::strcmp(argv[i], "-p"))
+			policies.push_back(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "-j"))
+			threads = std::max(1ul, std::stoul(argv[i + 1]));
+		else if (!std::strcmp(argv[i], "-s"))
+			seed = std::stoull(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "-l"))
+			label = argv[i + 1];
+		else if (!std::strcmp(argv[i], "-o"))
+			report_name = argv[i + 1];
+		else {
+			std::cerr << "Error! Unknown option " << argv[i] << "\n";
+			return -1;
+		}
+	}
+
+	bool workload_ = trace_name.compare(0, 4, "gen:") == 0;
+
+	if (policies.empty()) {
+		policies = all_policies;
+
+		// Belady needs the whole trace
+		if (workload_)
+			policies.pop_back();
+	}
+
+	for (const std::string &policy : policies) {
+		if (std::find(all_policies.begin(), all_policies.end(), policy)
+				== all_policies.end()) {
+			std::cerr << "Error! Unknown policy " << policy << "\n";
+			return -1;
+		}
+	}
+
+	if (workload_)
+		return runWorkload(trace_name, cache_sizes, policies, threads, seed,
+				label, report_name);
+
+	// Binary traces with 8-byte keys are used in place with 8-byte keys
+	if (traceKeyWidth(trace_name.c_str()) == 8)
+		return runBench<long long>(trace_name, cache_sizes, policies, threads,
+				label, report_name);
+
+	return runBench<int>(trace_name, cache_sizes, policies, threads, label,
+			report_name);
+}
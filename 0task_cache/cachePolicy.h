@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cassert>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "arcTelemetry.h"
+
+//! @brief The common interface of all cache policies (ARCache, CARCache,
+//! beladyCache, LRUCache, LFUCache, TwoQCache, LIRSCache). There are no virtual
+//! calls - code that works with any policy takes it as a template parameter:
+//!
+//!  bool lookup(const T *elem) - access the element by 'elem->id', the element
+//! is copied into the cache on a miss, true on a hit
+//!  T& get_or_load(const KeyT &key, Loader loader) - return the cached element,
+//! on a miss it is loaded with 'loader(key)' once and moved into the cache
+//!  T& insert(const KeyT &key, T &&elem) - move the element into the cache as an access
+template<class Cache, class T, class KeyT, class = void>
+struct isCachePolicy : std::false_type {
+};
+
+template<class Cache, class T, class KeyT>
+struct isCachePolicy<Cache, T, KeyT,
+		std::enable_if_t<
+				std::is_same<
+						decltype(std::declval<Cache&>().lookup(
+								std::declval<const T*>())), bool>::value
+						&& std::is_same<
+								decltype(std::declval<Cache&>().get_or_load(
+										std::declval<const KeyT&>(),
+										std::declval<T (*)(const KeyT&)>())),
+								T&>::value
+						&& std::is_same<
+								decltype(std::declval<Cache&>().insert(
+										std::declval<const KeyT&>(),
+										std::declval<T&&>())), T&>::value>> : std::true_type {
+};
+
+//! @brief Access the key in the cache that keeps keys as its elements
+//! (for simulations), true on a hit
+template<class Cache, class KeyT>
+inline bool accessKey(Cache &cache, const KeyT &key) {
+	bool hit_ = true;
+
+	cache.get_or_load(key, [&](const KeyT &loaded) {
+		hit_ = false;
+		return loaded;
+	});
+
+	return hit_;
+}
+
+//! @brief Implements the common interface of cache policies on top of
+//! the policy's own steps (CRTP, so the steps are not virtual):
+//!
+//!  size_t capacity() - the size of the cache
+//!  Node* findNode(const KeyT &key) - the node of the key, resident or not
+//! (nullptr if there is none)
+//!  bool isResident(Node *node) - true if the node keeps an element
+//!  std::optional<T>& touch(Node *node) - update the resident node on a hit
+//!  std::optional<T>& admit(const KeyT &key, Node *node) - make place for the missed
+//! key (its non-resident node or nullptr), the element is put into the result
+//!
+//! The policy calls 'evicted' for every resident element it drops
+//! @param Derived - the policy itself
+template<class Derived, class T, class KeyT>
+class policyBase {
+	//! Keeps the element when the cache has zero size
+	std::optional<T> uncached;
+
+	std::function<void(const KeyT&, T&&, evictionReason)> evict_listener;
+
+	Derived& derived();
+	//! Keep the element of the cache of zero size for the caller, the listener
+	//! gets a copy as evicted at once
+	T& keepUncached(const KeyT &key, T &&elem);
+protected:
+	//! Hand the element that is about to be dropped to the listener
+	void evicted(const KeyT &key, std::optional<T> &elem);
+public:
+	bool lookup(const T *elem);
+
+	template<class Loader>
+	T& get_or_load(const KeyT &key, Loader loader);
+	T& insert(const KeyT &key, T &&elem);
+
+	//! Call 'listener(key, elem, EVICT_CAPACITY)' for every element evicted to
+	//! make place, right before it is forgotten (the element may be moved out).
+	//! A cache of zero size reports every element at once (with a copy of it).
+	//! The listener must not access this cache (see ARCache::setEvictionListener)
+	void setEvictionListener(
+			std::function<void(const KeyT&, T&&, evictionReason)> listener);
+};
+
+template<class Derived, class T, class KeyT>
+inline Derived& policyBase<Derived, T, KeyT>::derived() {
+	return static_cast<Derived&>(*this);
+}
+
+template<class Derived, class T, class KeyT>
+inline T& policyBase<Derived, T, KeyT>::keepUncached(const KeyT &key,
+		T &&elem) {
+	uncached.emplace(std::move(elem));
+
+	if (evict_listener)
+		evict_listener(key, T(*uncached), EVICT_CAPACITY);
+
+	return *uncached;
+}
+
+template<class Derived, class T, class KeyT>
+inline void policyBase<Derived, T, KeyT>::evicted(const KeyT &key,
+		std::optional<T> &elem) {
+	assert(elem);
+
+	if (evict_listener)
+		evict_listener(key, std::move(*elem), EVICT_CAPACITY);
+}
+
+template<class Derived, class T, class KeyT>
+inline bool policyBase<Derived, T, KeyT>::lookup(const T *elem) {
+	assert(elem);
+
+	if (derived().capacity() == 0)
+		return false;
+
+	auto node = derived().findNode(elem->id);
+
+	if (node != nullptr && derived().isResident(node)) {
+		derived().touch(node);
+		return true;
+	}
+
+	derived().admit(elem->id, node).emplace(*elem);
+
+	return false;
+}
+
+template<class Derived, class T, class KeyT>
+template<class Loader>
+inline T& policyBase<Derived, T, KeyT>::get_or_load(const KeyT &key,
+		Loader loader) {
+	if (derived().capacity() == 0) 
+		return keepUncached(key, loader(key));
+
+	auto node = derived().findNode(key);
+
+	if (node != nullptr && derived().isResident(node))
+		return *derived().touch(node);
+
+	// Load before changing the policy, so a throwing loader changes nothing
+	T elem_ = loader(key);
+
+	std::optional<T> &place_ = derived().admit(key, node);
+	place_.emplace(std::move(elem_));
+
+	return *place_;
+}
+
+template<class Derived, class T, class KeyT>
+inline T& policyBase<Derived, T, KeyT>::insert(const KeyT &key, T &&elem) {
+	if (derived().capacity() == 0) 
+		return keepUncached(key, std::move(elem));
+
+	auto node = derived().findNode(key);
+
+	if (node != nullptr && derived().isResident(node)) {
+		std::optional<T> &place_ = derived().touch(node);
+		*place_ = std::move(elem);
+
+		return *place_;
+	}
+
+	std::optional<T> &place_ = derived().admit(key, node);
+	place_.emplace(std::move(elem));
+
+	return *place_;
+}
+
+template<class Derived, class T, class KeyT>
+inline void policyBase<Derived, T, KeyT>::setEvictionListener(
+		std::function<void(const KeyT&, T&&, evictionReason)> listener) {
+	evict_listener = std::move(listener);
+}
@@ -0,0 +1,127 @@
+// Measures read-heavy hit throughput of CARCache for different amounts of
+// reader threads. Every key the readers look up is resident, so all lookups
+// are hits: the lock-free hit path of CARCache is compared with the same
+// lookups under a shared lock (what the readers paid before - every
+// lock_shared writes the one cache line of the lock).
+//
+// Usage: carBench
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "CARCache.h"
+#include "cacheData.h"
+
+namespace {
+
+const int cache_size = 10000;
+const int lookups_per_thread = 2000000;
+const int max_threads = 16;
+
+//! Uniform keys of the resident set, each thread gets its own sequence
+std::vector<cacheData<int>> makeElements(int seed) {
+	std::mt19937 gen_(seed);
+	std::vector<cacheData<int>> elements_(lookups_per_thread);
+
+	for (auto &elem : elements_) {
+		elem.id = gen_() % cache_size;
+		elem.data = elem.id;
+	}
+
+	return elements_;
+}
+
+//! Run 'threads' readers calling 'lookup' and return millions of lookups
+//! per second, 'hits' gets the amount of hits
+template<class Lookup>
+double runReaders(int threads,
+		const std::vector<std::vector<cacheData<int>>> &elements,
+		Lookup lookup, size_t &hits) {
+	std::vector<std::thread> readers_;
+	std::vector<size_t> hits_(threads, 0);
+
+	auto start_ = std::chrono::steady_clock::now();
+
+	for (int t = 0; t < threads; t++) {
+		readers_.emplace_back([&, t]() {
+			size_t thread_hits_ = 0;
+
+			for (const cacheData<int> &elem : elements[t])
+				thread_hits_ += lookup(&elem);
+
+			hits_[t] = thread_hits_;
+		});
+	}
+
+	for (auto &reader : readers_)
+		reader.join();
+
+	std::chrono::duration<double> time_ = std::chrono::steady_clock::now()
+			- start_;
+
+	hits = 0;
+	for (size_t thread_hits : hits_)
+		hits += thread_hits;
+
+	return threads * (double) lookups_per_thread / time_.count() / 1e6;
+}
+
+}
+
+int main() {
+	std::vector<std::vector<cacheData<int>>> elements_;
+	for (int t = 0; t < max_threads; t++)
+		elements_.push_back(makeElements(t + 1));
+
+	CARCache<cacheData<int>> cache_(cache_size);
+	std::shared_mutex shared_lock_;
+
+	// All the keys become resident
+	for (int key = 0; key < cache_size; key++) {
+		cacheData<int> elem_;
+		elem_.id = key;
+		elem_.data = key;
+
+		cache_.lookup(&elem_);
+	}
+
+	std::cout << "Hardware threads: " << std::thread::hardware_concurrency()
+			<< "\n";
+	std::cout << std::setw(8) << "threads" << std::setw(16) << "shared Mops/s"
+			<< std::setw(16) << "lock-free" << std::setw(12) << "speedup"
+			<< std::setw(10) << "hits %" << "\n";
+
+	double lock_free_single = 0;
+
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		size_t hits_ = 0;
+
+		double shared_ = runReaders(threads, elements_,
+				[&](const cacheData<int> *elem) {
+					std::shared_lock<std::shared_mutex> guard_(shared_lock_);
+					return cache_.lookup(elem);
+				}, hits_);
+
+		double lock_free_ = runReaders(threads, elements_,
+				[&](const cacheData<int> *elem) {
+					return cache_.lookup(elem);
+				}, hits_);
+
+		if (threads == 1)
+			lock_free_single = lock_free_;
+
+		std::cout << std::setw(8) << threads << std::setw(16)
+				<< std::setprecision(4) << shared_ << std::setw(16)
+				<< lock_free_ << std::setw(12) << lock_free_ / lock_free_single
+				<< std::setw(10)
+				<< (double) hits_ * 100. / threads / lookups_per_thread << "\n";
+	}
+
+	return 0;
+}
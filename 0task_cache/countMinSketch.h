@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+//! @brief Count-min sketch of 4-bit counters that estimates how often keys
+//! were accessed recently. 16 counters are packed into every word, a key has
+//! one counter in each of 'depth' rows and its frequency is the least of them.
+//! After 5 * capacity increments all counters are halved (aging), so the
+//! sketch forgets the old history and follows the changes of the workload
+//! @param hash - hash of the key, must be mixed well (see hashKey)
+class countMinSketch {
+	static constexpr int depth = 4;
+	static constexpr unsigned max_count = 15;
+
+	//! All the rows share the same table
+	std::vector<uint64_t> table;
+	//! The amount of counters minus one (it is a power of two)
+	size_t mask;
+
+	size_t additions;
+	size_t sample_size;
+
+	//! The index of the key's counter in the row
+	size_t counterIndex(uint64_t hash, int row) const;
+	unsigned getCounter(size_t index) const;
+public:
+	countMinSketch(size_t capacity);
+
+	//! Count one more access of the key
+	void increment(uint64_t hash);
+	//! Estimated amount of the key's accesses (0 - 15)
+	unsigned frequency(uint64_t hash) const;
+	//! Halve all the counters
+	void age();
+};
+
+inline countMinSketch::countMinSketch(size_t capacity) :
+		additions(0) {
+	// 4 counters (2 bytes) per cached entry, at least one word
+	size_t counters_ = 16;
+
+	while (counters_ < 4 * capacity)
+		counters_ <<= 1;
+
+	table.assign(counters_ / 16, 0);
+	mask = counters_ - 1;
+	sample_size = 5 * std::max<size_t>(capacity, 1);
+}
+
+inline size_t countMinSketch::counterIndex(uint64_t hash, int row) const {
+	// Double hashing: the rows differ by the step of the high half
+	uint64_t step_ = (hash >> 32) | 1;
+
+	return (hash + row * step_) & mask;
+}
+
+inline unsigned countMinSketch::getCounter(size_t index) const {
+	return (table[index >> 4] >> ((index & 15) << 2)) & 0xf;
+}
+
+inline void countMinSketch::increment(uint64_t hash) {
+	for (int row = 0; row < depth; row++) {
+		size_t index_ = counterIndex(hash, row);
+
+		if (getCounter(index_) < max_count)
+			table[index_ >> 4] += uint64_t(1) << ((index_ & 15) << 2);
+	}
+
+	if (++additions >= sample_size)
+		age();
+}
+
+inline unsigned countMinSketch::frequency(uint64_t hash) const {
+	unsigned freq_ = max_count;
+
+	for (int row = 0; row < depth; row++)
+		freq_ = std::min(freq_, getCounter(counterIndex(hash, row)));
+
+	return freq_;
+}
+
+inline void countMinSketch::age() {
+	// Shift every counter right, the bits shifted into the next counter are masked
+	for (uint64_t &word : table)
+		word = (word >> 1) & 0x7777777777777777ULL;
+
+	additions /= 2;
+}
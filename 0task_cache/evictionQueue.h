@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "arcTelemetry.h"
+
+//! @brief The entry that left the cache
+template<class T, class KeyT = int>
+struct evictionRecord {
+	KeyT key;
+	T elem;
+	evictionReason reason;
+};
+
+//! @brief Hands evicted entries over to a background thread, so expensive
+//! cleanup (releasing resources, writing values back) is not done on the
+//! lookup path. The cache pushes the entries into a lock-free ring (one
+//! producer - the thread that owns the cache, one consumer), the background
+//! thread takes them by batches of up to 'batch' entries and calls
+//! 'handler(records, count)' for every batch. The ring slots are freed before
+//! the handler is called, so a slow handler only fills the ring up.
+//!
+//! When the ring is full the producer waits for a free slot (every entry is
+//! delivered, none is dropped), such waits are counted as stalls. The
+//! background thread parks on a condition variable when the ring stays empty
+//! for a while, only the push that finds it parked takes the mutex to wake it.
+//! The destructor delivers all the pushed entries and stops the thread
+//! @param T - the type of the cached elements
+template<class T, class KeyT = int>
+class evictionQueue {
+public:
+	using record = evictionRecord<T, KeyT>;
+	using batchHandler = std::function<void(record *records, size_t count)>;
+private:
+	//! The background thread yields this many times on the empty ring before
+	//! it parks, so a steady stream of pushes doesn't wake it every time
+	static constexpr int spin_rounds = 64;
+
+	std::unique_ptr<std::optional<record>[]> slots;
+	size_t mask;
+	size_t batch;
+
+	batchHandler handler;
+
+	//! Positions of the next pushed and the next taken entries, they
+	//! only grow (slots are taken modulo the size of the ring)
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+	//! The amount of entries the handler is done with
+	alignas(64) std::atomic<size_t> handled_count;
+	std::atomic<bool> stopping;
+
+	//! The background thread waits for entries (the ring was empty)
+	std::atomic<bool> parked;
+	std::mutex park_lock;
+	std::condition_variable wake;
+
+	//! Producer only
+	size_t stall_count;
+
+	std::thread consumer;
+
+	//! The loop of the background thread
+	void drain();
+public:
+	//! @param capacity - the size of the ring (rounded up to a power of two)
+	//! @param handler - called from the background thread for every batch
+	evictionQueue(size_t capacity, batchHandler handler, size_t batch = 64);
+	~evictionQueue();
+
+	evictionQueue(const evictionQueue &rhs) = delete;
+	evictionQueue& operator=(const evictionQueue &rhs) = delete;
+
+	//! Queue the entry (waits if the ring is full)
+	void push(const KeyT &key, T &&elem, evictionReason reason);
+	//! The eviction listener of the cache that pushes into this queue
+	//! (see ARCache::setEvictionListener)
+	std::function<void(const KeyT&, T&&, evictionReason)> listener();
+	//! Wait until the handler is done with all the pushed entries
+	void flush();
+
+	//! The amount of entries pushed and the amount of them handled
+	size_t pushed() const;
+	size_t handled() const;
+	//! How many pushes found the ring full
+	size_t stalls() const;
+};
+
+template<class T, class KeyT>
+inline evictionQueue<T, KeyT>::evictionQueue(size_t capacity,
+		batchHandler handler, size_t batch) :
+		mask(0), batch(std::max<size_t>(1, batch)), handler(std::move(handler)), head(
+				0), tail(0), handled_count(0), stopping(false), parked(false), stall_count(
+				0) {
+	assert(this->handler);
+
+	size_t size_ = 1;
+	while (size_ < capacity)
+		size_ <<= 1;
+
+	slots.reset(new std::optional<record>[size_]);
+	mask = size_ - 1;
+
+	consumer = std::thread([this]() {
+		drain();
+	});
+}
+
+template<class T, class KeyT>
+inline evictionQueue<T, KeyT>::~evictionQueue() {
+	{
+		std::lock_guard<std::mutex> guard_(park_lock);
+		stopping.store(true, std::memory_order_release);
+	}
+
+	wake.notify_one();
+	consumer.join();
+}
+
+template<class T, class KeyT>
+inline void evictionQueue<T, KeyT>::drain() {
+	std::vector<record> batch_;
+	batch_.reserve(batch);
+
+	int idle_rounds_ = 0;
+
+	while (true) {
+		size_t tail_ = tail.load(std::memory_order_relaxed);
+		size_t head_ = head.load(std::memory_order_acquire);
+
+		if (head_ == tail_) {
+			// The entries pushed before the stop are delivered
+			if (stopping.load(std::memory_order_acquire)
+					&& head.load(std::memory_order_acquire) == tail_)
+				return;
+
+			if (++idle_rounds_ < spin_rounds) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			idle_rounds_ = 0;
+
+			// 'parked' and 'head' are seq_cst on both sides: either the
+			// producer sees the thread parked or the thread sees the entry
+			std::unique_lock<std::mutex> guard_(park_lock);
+			parked.store(true);
+
+			wake.wait(guard_, [&]() {
+				return head.load() != tail_
+						|| stopping.load(std::memory_order_acquire);
+			});
+
+			parked.store(false, std::memory_order_relaxed);
+			continue;
+		}
+
+		idle_rounds_ = 0;
+
+		size_t count_ = std::min(head_ - tail_, batch);
+
+		for (size_t i = 0; i < count_; i++) {
+			std::optional<record> &slot_ = slots[(tail_ + i) & mask];
+
+			batch_.push_back(std::move(*slot_));
+			slot_.reset();
+		}
+
+		tail.store(tail_ + count_, std::memory_order_release);
+
+		handler(batch_.data(), count_);
+		batch_.clear();
+
+		handled_count.fetch_add(count_, std::memory_order_release);
+	}
+}
+
+template<class T, class KeyT>
+inline void evictionQueue<T, KeyT>::push(const KeyT &key, T &&elem,
+		evictionReason reason) {
+	size_t head_ = head.load(std::memory_order_relaxed);
+
+	if (head_ - tail.load(std::memory_order_acquire) > mask) {
+		stall_count++;
+
+		while (head_ - tail.load(std::memory_order_acquire) > mask)
+			std::this_thread::yield();
+	}
+
+	slots[head_ & mask].emplace(record { key, std::move(elem), reason });
+	head.store(head_ + 1);
+
+	// The thread parks only on the empty ring, so this is the first entry
+	if (parked.load()) {
+		std::lock_guard<std::mutex> guard_(park_lock);
+		wake.notify_one();
+	}
+}
+
+template<class T, class KeyT>
+inline std::function<void(const KeyT&, T&&, evictionReason)> evictionQueue<T,
+		KeyT>::listener() {
+	return [this](const KeyT &key, T &&elem, evictionReason reason) {
+		push(key, std::move(elem), reason);
+	};
+}
+
+template<class T, class KeyT>
+inline void evictionQueue<T, KeyT>::flush() {
+	size_t head_ = head.load(std::memory_order_relaxed);
+
+	while (handled_count.load(std::memory_order_acquire) < head_)
+		std::this_thread::yield();
+}
+
+template<class T, class KeyT>
+inline size_t evictionQueue<T, KeyT>::pushed() const {
+	return head.load(std::memory_order_relaxed);
+}
+
+template<class T, class KeyT>
+inline size_t evictionQueue<T, KeyT>::handled() const {
+	return handled_count.load(std::memory_order_acquire);
+}
+
+template<class T, class KeyT>
+inline size_t evictionQueue<T, KeyT>::stalls() const {
+	return stall_count;
+}
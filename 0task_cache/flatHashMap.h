@@ -0,0 +1,338 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hashMix.h"
+
+//! @brief Open addressing hash map in the style of SwissTable. Keys and values
+//! are stored inline in one array of slots, every slot has a control byte:
+//! empty, deleted or the low 7 bits of the key's hash. Slots are probed by groups
+//! of 16: the control bytes of a group are compared with the hash bits at once
+//! (SSE2, or a scalar loop without it), so usually only the right key is compared
+//! and a probe touches one or two cache lines without any pointer chasing.
+//!
+//! The interface is the part of std::unordered_map the caches use. Iterators are
+//! pointers to the slots, end() is nullptr; they are invalidated by insertions.
+//! @param KeyT, ValueT - must be default constructible (free slots keep defaults)
+//! @param Hash - the hash of keys, it is mixed (see mixHash) so identity hashes work
+template<class KeyT, class ValueT, class Hash = std::hash<KeyT>>
+class flatHashMap {
+public:
+	using value_type = std::pair<KeyT, ValueT>;
+	using iterator = value_type*;
+	using const_iterator = const value_type*;
+private:
+	static constexpr size_t group_size = 16;
+
+	static constexpr int8_t ctrl_empty = -128;
+	static constexpr int8_t ctrl_deleted = -2;
+
+	//! Control bytes, one per slot
+	std::unique_ptr<int8_t[]> ctrl;
+	std::unique_ptr<value_type[]> slots;
+
+	//! The amount of slots (a power of two, at least one group)
+	size_t capacity;
+	size_t used;
+	size_t deleted;
+
+	Hash hasher;
+
+	size_t hashOf(const KeyT &key) const;
+	//! Bits of the group's slots whose control bytes are equal to 'h2'
+	uint32_t matchGroup(size_t group, int8_t h2) const;
+	//! Bits of the group's slots that are empty
+	uint32_t matchEmpty(size_t group) const;
+	//! Bits of the group's slots that are empty or deleted
+	uint32_t matchFree(size_t group) const;
+
+	//! The slot of the key, capacity if there is no such key
+	size_t findIndex(const KeyT &key, size_t hash) const;
+	//! The first free slot on the probe sequence of the hash
+	size_t findFree(size_t hash) const;
+	//! Put the key into a free slot (the key must not be in the map)
+	iterator insertNew(const KeyT &key, size_t hash, ValueT &&value);
+	void rehash(size_t new_capacity);
+public:
+	flatHashMap();
+
+	iterator find(const KeyT &key);
+	const_iterator find(const KeyT &key) const;
+	iterator end();
+	const_iterator end() const;
+
+	//! Insert the key if it is not in the map yet
+	//! @return the slot of the key and true if it was inserted
+	std::pair<iterator, bool> emplace(const KeyT &key, ValueT value);
+	ValueT& operator[](const KeyT &key);
+	//! @return the amount of erased keys (0 or 1)
+	size_t erase(const KeyT &key);
+
+	void reserve(size_t count);
+	void clear();
+
+	size_t size() const;
+	bool empty() const;
+
+	//! Start loading the control bytes and slots the key is probed in first
+	void prefetch(const KeyT &key) const;
+};
+
+template<class KeyT, class ValueT, class Hash>
+inline flatHashMap<KeyT, ValueT, Hash>::flatHashMap() :
+		capacity(0), used(0), deleted(0) {
+	rehash(group_size);
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline size_t flatHashMap<KeyT, ValueT, Hash>::hashOf(const KeyT &key) const {
+	return mixHash(hasher(key));
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline uint32_t flatHashMap<KeyT, ValueT, Hash>::matchGroup(size_t group,
+		int8_t h2) const {
+	const int8_t *ctrl_ = &ctrl[group * group_size];
+
+#if defined(__SSE2__)
+	__m128i bytes_ = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl_));
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes_, _mm_set1_epi8(h2)));
+#else
+	uint32_t bits_ = 0;
+
+	for (size_t i = 0; i < group_size; i++)
+		bits_ |= uint32_t(ctrl_[i] == h2) << i;
+
+	return bits_;
+#endif
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline uint32_t flatHashMap<KeyT, ValueT, Hash>::matchEmpty(
+		size_t group) const {
+	return matchGroup(group, ctrl_empty);
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline uint32_t flatHashMap<KeyT, ValueT, Hash>::matchFree(size_t group) const {
+	const int8_t *ctrl_ = &ctrl[group * group_size];
+
+	// Empty and deleted slots are the only ones with the high bit set
+#if defined(__SSE2__)
+	return _mm_movemask_epi8(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl_)));
+#else
+	uint32_t bits_ = 0;
+
+	for (size_t i = 0; i < group_size; i++)
+		bits_ |= uint32_t(ctrl_[i] < 0) << i;
+
+	return bits_;
+#endif
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline size_t flatHashMap<KeyT, ValueT, Hash>::findIndex(const KeyT &key,
+		size_t hash) const {
+	size_t group_mask_ = capacity / group_size - 1;
+	size_t group_ = (hash >> 7) & group_mask_;
+	int8_t h2_ = hash & 0x7f;
+
+	// Triangular probing visits every group when their amount is a power of two
+	for (size_t step = 1;; step++) {
+		for (uint32_t bits_ = matchGroup(group_, h2_); bits_ != 0;
+				bits_ &= bits_ - 1) {
+			size_t index_ = group_ * group_size + __builtin_ctz(bits_);
+
+			if (slots[index_].first == key)
+				return index_;
+		}
+
+		// A key is never put behind a group that has an empty slot
+		if (matchEmpty(group_) != 0 || step > group_mask_)
+			return capacity;
+
+		group_ = (group_ + step) & group_mask_;
+	}
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline size_t flatHashMap<KeyT, ValueT, Hash>::findFree(size_t hash) const {
+	size_t group_mask_ = capacity / group_size - 1;
+	size_t group_ = (hash >> 7) & group_mask_;
+
+	for (size_t step = 1;; step++) {
+		uint32_t bits_ = matchFree(group_);
+
+		if (bits_ != 0)
+			return group_ * group_size + __builtin_ctz(bits_);
+
+		group_ = (group_ + step) & group_mask_;
+	}
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline typename flatHashMap<KeyT, ValueT, Hash>::iterator flatHashMap<KeyT,
+		ValueT, Hash>::insertNew(const KeyT &key, size_t hash, ValueT &&value) {
+	// At most 7/8 of the slots are taken (deleted ones too), so probes stay short
+	if (8 * (used + deleted + 1) > 7 * capacity)
+		rehash((2 * (used + 1) > capacity) ? 2 * capacity : capacity);
+
+	size_t index_ = findFree(hash);
+
+	if (ctrl[index_] == ctrl_deleted)
+		deleted--;
+
+	ctrl[index_] = hash & 0x7f;
+	slots[index_].first = key;
+	slots[index_].second = std::move(value);
+	used++;
+
+	return &slots[index_];
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline void flatHashMap<KeyT, ValueT, Hash>::rehash(size_t new_capacity) {
+	std::unique_ptr<int8_t[]> old_ctrl_ = std::move(ctrl);
+	std::unique_ptr<value_type[]> old_slots_ = std::move(slots);
+	size_t old_capacity_ = capacity;
+
+	ctrl.reset(new int8_t[new_capacity]);
+	slots.reset(new value_type[new_capacity]);
+	std::memset(ctrl.get(), ctrl_empty, new_capacity);
+
+	capacity = new_capacity;
+	used = 0;
+	deleted = 0;
+
+	for (size_t i = 0; i < old_capacity_; i++) {
+		if (old_ctrl_[i] < 0)
+			continue;
+
+		size_t index_ = findFree(hashOf(old_slots_[i].first));
+
+		ctrl[index_] = old_ctrl_[i];
+		slots[index_] = std::move(old_slots_[i]);
+		used++;
+	}
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline typename flatHashMap<KeyT, ValueT, Hash>::iterator flatHashMap<KeyT,
+		ValueT, Hash>::find(const KeyT &key) {
+	size_t index_ = findIndex(key, hashOf(key));
+
+	return (index_ != capacity) ? &slots[index_] : nullptr;
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline typename flatHashMap<KeyT, ValueT, Hash>::const_iterator flatHashMap<
+		KeyT, ValueT, Hash>::find(const KeyT &key) const {
+	size_t index_ = findIndex(key, hashOf(key));
+
+	return (index_ != capacity) ? &slots[index_] : nullptr;
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline typename flatHashMap<KeyT, ValueT, Hash>::iterator flatHashMap<KeyT,
+		ValueT, Hash>::end() {
+	return nullptr;
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline typename flatHashMap<KeyT, ValueT, Hash>::const_iterator flatHashMap<
+		KeyT, ValueT, Hash>::end() const {
+	return nullptr;
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline std::pair<typename flatHashMap<KeyT, ValueT, Hash>::iterator, bool> flatHashMap<
+		KeyT, ValueT, Hash>::emplace(const KeyT &key, ValueT value) {
+	size_t hash_ = hashOf(key);
+	size_t index_ = findIndex(key, hash_);
+
+	if (index_ != capacity)
+		return {&slots[index_], false};
+
+	return {insertNew(key, hash_, std::move(value)), true};
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline ValueT& flatHashMap<KeyT, ValueT, Hash>::operator[](const KeyT &key) {
+	return emplace(key, ValueT()).first->second;
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline size_t flatHashMap<KeyT, ValueT, Hash>::erase(const KeyT &key) {
+	size_t index_ = findIndex(key, hashOf(key));
+
+	if (index_ == capacity)
+		return 0;
+
+	// No probe went past a group with an empty slot, so the slot may become
+	// empty again. Otherwise it must stay in the way of the probes
+	if (matchEmpty(index_ / group_size) != 0) {
+		ctrl[index_] = ctrl_empty;
+	} else {
+		ctrl[index_] = ctrl_deleted;
+		deleted++;
+	}
+
+	// Free the memory of the key and the value
+	slots[index_] = value_type();
+	used--;
+
+	return 1;
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline void flatHashMap<KeyT, ValueT, Hash>::reserve(size_t count) {
+	size_t capacity_ = group_size;
+
+	while (8 * count > 7 * capacity_)
+		capacity_ *= 2;
+
+	if (capacity_ > capacity)
+		rehash(capacity_);
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline void flatHashMap<KeyT, ValueT, Hash>::clear() {
+	for (size_t i = 0; i < capacity; i++) {
+		if (ctrl[i] >= 0)
+			slots[i] = value_type();
+	}
+
+	std::memset(ctrl.get(), ctrl_empty, capacity);
+	used = 0;
+	deleted = 0;
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline size_t flatHashMap<KeyT, ValueT, Hash>::size() const {
+	return used;
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline bool flatHashMap<KeyT, ValueT, Hash>::empty() const {
+	return used == 0;
+}
+
+template<class KeyT, class ValueT, class Hash>
+inline void flatHashMap<KeyT, ValueT, Hash>::prefetch(const KeyT &key) const {
+	size_t hash_ = hashOf(key);
+	size_t group_ = (hash_ >> 7) & (capacity / group_size - 1);
+
+	__builtin_prefetch(&ctrl[group_ * group_size]);
+	__builtin_prefetch(&slots[group_ * group_size]);
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "hashMix.h"
+
+//! @brief FIFO of "ghost" entries that keeps only 32-bit fingerprints of keys
+//! (and the weights the entries had). Entries are appended to a log, the ones
+//! removed from the middle are marked dead and the log is compacted when it is
+//! full. An open addressing table maps a fingerprint to its position in the log,
+//! so a ghost costs about 16 bytes instead of a node with a key and an element.
+//!
+//! Different keys with the same fingerprint are the same ghost, so a key that was
+//! never evicted is taken for a ghost with probability size() / 2^32 (0.2% for
+//! 10M ghosts). ARC only uses ghosts to adapt 'p', so such false hits are harmless
+class ghostList {
+	struct Entry {
+		uint32_t fingerprint;
+		//! 0 for dead entries (removed from the middle of the FIFO)
+		uint32_t weight;
+	};
+
+	//! The oldest entry is at 'tail', the newest one is at 'head - 1'
+	std::vector<Entry> log;
+	size_t tail;
+	size_t head;
+
+	//! Position in the log + 1 of every live entry, 0 for empty slots
+	std::vector<uint32_t> table;
+	size_t mask;
+
+	size_t count;
+	size_t total_weight;
+
+	//! The first slot probed for the fingerprint. The fingerprint is mixed
+	//! again: its bits may select the shard of the cache as well, then all
+	//! fingerprints of the shard share them
+	size_t homeSlot(uint32_t fingerprint) const;
+	//! The slot of the fingerprint or the empty slot where it should be
+	size_t findSlot(uint32_t fingerprint) const;
+	//! Empty the slot moving back the entries probed after it
+	void eraseSlot(size_t slot);
+	//! Forget the entry at the position of the log
+	size_t eraseEntry(size_t slot, size_t pos);
+	//! Move live entries to the beginning of the log (growing it if needed)
+	void compact();
+	//! Rebuild the table with the given amount of slots (a power of two)
+	void rehash(size_t table_size);
+public:
+	ghostList();
+
+	//! The fingerprint of the key's hash (see hashKey)
+	static uint32_t fingerprint(uint64_t hash);
+
+	bool contains(uint32_t fingerprint) const;
+	//! Start loading the table slot of the fingerprint into the CPU cache
+	void prefetch(uint32_t fingerprint) const;
+
+	//! Remember the entry as the newest one (the old entry of the same
+	//! fingerprint is forgotten)
+	void push_front(uint32_t fingerprint, size_t weight);
+	//! Forget the oldest entry, returns its weight
+	size_t pop_back();
+	//! Forget the entry, returns its weight (0 if there is no such entry)
+	size_t remove(uint32_t fingerprint);
+
+	size_t size() const;
+	bool empty() const;
+	//! The total weight of the entries
+	size_t weight() const;
+	//! The amount of bytes taken by the list
+	size_t memory() const;
+
+	//! Call 'func(fingerprint, weight)' for every entry from the newest to the oldest
+	template<class Func>
+	void forEach(Func func) const;
+};
+
+inline ghostList::ghostList() :
+		log(16), tail(0), head(0), table(16, 0), mask(15), count(0), total_weight(
+				0) {
+}
+
+inline uint32_t ghostList::fingerprint(uint64_t hash) {
+	return static_cast<uint32_t>(hash >> 32);
+}
+
+inline size_t ghostList::homeSlot(uint32_t fingerprint) const {
+	return mixHash(fingerprint) & mask;
+}
+
+inline size_t ghostList::findSlot(uint32_t fingerprint) const {
+	size_t slot_ = homeSlot(fingerprint);
+
+	while (table[slot_] != 0
+			&& log[table[slot_] - 1].fingerprint != fingerprint)
+		slot_ = (slot_ + 1) & mask;
+
+	return slot_;
+}
+
+inline void ghostList::eraseSlot(size_t slot) {
+	table[slot] = 0;
+
+	// Linear probing: the following entries that can't be found through
+	// the empty slot any more are moved into it
+	for (size_t next_ = (slot + 1) & mask; table[next_] != 0;
+			next_ = (next_ + 1) & mask) {
+		size_t home_ = homeSlot(log[table[next_] - 1].fingerprint);
+
+		bool reachable_ =
+				(slot <= next_) ?
+						(slot < home_ && home_ <= next_) :
+						(slot < home_ || home_ <= next_);
+
+		if (!reachable_) {
+			table[slot] = table[next_];
+			table[next_] = 0;
+			slot = next_;
+		}
+	}
+}
+
+inline size_t ghostList::eraseEntry(size_t slot, size_t pos) {
+	size_t weight_ = log[pos].weight;
+
+	log[pos].weight = 0;
+	eraseSlot(slot);
+
+	count--;
+	total_weight -= weight_;
+
+	if (count == 0) {
+		tail = 0;
+		head = 0;
+	}
+
+	return weight_;
+}
+
+inline void ghostList::compact() {
+	size_t live_ = 0;
+
+	for (size_t pos = tail; pos < head; pos++) {
+		if (log[pos].weight != 0)
+			log[live_++] = log[pos];
+	}
+
+	assert(live_ == count);
+
+	tail = 0;
+	head = count;
+
+	// Keep at least half of the log free, so compacting is amortized O(1)
+	if (2 * count >= log.size())
+		log.resize(2 * log.size());
+
+	rehash(table.size());
+}
+
+inline void ghostList::rehash(size_t table_size) {
+	table.assign(table_size, 0);
+	mask = table_size - 1;
+
+	for (size_t pos = tail; pos < head; pos++) {
+		if (log[pos].weight != 0)
+			table[findSlot(log[pos].fingerprint)] = pos + 1;
+	}
+}
+
+inline bool ghostList::contains(uint32_t fingerprint) const {
+	return table[findSlot(fingerprint)] != 0;
+}
+
+inline void ghostList::prefetch(uint32_t fingerprint) const {
+	__builtin_prefetch(&table[homeSlot(fingerprint)]);
+}
+
+inline void ghostList::push_front(uint32_t fingerprint, size_t weight) {
+	remove(fingerprint);
+
+	// Keep the table at most 3/4 full
+	if (4 * (count + 1) > 3 * table.size())
+		rehash(2 * table.size());
+
+	if (head == log.size())
+		compact();
+
+	// Weights of ghosts are saturated at 4 GB
+	uint32_t weight_ = static_cast<uint32_t>(std::min<size_t>(
+			std::max<size_t>(weight, 1), std::numeric_limits<uint32_t>::max()));
+
+	log[head] = {fingerprint, weight_};
+	table[findSlot(fingerprint)] = head + 1;
+
+	head++;
+	count++;
+	total_weight += weight_;
+}
+
+inline size_t ghostList::pop_back() {
+	assert(count != 0);
+
+	while (log[tail].weight == 0)
+		tail++;
+
+	size_t pos_ = tail;
+
+	return eraseEntry(findSlot(log[pos_].fingerprint), pos_);
+}
+
+inline size_t ghostList::remove(uint32_t fingerprint) {
+	size_t slot_ = findSlot(fingerprint);
+
+	if (table[slot_] == 0)
+		return 0;
+
+	return eraseEntry(slot_, table[slot_] - 1);
+}
+
+inline size_t ghostList::size() const {
+	return count;
+}
+
+inline bool ghostList::empty() const {
+	return count == 0;
+}
+
+inline size_t ghostList::weight() const {
+	return total_weight;
+}
+
+inline size_t ghostList::memory() const {
+	return log.capacity() * sizeof(Entry) + table.capacity() * sizeof(uint32_t);
+}
+
+template<class Func>
+inline void ghostList::forEach(Func func) const {
+	for (size_t pos = head; pos > tail; pos--) {
+		if (log[pos - 1].weight != 0)
+			func(log[pos - 1].fingerprint, log[pos - 1].weight);
+	}
+}
@@ -0,0 +1,160 @@
+// Compares std::unordered_map with flatHashMap on the operations a cache index
+// does: lookups (half of them miss) and churn (erase an evicted key, insert
+// the missed one) for integer and string keys.
+//
+// Then measures ghostList of one shard of ShardedARCache: the shard gets only
+// the keys whose hash selects it, the cost per ghost must not grow with the
+// amount of shards (the shard and the ghost slot must use different bits)
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flatHashMap.h"
+#include "ghostList.h"
+#include "hashMix.h"
+
+namespace {
+
+const size_t keys_amount = 1000000;
+const size_t operations = 4000000;
+//! Ghosts kept by the shard (like B1 + B2 of a shard of 'ghosts' entries)
+const size_t ghosts = 100000;
+
+template<class KeyT>
+KeyT makeKey(size_t i);
+
+template<>
+int makeKey<int>(size_t i) {
+	return static_cast<int>(i * 2654435761u);
+}
+
+template<>
+std::string makeKey<std::string>(size_t i) {
+	return "object/" + std::to_string(i * 2654435761u);
+}
+
+double nsPerOperation(std::chrono::steady_clock::time_point start) {
+	std::chrono::duration<double, std::nano> time_ =
+			std::chrono::steady_clock::now() - start;
+
+	return time_.count() / operations;
+}
+
+//! Prints ns per lookup and per churn step of the map
+template<class Map, class KeyT>
+void runMap(const char *name, const std::vector<KeyT> &keys,
+		const std::vector<size_t> &order) {
+	Map map_;
+	map_.reserve(keys_amount);
+
+	// The first half of the keys is in the map, the second one is not
+	for (size_t i = 0; i < keys_amount; i++)
+		map_.emplace(keys[i], static_cast<int>(i));
+
+	size_t found_ = 0;
+	auto start_ = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < operations; i++) {
+		if (map_.find(keys[order[i]]) != map_.end())
+			found_++;
+	}
+
+	double lookup_ = nsPerOperation(start_);
+
+	start_ = std::chrono::steady_clock::now();
+
+	// Evict the oldest key and admit the next one, like a FIFO cache
+	for (size_t i = 0; i < operations; i++) {
+		map_.erase(keys[i % keys.size()]);
+		map_.emplace(keys[(i + keys_amount) % keys.size()], static_cast<int>(i));
+	}
+
+	double churn_ = nsPerOperation(start_);
+
+	std::cout << std::setw(16) << name << std::setw(14)
+			<< std::setprecision(4) << lookup_ << std::setw(14) << churn_
+			<< std::setw(12) << found_ << "\n";
+}
+
+template<class KeyT>
+void runKeys(const char *title) {
+	std::vector<KeyT> keys_;
+	keys_.reserve(2 * keys_amount);
+
+	for (size_t i = 0; i < 2 * keys_amount; i++)
+		keys_.push_back(makeKey<KeyT>(i));
+
+	std::mt19937_64 gen_(1);
+	std::vector<size_t> order_(operations);
+
+	for (auto &index : order_)
+		index = gen_() % keys_.size();
+
+	std::cout << title << ":\n";
+	std::cout << std::setw(16) << "map" << std::setw(14) << "lookup ns"
+			<< std::setw(14) << "churn ns" << std::setw(12) << "found" << "\n";
+
+	runMap<std::unordered_map<KeyT, int>>("unordered_map", keys_, order_);
+	runMap<flatHashMap<KeyT, int>>("flatHashMap", keys_, order_);
+}
+
+//! Prints ns per ghost operation (push the evicted key, look up the missed one)
+//! of the shard 0 of 'shards_count' shards
+void runGhosts(size_t shards_count) {
+	// Hashes of the keys the shard 0 gets, chosen like ShardedARCache::getShard.
+	// The first 'operations + ghosts' go through the FIFO, the rest never do
+	std::vector<uint64_t> hashes_;
+	hashes_.reserve(2 * operations + ghosts);
+
+	for (uint64_t key = 0; hashes_.size() < 2 * operations + ghosts; key++) {
+		uint64_t hash_ = hashKey(key);
+
+		if ((hash_ >> 32) % shards_count == 0)
+			hashes_.push_back(hash_);
+	}
+
+	ghostList ghosts_;
+	size_t found_ = 0;
+
+	// A FIFO of 'ghosts' fingerprints, the keys looked up are half ghosts
+	// (from the middle of the FIFO) and half keys never seen
+	for (size_t i = 0; i < ghosts; i++)
+		ghosts_.push_front(ghostList::fingerprint(hashes_[i]), 1);
+
+	auto start_ = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < operations; i++) {
+		size_t looked_up_ =
+				(i % 2 == 0) ? i + ghosts / 2 : operations + ghosts + i;
+
+		found_ += ghosts_.contains(ghostList::fingerprint(hashes_[looked_up_]));
+
+		ghosts_.pop_back();
+		ghosts_.push_front(ghostList::fingerprint(hashes_[i + ghosts]), 1);
+	}
+
+	std::cout << std::setw(16) << shards_count << std::setw(14)
+			<< std::setprecision(4) << nsPerOperation(start_) << std::setw(12)
+			<< found_ << "\n";
+}
+
+}
+
+int main() {
+	runKeys<int>("int keys");
+	runKeys<std::string>("string keys");
+
+	std::cout << "ghosts of one shard:\n";
+	std::cout << std::setw(16) << "shards" << std::setw(14) << "ghost ns"
+			<< std::setw(12) << "found" << "\n";
+
+	for (size_t shards_count : { 1, 16, 64 })
+		runGhosts(shards_count);
+
+	return 0;
+}
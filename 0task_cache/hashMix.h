@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+//! @brief Finalizer of MurmurHash3: spreads all bits of the hash, so even
+//! std::hash of integers (which is identity) can be split by its low or high bits
+inline uint64_t mixHash(uint64_t hash) {
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+//! @brief Mixed hash of the key
+template<class KeyT>
+inline uint64_t hashKey(const KeyT &key) {
+	return mixHash(std::hash<KeyT>()(key));
+}
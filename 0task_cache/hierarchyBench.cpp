@@ -0,0 +1,186 @@
+// Compares TwoLevelARCache (exclusive and inclusive) with one ARCache of the
+// same total capacity. The levels of the hierarchy split the capacity: L1 gets
+// 1/16, 1/8 or 1/4 of it and L2 the rest. Every configuration replays the same
+// accesses: the trace if it is given, or skewed keys with periodic scans.
+//
+// Usage: hierarchyBench [trace] [-c total_size]
+// The total size is the cache size of the trace (or 10000) by default.
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ARCache.h"
+#include "TwoLevelARCache.h"
+#include "cachePolicy.h"
+#include "trace.h"
+
+namespace {
+
+const size_t default_size = 10000;
+const size_t synthetic_accesses = 5000000;
+//! Synthetic keys are taken from 'keys_per_entry' * size keys
+const size_t keys_per_entry = 8;
+//! Every 'scan_period' accesses a scan of 'size' new keys goes through
+const size_t scan_period = 500000;
+
+struct hierarchyResult {
+	std::string name;
+	size_t hits;
+	//! L1 and L2 hits (the single cache has only L1)
+	size_t level_hits[2];
+	size_t level_lookups[2];
+	//! Millions of accesses per second
+	double mops;
+};
+
+//! Skewed keys with scans of keys that are never accessed again
+std::vector<long long> makeKeys(size_t total_size) {
+	std::mt19937 gen_(1);
+	std::uniform_real_distribution<double> dist_(0.0, 1.0);
+
+	std::vector<long long> keys_;
+	keys_.reserve(synthetic_accesses);
+
+	long long scan_key_ = keys_per_entry * total_size;
+
+	while (keys_.size() < synthetic_accesses) {
+		if (keys_.size() % scan_period == scan_period - 1) {
+			for (size_t i = 0; i < total_size; i++)
+				keys_.push_back(scan_key_++);
+		}
+
+		keys_.push_back(static_cast<long long>(keys_per_entry * total_size
+				* std::pow(dist_(gen_), 3.0)));
+	}
+
+	keys_.resize(synthetic_accesses);
+
+	return keys_;
+}
+
+template<class Cache>
+double replay(Cache &cache, const long long *keys, size_t count,
+		size_t &hits) {
+	auto start_ = std::chrono::steady_clock::now();
+
+	hits = 0;
+	for (size_t i = 0; i < count; i++)
+		hits += accessKey(cache, keys[i]);
+
+	std::chrono::duration<double> time_ = std::chrono::steady_clock::now()
+			- start_;
+
+	return count / time_.count() / 1e6;
+}
+
+hierarchyResult runSingle(size_t total_size, const long long *keys,
+		size_t count) {
+	hierarchyResult result_ { "arc", 0, { 0, 0 }, { count, 0 }, 0 };
+	ARCache<long long, long long> cache_(total_size);
+
+	result_.mops = replay(cache_, keys, count, result_.hits);
+	result_.level_hits[0] = result_.hits;
+
+	return result_;
+}
+
+hierarchyResult runHierarchy(size_t total_size, size_t l1_divisor,
+		hierarchyPolicy policy, const long long *keys, size_t count) {
+	size_t l1_size_ = total_size / l1_divisor;
+	std::string name_ = std::string(
+			(policy == HIERARCHY_EXCLUSIVE) ? "exclusive" : "inclusive")
+			+ " L1=1/" + std::to_string(l1_divisor);
+
+	hierarchyResult result_ { name_, 0, { 0, 0 }, { 0, 0 }, 0 };
+	TwoLevelARCache<long long, long long> cache_(l1_size_,
+			total_size - l1_size_, policy);
+
+	result_.mops = replay(cache_, keys, count, result_.hits);
+
+	for (size_t level = 0; level < 2; level++) {
+		levelStats stats_ = cache_.getStats(level);
+
+		result_.level_hits[level] = stats_.hits;
+		result_.level_lookups[level] = stats_.lookups;
+	}
+
+	return result_;
+}
+
+void printResult(const hierarchyResult &result, size_t count) {
+	auto percent = [](size_t hits, size_t lookups) {
+		return lookups ? (double) hits * 100. / lookups : 0.;
+	};
+
+	std::cout << std::setw(20) << result.name << std::setw(10)
+			<< std::setprecision(4) << percent(result.hits, count)
+			<< std::setw(10) << percent(result.level_hits[0],
+					result.level_lookups[0]) << std::setw(10)
+			<< percent(result.level_hits[1], result.level_lookups[1])
+			<< std::setw(10) << result.mops << "\n";
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	std::string trace_name = "";
+	size_t total_size = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "-c") && i + 1 < argc)
+			total_size = std::stoul(argv[++i]);
+		else if (argv[i][0] != '-' && trace_name.empty())
+			trace_name = argv[i];
+		else {
+			std::cerr << "Error! Unknown option " << argv[i] << "\n";
+			return -1;
+		}
+	}
+
+	trace<long long> accesses;
+	std::vector<long long> synthetic_;
+	const long long *keys_ = nullptr;
+	size_t count_ = 0;
+
+	if (!trace_name.empty()) {
+		if (!accesses.open(trace_name.c_str())) {
+			std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+			return -1;
+		}
+
+		if (total_size == 0)
+			total_size = accesses.cache_size;
+
+		keys_ = accesses.keys;
+		count_ = accesses.size;
+	} else {
+		if (total_size == 0)
+			total_size = default_size;
+
+		synthetic_ = makeKeys(total_size);
+		keys_ = synthetic_.data();
+		count_ = synthetic_.size();
+	}
+
+	std::cout << "Total size " << total_size << ", " << count_
+			<< " accesses\n";
+	std::cout << std::setw(20) << "cache" << std::setw(10) << "hits %"
+			<< std::setw(10) << "L1 %" << std::setw(10) << "L2 %"
+			<< std::setw(10) << "Mops/s" << "\n";
+
+	printResult(runSingle(total_size, keys_, count_), count_);
+
+	for (hierarchyPolicy policy : { HIERARCHY_EXCLUSIVE, HIERARCHY_INCLUSIVE }) {
+		for (size_t l1_divisor : { 16, 8, 4 })
+			printResult(runHierarchy(total_size, l1_divisor, policy, keys_,
+					count_), count_);
+	}
+
+	return 0;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+//! @brief Doubly linked list that doesn't own its nodes - links are stored
+//! inside the nodes themselves, so moving a node from one list to another
+//! is just a pointer splice without any allocation
+//! @param Node - the type of nodes, has 'prev' and 'next' pointers by default
+//! @param Prev, Next - the links used by this list (a node can be linked into
+//! several lists at once if it has several pairs of links)
+template<class Node, Node* Node::*Prev = &Node::prev,
+		Node* Node::*Next = &Node::next>
+class intrusiveList {
+	Node *head;
+	Node *tail;
+
+	size_t count;
+public:
+	intrusiveList();
+
+	intrusiveList(const intrusiveList &rhs) = delete;
+	intrusiveList& operator=(const intrusiveList &rhs) = delete;
+
+	//! The most recently inserted node (MRU end)
+	Node* front() const;
+	//! The oldest node (LRU end)
+	Node* back() const;
+
+	size_t size() const;
+	bool empty() const;
+
+	//! Link the node at the MRU end of the list
+	void push_front(Node *node);
+	//! Link the node at the LRU end of the list
+	void push_back(Node *node);
+	//! Link the node right after 'pos' (towards the LRU end)
+	void insert_after(Node *pos, Node *node);
+	//! Unlink the node from the list (the node must be in this list)
+	void remove(Node *node);
+	//! Move the node that is already in this list to the MRU end
+	void move_to_front(Node *node);
+	//! Forget all the nodes (they are not touched)
+	void clear();
+};
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline intrusiveList<Node, Prev, Next>::intrusiveList() :
+		head(nullptr), tail(nullptr), count(0) {
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline Node* intrusiveList<Node, Prev, Next>::front() const {
+	return head;
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline Node* intrusiveList<Node, Prev, Next>::back() const {
+	return tail;
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline size_t intrusiveList<Node, Prev, Next>::size() const {
+	return count;
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline bool intrusiveList<Node, Prev, Next>::empty() const {
+	return count == 0;
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline void intrusiveList<Node, Prev, Next>::push_front(Node *node) {
+	assert(node);
+
+	node->*Prev = nullptr;
+	node->*Next = head;
+
+	if (head != nullptr)
+		head->*Prev = node;
+	else
+		tail = node;
+
+	head = node;
+	count++;
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline void intrusiveList<Node, Prev, Next>::push_back(Node *node) {
+	assert(node);
+
+	node->*Next = nullptr;
+	node->*Prev = tail;
+
+	if (tail != nullptr)
+		tail->*Next = node;
+	else
+		head = node;
+
+	tail = node;
+	count++;
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline void intrusiveList<Node, Prev, Next>::insert_after(Node *pos,
+		Node *node) {
+	assert(pos);
+	assert(node);
+
+	if (pos == tail) {
+		push_back(node);
+		return;
+	}
+
+	node->*Prev = pos;
+	node->*Next = pos->*Next;
+
+	(pos->*Next)->*Prev = node;
+	pos->*Next = node;
+
+	count++;
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline void intrusiveList<Node, Prev, Next>::remove(Node *node) {
+	assert(node);
+	assert(count != 0);
+
+	if (node->*Prev != nullptr)
+		(node->*Prev)->*Next = node->*Next;
+	else
+		head = node->*Next;
+
+	if (node->*Next != nullptr)
+		(node->*Next)->*Prev = node->*Prev;
+	else
+		tail = node->*Prev;
+
+	node->*Prev = nullptr;
+	node->*Next = nullptr;
+	count--;
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline void intrusiveList<Node, Prev, Next>::move_to_front(Node *node) {
+	assert(node);
+
+	if (node == head)
+		return;
+
+	remove(node);
+	push_front(node);
+}
+
+template<class Node, Node* Node::*Prev, Node* Node::*Next>
+inline void intrusiveList<Node, Prev, Next>::clear() {
+	head = nullptr;
+	tail = nullptr;
+	count = 0;
+}
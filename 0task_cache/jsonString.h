@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+//! @brief The text as a JSON string with the quotes: quotes, backslashes and
+//! control characters are escaped, so labels and file names of reports may
+//! have any of them
+inline std::string jsonString(const std::string &text) {
+	std::string quoted_ = "\"";
+
+	for (char symbol : text) {
+		switch (symbol) {
+		case '"':
+			quoted_ += "\\\"";
+			break;
+		case '\\':
+			quoted_ += "\\\\";
+			break;
+		case '\n':
+			quoted_ += "\\n";
+			break;
+		case '\r':
+			quoted_ += "\\r";
+			break;
+		case '\t':
+			quoted_ += "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(symbol) < 0x20) {
+				char code_[8];
+				std::snprintf(code_, sizeof(code_), "\\u%04x",
+						static_cast<unsigned>(symbol));
+				quoted_ += code_;
+			} else {
+				quoted_ += symbol;
+			}
+		}
+	}
+
+	return quoted_ + "\"";
+}
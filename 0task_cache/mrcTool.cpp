@@ -0,0 +1,327 @@
+// Computes the LRU miss-ratio curve of a trace in one pass: every access gets
+// its stack distance, and the histogram of distances gives the hit ratio of
+// all cache sizes. Long traces can be spatially sampled (SHARDS): only keys
+// whose hash is below a threshold are tracked, and distances are scaled by
+// the sampling rate. With a limit on tracked keys the threshold is lowered
+// whenever the limit is exceeded, so memory stays fixed for any trace.
+//
+// The trace (in any format of cacheBench) is read by chunks and never kept
+// whole, the curve is written as JSON with the same 'hit_ratio' fields as
+// the reports of cacheBench.
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hashMix.h"
+#include "jsonString.h"
+#include "stackDistance.h"
+#include "trace.h"
+
+namespace {
+
+//! The high 24 bits of hashes of keys are compared with the threshold (the
+//! low bits place keys in flatHashMap, they must stay uniform among samples)
+const uint64_t sampling_modulus = uint64_t(1) << 24;
+//! The histogram never has more buckets than this
+const size_t max_buckets = size_t(1) << 20;
+//! Points of the curve when cache sizes are not given
+const size_t default_points = 100;
+//! Accesses read from the trace at once
+const size_t chunk_size = 1 << 16;
+
+//! @brief Histogram of scaled stack distances. Every bucket covers 'width'
+//! distances; when a distance doesn't fit, neighbour buckets are merged
+//! and the width doubles
+class distanceHistogram {
+	std::vector<double> buckets;
+	size_t width;
+
+	//! Accesses of keys that were never seen before
+	double cold;
+	double total;
+public:
+	distanceHistogram();
+
+	void add(size_t distance, double weight);
+	void addCold(double weight);
+	//! Count the difference between the real amount of accesses and the
+	//! estimated one as hits at the shortest distance (SHARDS adjustment)
+	void adjust(double accesses);
+
+	//! The hit ratio of the LRU cache of the given size
+	double hitRatio(size_t cache_size) const;
+	//! The greatest distance that was counted
+	size_t maxDistance() const;
+};
+
+distanceHistogram::distanceHistogram() :
+		buckets(1, 0), width(1), cold(0), total(0) {
+}
+
+void distanceHistogram::add(size_t distance, double weight) {
+	while (distance / width >= max_buckets) {
+		for (size_t i = 0; i < buckets.size(); i++)
+			buckets[i / 2] = (i % 2 ? buckets[i / 2] : 0) + buckets[i];
+
+		buckets.resize((buckets.size() + 1) / 2);
+		width *= 2;
+	}
+
+	size_t bucket_ = distance / width;
+
+	if (bucket_ >= buckets.size())
+		buckets.resize(bucket_ + 1, 0);
+
+	buckets[bucket_] += weight;
+	total += weight;
+}
+
+void distanceHistogram::addCold(double weight) {
+	cold += weight;
+	total += weight;
+}
+
+void distanceHistogram::adjust(double accesses) {
+	buckets[0] += accesses - total;
+	total = accesses;
+}
+
+double distanceHistogram::hitRatio(size_t cache_size) const {
+	if (total <= 0)
+		return 0;
+
+	// A hit needs the distance less than the cache size
+	double hits_ = 0;
+	size_t full_ = cache_size / width;
+
+	for (size_t i = 0; i < full_ && i < buckets.size(); i++)
+		hits_ += buckets[i];
+
+	// The part of the boundary bucket
+	if (full_ < buckets.size())
+		hits_ += buckets[full_] * (double) (cache_size % width) / width;
+
+	return std::min(1.0, std::max(0.0, hits_ / total));
+}
+
+size_t distanceHistogram::maxDistance() const {
+	return buckets.size() * width;
+}
+
+//! @brief Feeds the trace into the stack, sampling keys by their hash
+template<class KeyT>
+class mrcBuilder {
+	stackDistance<KeyT> stack;
+	distanceHistogram histogram;
+
+	//! Keys with the high bits of the hash below the threshold are sampled
+	uint64_t threshold;
+	//! 0 - no limit
+	size_t max_keys;
+
+	//! Sampled keys by their hash, the greatest one on the top
+	std::priority_queue<std::pair<uint64_t, KeyT>> sampled;
+
+	double rate() const;
+	//! Lower the threshold until there are not more than 'max_keys' keys
+	void shrink();
+public:
+	mrcBuilder(double sampling_rate, size_t max_keys_);
+
+	void access(const KeyT &key);
+	void finish(size_t accesses);
+
+	const distanceHistogram& curve() const;
+	double finalRate() const;
+	size_t trackedKeys() const;
+};
+
+template<class KeyT>
+mrcBuilder<KeyT>::mrcBuilder(double sampling_rate, size_t max_keys_) :
+		threshold(sampling_rate * sampling_modulus), max_keys(max_keys_) {
+	threshold = std::max<uint64_t>(1,
+			std::min(threshold, sampling_modulus));
+}
+
+template<class KeyT>
+double mrcBuilder<KeyT>::rate() const {
+	return (double) threshold / sampling_modulus;
+}
+
+template<class KeyT>
+void mrcBuilder<KeyT>::shrink() {
+	while (stack.size() > max_keys && !sampled.empty()) {
+		uint64_t top_ = sampled.top().first;
+
+		// Keys of the top hash are not sampled any more
+		while (!sampled.empty() && sampled.top().first == top_) {
+			stack.forget(sampled.top().second);
+			sampled.pop();
+		}
+
+		threshold = top_;
+	}
+}
+
+template<class KeyT>
+void mrcBuilder<KeyT>::access(const KeyT &key) {
+	uint64_t hash_ = hashKey(key) >> 40;
+
+	if (hash_ >= threshold)
+		return;
+
+	// Every sampled access stands for 1 / rate accesses of the trace
+	double rate_ = rate();
+	size_t distance_ = stack.access(key);
+
+	if (distance_ == stackDistance<KeyT>::infinite) {
+		histogram.addCold(1 / rate_);
+
+		if (max_keys != 0) {
+			sampled.emplace(hash_, key);
+			shrink();
+		}
+	} else {
+		histogram.add(static_cast<size_t>(distance_ / rate_), 1 / rate_);
+	}
+}
+
+template<class KeyT>
+void mrcBuilder<KeyT>::finish(size_t accesses) {
+	if (threshold < sampling_modulus || max_keys != 0)
+		histogram.adjust(accesses);
+}
+
+template<class KeyT>
+const distanceHistogram& mrcBuilder<KeyT>::curve() const {
+	return histogram;
+}
+
+template<class KeyT>
+double mrcBuilder<KeyT>::finalRate() const {
+	return rate();
+}
+
+template<class KeyT>
+size_t mrcBuilder<KeyT>::trackedKeys() const {
+	return stack.size();
+}
+
+template<class KeyT>
+int runMRC(const std::string &trace_name, std::vector<size_t> cache_sizes,
+		double sampling_rate, size_t max_keys, const std::string &output_name) {
+	traceReader<KeyT> reader_;
+
+	if (!reader_.open(trace_name.c_str())) {
+		std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+		return -1;
+	}
+
+	mrcBuilder<KeyT> builder(sampling_rate, max_keys);
+	std::vector<KeyT> keys_(chunk_size);
+
+	for (size_t position_ = 0; position_ < reader_.size;) {
+		size_t count_ = reader_.read(keys_.data(), chunk_size);
+
+		// A text trace ends before its broken key, a binary one can't break
+		if (count_ == 0 && reader_.isBinary()) {
+			std::cerr << "Error! Can't read the trace " << trace_name << "\n";
+			return -1;
+		}
+
+		for (size_t i = 0; i < count_; i++)
+			builder.access(keys_[i]);
+
+		position_ += count_;
+	}
+
+	builder.finish(reader_.size);
+
+	const distanceHistogram &curve_ = builder.curve();
+
+	if (cache_sizes.empty()) {
+		size_t step_ = std::max<size_t>(1,
+				curve_.maxDistance() / default_points);
+
+		for (size_t size = step_; size <= curve_.maxDistance(); size += step_)
+			cache_sizes.push_back(size);
+	}
+
+	std::ofstream file_;
+	if (!output_name.empty())
+		file_.open(output_name);
+
+	std::ostream &out = output_name.empty() ? std::cout : file_;
+
+	out << "{\n  \"trace\": " << jsonString(trace_name) << ",\n  \"accesses\": "
+			<< reader_.size << ",\n  \"sampling_rate\": "
+			<< builder.finalRate() << ",\n  \"tracked_keys\": "
+			<< builder.trackedKeys() << ",\n  \"curve\": [\n";
+
+	for (size_t i = 0; i < cache_sizes.size(); i++) {
+		double hit_ratio_ = curve_.hitRatio(cache_sizes[i]);
+
+		out << "    {\"policy\": \"lru\", \"cache_size\": " << cache_sizes[i]
+				<< ", \"hit_ratio\": " << hit_ratio_ << ", \"miss_ratio\": "
+				<< 1 - hit_ratio_ << "}"
+				<< (i + 1 < cache_sizes.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n}\n";
+
+	std::cerr << "lru miss-ratio curve: " << cache_sizes.size()
+			<< " points, sampling rate " << builder.finalRate() << ", "
+			<< builder.trackedKeys() << " keys tracked\n";
+
+	return 0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0]
+				<< " <trace> [-c cache_size]... [-r sampling_rate] [-s max_keys] [-o curve.json]\n";
+		return -1;
+	}
+
+	std::string trace_name = argv[1];
+	std::string output_name = "";
+	std::vector<size_t> cache_sizes;
+	double sampling_rate = 1;
+	size_t max_keys = 0;
+
+	for (int i = 2; i + 1 < argc; i += 2) {
+		if (!std::strcmp(argv[i], "-c"))
+			cache_sizes.push_back(std::stoul(argv[i + 1]));
+		else if (!std::strcmp(argv[i], "-r"))
+			sampling_rate = std::stod(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "-s"))
+			max_keys = std::stoul(argv[i + 1]);
+		else if (!std::strcmp(argv[i], "-o"))
+			output_name = argv[i + 1];
+		else {
+			std::cerr << "Error! Unknown option " << argv[i] << "\n";
+			return -1;
+		}
+	}
+
+	if (sampling_rate <= 0 || sampling_rate > 1) {
+		std::cerr << "Error! The sampling rate must be in (0, 1]\n";
+		return -1;
+	}
+
+	if (traceKeyWidth(trace_name.c_str()) == 8)
+		return runMRC<long long>(trace_name, cache_sizes, sampling_rate,
+				max_keys, output_name);
+
+	return runMRC<int>(trace_name, cache_sizes, sampling_rate, max_keys,
+			output_name);
+}
@@ -0,0 +1,178 @@
+// Compares hit throughput of ARCache behind one global mutex with
+// ShardedARCache for different amounts of worker threads. Then the threads
+// load missed keys from a slow backend through 'get_or_load': concurrent
+// misses of the same key are coalesced into one load, the amount of loads
+// saved is printed.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "ARCache.h"
+#include "ShardedARCache.h"
+#include "cacheData.h"
+#include "Memory.h"
+
+namespace {
+
+const int cache_size = 10000;
+const int memory_size = 100000;
+const int lookups_per_thread = 1000000;
+const int shards_amount = 64;
+
+//! The backend of the single-flight test: few keys, every load takes a while
+const int backend_keys = 1000;
+const int backend_cache_size = 100;
+const int loads_per_thread = 1000;
+const auto backend_latency = std::chrono::microseconds(500);
+
+//! Skewed indices into the memory, each thread gets its own sequence
+std::vector<int> makeIndices(int seed) {
+	std::mt19937 gen_(seed);
+	std::uniform_real_distribution<double> dist_(0.0, 1.0);
+
+	std::vector<int> indices_(lookups_per_thread);
+	for (auto &index : indices_)
+		index = static_cast<int>(memory_size * std::pow(dist_(gen_), 3.0));
+
+	return indices_;
+}
+
+//! Run 'threads' workers calling 'lookup' and return millions of lookups per second
+template<class Lookup>
+double runThreads(int threads, const std::vector<std::vector<int>> &indices,
+		Memory<cacheData<int>> &memory, Lookup lookup) {
+	std::vector<std::thread> workers_;
+
+	auto start_ = std::chrono::steady_clock::now();
+
+	for (int t = 0; t < threads; t++) {
+		workers_.emplace_back([&, t]() {
+			for (int index : indices[t])
+				lookup(&memory.data[index]);
+		});
+	}
+
+	for (auto &worker : workers_)
+		worker.join();
+
+	std::chrono::duration<double> time_ = std::chrono::steady_clock::now()
+			- start_;
+
+	return threads * (double) lookups_per_thread / time_.count() / 1e6;
+}
+
+//! Run 'threads' workers loading skewed keys through the sharded cache
+//! and print how many misses were coalesced
+void runLoads(int threads, const std::vector<std::vector<int>> &indices) {
+	ShardedARCache<int> cache_(backend_cache_size, 16);
+	std::atomic<size_t> backend_calls_(0);
+	std::vector<std::thread> workers_;
+
+	auto start_ = std::chrono::steady_clock::now();
+
+	for (int t = 0; t < threads; t++) {
+		workers_.emplace_back([&, t]() {
+			for (int i = 0; i < loads_per_thread; i++) {
+				int key_ = indices[t][i] % backend_keys;
+
+				cache_.get_or_load(key_, [&](int key) {
+					backend_calls_++;
+					std::this_thread::sleep_for(backend_latency);
+
+					return key;
+				});
+			}
+		});
+	}
+
+	for (auto &worker : workers_)
+		worker.join();
+
+	std::chrono::duration<double> time_ = std::chrono::steady_clock::now()
+			- start_;
+	shardStats total_ = cache_.getTotalStats();
+	size_t misses_ = total_.lookups - total_.hits;
+
+	std::cout << std::setw(8) << threads << std::setw(12) << misses_
+			<< std::setw(12) << total_.loads << std::setw(12)
+			<< total_.coalesced << std::setw(12) << std::setprecision(3)
+			<< (misses_ ? (float) total_.coalesced * 100.f / misses_ : 0.f)
+			<< std::setw(10) << time_.count() << "\n";
+
+	if (backend_calls_ != total_.loads)
+		std::cerr << "Error! The backend was called " << backend_calls_
+				<< " times for " << total_.loads << " loads\n";
+}
+
+}
+
+int main() {
+	const int max_threads = 32;
+
+	Memory<cacheData<int>> memory(memory_size);
+	memory.fill_rand();
+
+	std::vector<std::vector<int>> indices_;
+	for (int t = 0; t < max_threads; t++)
+		indices_.push_back(makeIndices(t + 1));
+
+	std::cout << "Hardware threads: " << std::thread::hardware_concurrency()
+			<< "\n";
+	std::cout << std::setw(8) << "threads" << std::setw(16) << "global Mops/s"
+			<< std::setw(16) << "sharded Mops/s" << std::setw(12) << "speedup"
+			<< "\n";
+
+	double sharded_single = 0;
+
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		ARCache<cacheData<int>> global_cache(cache_size);
+		std::mutex global_lock;
+
+		double global_ = runThreads(threads, indices_, memory,
+				[&](const cacheData<int> *elem) {
+					std::lock_guard<std::mutex> guard_(global_lock);
+					return global_cache.lookup(elem);
+				});
+
+		ShardedARCache<cacheData<int>> sharded_cache(cache_size,
+				shards_amount);
+
+		double sharded_ = runThreads(threads, indices_, memory,
+				[&](const cacheData<int> *elem) {
+					return sharded_cache.lookup(elem);
+				});
+
+		if (threads == 1)
+			sharded_single = sharded_;
+
+		std::cout << std::setw(8) << threads << std::setw(16)
+				<< std::setprecision(4) << global_ << std::setw(16)
+				<< sharded_ << std::setw(12) << sharded_ / sharded_single
+				<< "\n";
+
+		if (threads == max_threads) {
+			shardStats total_ = sharded_cache.getTotalStats();
+
+			std::cout << "Sharded hit ratio: "
+					<< (float) total_.hits * 100.f / total_.lookups << "%\n";
+		}
+	}
+
+	std::cout << "\nSingle-flight loads (" << backend_latency.count()
+			<< " us per load):\n";
+	std::cout << std::setw(8) << "threads" << std::setw(12) << "misses"
+			<< std::setw(12) << "loads" << std::setw(12) << "coalesced"
+			<< std::setw(12) << "saved %" << std::setw(10) << "time, s" << "\n";
+
+	for (int threads = 1; threads <= max_threads; threads *= 2)
+		runLoads(threads, indices_);
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+//! @brief Fixed size pool of nodes allocated with one allocation at construction.
+//! Free nodes are chained through their 'next' pointer, so acquiring and
+//! releasing a node never touches the heap. A pool that can't know its size
+//! in advance may be grown with one more allocation for a block of nodes
+//! @param Node - the type of nodes, must have a 'next' pointer and be default constructible
+template<class Node>
+class slabPool {
+	std::vector<std::unique_ptr<Node[]>> blocks;
+	Node *free_head;
+
+	size_t capacity;
+	size_t used;
+public:
+	slabPool(size_t pool_size);
+
+	slabPool(const slabPool &rhs) = delete;
+	slabPool& operator=(const slabPool &rhs) = delete;
+
+	//! Take a free node from the pool (nullptr if the pool is exhausted)
+	Node* acquire();
+	//! Give the node back to the pool
+	void release(Node *node);
+	//! Add 'count' more free nodes to the pool
+	void grow(size_t count);
+
+	size_t size() const;
+	size_t max_size() const;
+};
+
+template<class Node>
+inline slabPool<Node>::slabPool(size_t pool_size) :
+		free_head(nullptr), capacity(0), used(0) {
+	grow(pool_size);
+}
+
+template<class Node>
+inline void slabPool<Node>::grow(size_t count) {
+	Node *nodes_ = new Node[count];
+	blocks.emplace_back(nodes_);
+
+	for (size_t i = 0; i < count; i++) {
+		nodes_[i].next = free_head;
+		free_head = &nodes_[i];
+	}
+
+	capacity += count;
+}
+
+template<class Node>
+inline Node* slabPool<Node>::acquire() {
+	if (free_head == nullptr)
+		return nullptr;
+
+	Node *node = free_head;
+	free_head = node->next;
+
+	node->next = nullptr;
+	used++;
+
+	return node;
+}
+
+template<class Node>
+inline void slabPool<Node>::release(Node *node) {
+	assert(node);
+	assert(used != 0);
+
+	node->next = free_head;
+	free_head = node;
+
+	used--;
+}
+
+template<class Node>
+inline size_t slabPool<Node>::size() const {
+	return used;
+}
+
+template<class Node>
+inline size_t slabPool<Node>::max_size() const {
+	return capacity;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "flatHashMap.h"
+
+//! @brief LRU stack distances of a stream of keys (Mattson's algorithm). The
+//! distance of an access is the amount of distinct keys accessed since the
+//! previous access of the same key, so the access hits in every LRU cache
+//! bigger than its distance - one pass gives hits of all cache sizes at once.
+//!
+//! Every key marks the slot of its last access in a Fenwick tree (a balanced
+//! tree over the slots stored implicitly in an array), so the distance is the
+//! amount of marks after the slot, counted in O(log n). When the slots run out
+//! the marked ones are renumbered from zero, so memory is O(distinct keys)
+//! and doesn't depend on the length of the stream
+template<class KeyT>
+class stackDistance {
+	//! The slot of the last access of every tracked key
+	flatHashMap<KeyT, size_t> last_slot;
+
+	//! Fenwick tree of marks (1-based inside)
+	std::vector<uint32_t> tree;
+	//! The key that marked every slot and whether the mark is still there
+	std::vector<KeyT> owners;
+	std::vector<char> marked;
+
+	size_t next_slot;
+	size_t marked_count;
+
+	void add(size_t slot, int delta);
+	//! The amount of marks in the slots [0, slot]
+	size_t prefix(size_t slot) const;
+	void unmark(size_t slot);
+	//! Renumber the marked slots from zero, growing the tree if needed
+	void compact();
+public:
+	//! The distance of the first access of a key
+	static constexpr size_t infinite = std::numeric_limits<size_t>::max();
+
+	stackDistance();
+
+	//! Count the access of the key and return its distance
+	size_t access(const KeyT &key);
+	//! Stop tracking the key (its next access will be a first one)
+	void forget(const KeyT &key);
+
+	//! The amount of tracked keys
+	size_t size() const;
+};
+
+template<class KeyT>
+inline stackDistance<KeyT>::stackDistance() :
+		tree(1025, 0), owners(1024), marked(1024, 0), next_slot(0), marked_count(
+				0) {
+}
+
+template<class KeyT>
+inline void stackDistance<KeyT>::add(size_t slot, int delta) {
+	for (size_t i = slot + 1; i < tree.size(); i += i & (~i + 1))
+		tree[i] += delta;
+}
+
+template<class KeyT>
+inline size_t stackDistance<KeyT>::prefix(size_t slot) const {
+	size_t sum_ = 0;
+
+	for (size_t i = slot + 1; i > 0; i -= i & (~i + 1))
+		sum_ += tree[i];
+
+	return sum_;
+}
+
+template<class KeyT>
+inline void stackDistance<KeyT>::unmark(size_t slot) {
+	add(slot, -1);
+	marked[slot] = 0;
+	marked_count--;
+}
+
+template<class KeyT>
+inline void stackDistance<KeyT>::compact() {
+	size_t count_ = 0;
+
+	for (size_t slot = 0; slot < next_slot; slot++) {
+		if (!marked[slot])
+			continue;
+
+		owners[count_] = owners[slot];
+		last_slot[owners[count_]] = count_;
+		count_++;
+	}
+
+	assert(count_ == marked_count);
+
+	// Keep at least half of the slots free, so compacting is amortized O(1)
+	size_t slots_ = owners.size();
+	if (2 * count_ >= slots_)
+		slots_ *= 2;
+
+	owners.resize(slots_);
+	marked.assign(slots_, 0);
+	std::fill(marked.begin(), marked.begin() + count_, 1);
+
+	// Build the tree of 'count_' marks in O(n)
+	tree.assign(slots_ + 1, 0);
+	for (size_t i = 1; i <= slots_; i++) {
+		tree[i] += (i <= count_) ? 1 : 0;
+
+		size_t parent_ = i + (i & (~i + 1));
+		if (parent_ <= slots_)
+			tree[parent_] += tree[i];
+	}
+
+	next_slot = count_;
+}
+
+template<class KeyT>
+inline size_t stackDistance<KeyT>::access(const KeyT &key) {
+	size_t distance_ = infinite;
+	auto last_ = last_slot.find(key);
+
+	if (last_ != last_slot.end()) {
+		size_t slot_ = last_->second;
+
+		// Keys accessed after the last access of this one
+		distance_ = marked_count - prefix(slot_);
+		unmark(slot_);
+	}
+
+	if (next_slot == owners.size())
+		compact();
+
+	size_t slot_ = next_slot++;
+
+	add(slot_, 1);
+	owners[slot_] = key;
+	marked[slot_] = 1;
+	marked_count++;
+
+	last_slot[key] = slot_;
+
+	return distance_;
+}
+
+template<class KeyT>
+inline void stackDistance<KeyT>::forget(const KeyT &key) {
+	auto last_ = last_slot.find(key);
+
+	if (last_ == last_slot.end())
+		return;
+
+	unmark(last_->second);
+	last_slot.erase(key);
+}
+
+template<class KeyT>
+inline size_t stackDistance<KeyT>::size() const {
+	return marked_count;
+}
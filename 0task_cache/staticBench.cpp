@@ -0,0 +1,140 @@
+// Compares StaticARCache with ARCache of the same small sizes: both replay the
+// same skewed accesses, the hits must be the same (ghosts of ARCache are
+// fingerprints, a collision could change them, but not at these sizes).
+// Heap allocations are counted from the construction of the cache on.
+//
+// Usage: staticBench
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "ARCache.h"
+#include "StaticARCache.h"
+
+namespace {
+
+//! Accesses replayed for every cache size
+const size_t accesses = 5000000;
+//! Keys are taken from 'keys_per_entry' * c keys
+const size_t keys_per_entry = 8;
+
+size_t alloc_count = 0;
+
+}
+
+// Count all allocations of the program
+void* operator new(size_t size) {
+	alloc_count++;
+
+	void *ptr = std::malloc(size ? size : 1);
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+// GCC doesn't know the replaced operator new uses malloc
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+namespace {
+
+struct benchResult {
+	size_t hits;
+	//! Millions of accesses per second
+	double mops;
+	size_t allocs;
+};
+
+//! Skewed keys: low keys are accessed much more often
+std::vector<int> makeKeys(size_t cache_size) {
+	std::mt19937 gen_(cache_size);
+	std::uniform_real_distribution<double> dist_(0.0, 1.0);
+
+	std::vector<int> keys_(accesses);
+	for (auto &key : keys_)
+		key = static_cast<int>(keys_per_entry * cache_size
+				* std::pow(dist_(gen_), 3.0));
+
+	return keys_;
+}
+
+template<class Cache>
+benchResult replay(Cache &cache, const std::vector<int> &keys,
+		size_t allocs_before) {
+	size_t hits_ = 0;
+	auto start_ = std::chrono::steady_clock::now();
+
+	for (int key : keys) {
+		bool hit_ = true;
+
+		cache.get_or_load(key, [&](int key_) {
+			hit_ = false;
+			return key_;
+		});
+
+		hits_ += hit_;
+	}
+
+	std::chrono::duration<double> time_ = std::chrono::steady_clock::now()
+			- start_;
+
+	return benchResult { hits_, keys.size() / time_.count() / 1e6, alloc_count
+			- allocs_before };
+}
+
+template<size_t Capacity>
+void compare() {
+	std::vector<int> keys_ = makeKeys(Capacity);
+
+	size_t allocs_before_ = alloc_count;
+	ARCache<int> dynamic_cache(Capacity);
+	benchResult dynamic_ = replay(dynamic_cache, keys_, allocs_before_);
+
+	// Static storage: the cache is too big for the stack at large sizes
+	allocs_before_ = alloc_count;
+	static StaticARCache<int, int, Capacity> static_cache;
+	benchResult static_ = replay(static_cache, keys_, allocs_before_);
+
+	std::cout << std::setw(8) << Capacity << std::setw(12)
+			<< std::setprecision(4) << dynamic_.mops << std::setw(12)
+			<< static_.mops << std::setw(10) << static_.mops / dynamic_.mops
+			<< std::setw(10) << dynamic_.allocs << std::setw(10)
+			<< static_.allocs << std::setw(12)
+			<< (dynamic_.hits == static_.hits ? "same" : "DIFFERENT") << "\n";
+
+	if (dynamic_.hits != static_.hits)
+		std::cerr << "Error! Hits of ARCache " << dynamic_.hits
+				<< ", of StaticARCache " << static_.hits << "\n";
+}
+
+}
+
+int main() {
+	std::cout << std::setw(8) << "c" << std::setw(12) << "ARC Mops/s"
+			<< std::setw(12) << "static" << std::setw(10) << "speedup"
+			<< std::setw(10) << "allocs" << std::setw(10) << "static"
+			<< std::setw(12) << "hits" << "\n";
+
+	compare<16>();
+	compare<64>();
+	compare<256>();
+	compare<1024>();
+
+	return 0;
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "flatHashMap.h"
+
+//! The next usage that is not known (no more accesses or beyond the lookahead)
+const uint64_t unknown_usage = std::numeric_limits<uint64_t>::max();
+
+//! @brief Belady's replacement for an access stream that is replayed once: the
+//! caller gives the position of the next usage of every access. Unlike
+//! beladyCache it keeps only the keys (no elements and no access order), so the
+//! memory is O(cache size) whatever the length of the stream.
+//!
+//! Cached keys are in a max-heap by the next usage. Keys whose next usage is
+//! unknown are the farthest ones, they are evicted in the LRU order among
+//! themselves; their next usage can be told later with 'reschedule'
+template<class KeyT = int>
+class beladySimulator {
+	struct Slot {
+		KeyT key;
+		uint64_t next_usage;
+		//! The position of the last access of the key
+		uint64_t last_usage;
+	};
+
+	std::vector<Slot> data;
+
+	//! Max-heap of slots by their next usage
+	std::vector<int> heap;
+	//! Position of each slot in the heap
+	std::vector<int> heap_pos;
+
+	flatHashMap<KeyT, int> hash_data;
+
+	size_t cache_size;
+	size_t hits;
+
+	//! True if the slot 'i' is evicted before the slot 'j'
+	bool farther(int i, int j) const;
+	void swapHeap(int i, int j);
+	void siftUp(int i);
+	void siftDown(int i);
+	void fix(int i);
+public:
+	beladySimulator(size_t c_size);
+
+	//! Replay the access of the key at the given position
+	//! @return true on a hit
+	bool access(const KeyT &key, uint64_t position, uint64_t next_usage);
+	//! The next usage of the key became known, it matters only if the key
+	//! is cached with the unknown one
+	void reschedule(const KeyT &key, uint64_t next_usage);
+
+	size_t hitsCount() const;
+	size_t size() const;
+};
+
+//! @brief Lookahead over the last 'window' accesses of a stream. The accesses
+//! are pushed as they are read and taken 'window' accesses later, by then the
+//! next usage of an access is known if it is in the window. The last position
+//! of every key in the window is kept, so pushing an access finds the previous
+//! one of the same key in O(1). Memory is O(window)
+template<class KeyT = int>
+class lookaheadWindow {
+	struct Access {
+		KeyT key;
+		uint64_t next_usage;
+	};
+
+	//! Accesses from the oldest one not taken yet, by their positions modulo the size
+	std::vector<Access> ring;
+	flatHashMap<KeyT, uint64_t> last_position;
+
+	uint64_t pushed;
+	uint64_t taken;
+public:
+	lookaheadWindow(size_t window);
+
+	//! Push the next access of the stream
+	//! @return true if the key has no access in the window before this one,
+	//! so the next usage of the key became known just now
+	bool push(const KeyT &key);
+	//! Take the oldest access and its next usage (unknown_usage if it is
+	//! beyond the window)
+	//! @return the position of the access
+	uint64_t take(KeyT &key, uint64_t &next_usage);
+
+	//! The amount of accesses pushed and not taken yet
+	size_t size() const;
+	//! True if the window is full, so the oldest access has to be taken
+	bool full() const;
+};
+
+template<class KeyT>
+inline beladySimulator<KeyT>::beladySimulator(size_t c_size) :
+		cache_size(c_size), hits(0) {
+	data.reserve(cache_size);
+	heap.reserve(cache_size);
+	heap_pos.reserve(cache_size);
+	hash_data.reserve(cache_size);
+}
+
+template<class KeyT>
+inline bool beladySimulator<KeyT>::farther(int i, int j) const {
+	if (data[i].next_usage != data[j].next_usage)
+		return data[i].next_usage > data[j].next_usage;
+
+	return data[i].last_usage < data[j].last_usage;
+}
+
+template<class KeyT>
+inline void beladySimulator<KeyT>::swapHeap(int i, int j) {
+	std::swap(heap[i], heap[j]);
+
+	heap_pos[heap[i]] = i;
+	heap_pos[heap[j]] = j;
+}
+
+template<class KeyT>
+inline void beladySimulator<KeyT>::siftUp(int i) {
+	while (i > 0) {
+		int parent_ = (i - 1) / 2;
+
+		if (!farther(heap[i], heap[parent_]))
+			break;
+
+		swapHeap(i, parent_);
+		i = parent_;
+	}
+}
+
+template<class KeyT>
+inline void beladySimulator<KeyT>::siftDown(int i) {
+	int size_ = heap.size();
+
+	while (true) {
+		int largest_ = i;
+		int left_ = 2 * i + 1;
+		int right_ = 2 * i + 2;
+
+		if (left_ < size_ && farther(heap[left_], heap[largest_]))
+			largest_ = left_;
+		if (right_ < size_ && farther(heap[right_], heap[largest_]))
+			largest_ = right_;
+
+		if (largest_ == i)
+			break;
+
+		swapHeap(i, largest_);
+		i = largest_;
+	}
+}
+
+template<class KeyT>
+inline void beladySimulator<KeyT>::fix(int i) {
+	int slot_ = heap[i];
+
+	siftUp(i);
+	siftDown(heap_pos[slot_]);
+}
+
+template<class KeyT>
+inline bool beladySimulator<KeyT>::access(const KeyT &key, uint64_t position,
+		uint64_t next_usage) {
+	if (cache_size == 0)
+		return false;
+
+	auto hit = hash_data.find(key);
+
+	if (hit != hash_data.end()) {
+		int slot_ = hit->second;
+
+		data[slot_].next_usage = next_usage;
+		data[slot_].last_usage = position;
+		fix(heap_pos[slot_]);
+
+		hits++;
+
+		return true;
+	}
+
+	if (data.size() < cache_size) {
+		int slot_ = data.size();
+
+		data.push_back(Slot { key, next_usage, position });
+		heap.push_back(slot_);
+		heap_pos.push_back(slot_);
+		hash_data[key] = slot_;
+
+		siftUp(slot_);
+
+		return false;
+	}
+
+	// The key that won't be used for the longest time
+	int father_slot = heap[0];
+
+	hash_data.erase(data[father_slot].key);
+
+	data[father_slot] = Slot { key, next_usage, position };
+	hash_data[key] = father_slot;
+
+	siftDown(0);
+
+	return false;
+}
+
+template<class KeyT>
+inline void beladySimulator<KeyT>::reschedule(const KeyT &key,
+		uint64_t next_usage) {
+	auto cached = hash_data.find(key);
+
+	if (cached == hash_data.end()
+			|| data[cached->second].next_usage != unknown_usage)
+		return;
+
+	// The next usage only gets nearer
+	data[cached->second].next_usage = next_usage;
+	siftDown(heap_pos[cached->second]);
+}
+
+template<class KeyT>
+inline size_t beladySimulator<KeyT>::hitsCount() const {
+	return hits;
+}
+
+template<class KeyT>
+inline size_t beladySimulator<KeyT>::size() const {
+	return data.size();
+}
+
+template<class KeyT>
+inline lookaheadWindow<KeyT>::lookaheadWindow(size_t window) :
+		ring(window + 1), pushed(0), taken(0) {
+	last_position.reserve(window + 1);
+}
+
+template<class KeyT>
+inline bool lookaheadWindow<KeyT>::push(const KeyT &key) {
+	uint64_t position_ = pushed++;
+	ring[position_ % ring.size()] = Access { key, unknown_usage };
+
+	auto last_ = last_position.emplace(key, position_);
+
+	if (last_.second)
+		return true;
+
+	ring[last_.first->second % ring.size()].next_usage = position_;
+	last_.first->second = position_;
+
+	return false;
+}
+
+template<class KeyT>
+inline uint64_t lookaheadWindow<KeyT>::take(KeyT &key, uint64_t &next_usage) {
+	uint64_t position_ = taken++;
+	const Access &access_ = ring[position_ % ring.size()];
+
+	key = access_.key;
+	next_usage = access_.next_usage;
+
+	// The last access of the key leaves the window
+	if (next_usage == unknown_usage)
+		last_position.erase(key);
+
+	return position_;
+}
+
+template<class KeyT>
+inline size_t lookaheadWindow<KeyT>::size() const {
+	return pushed - taken;
+}
+
+template<class KeyT>
+inline bool lookaheadWindow<KeyT>::full() const {
+	return size() == ring.size();
+}
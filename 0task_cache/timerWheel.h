@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "intrusiveList.h"
+
+//! @brief Hierarchical timing wheel (as in the Linux kernel timers). Level 'l'
+//! has 64 slots of 64^l ticks each, a node is put into the lowest level whose
+//! range covers its expiry time. When the lowest level wraps around, the next
+//! slot of the upper level is cascaded - its nodes are spread into the lower
+//! levels. Scheduling and cancelling are O(1), a tick costs O(1) amortized:
+//! every node is cascaded at most once per level. Nodes farther than the top
+//! level covers wait in its last slot and are cascaded again.
+//!
+//! The wheel doesn't own the nodes, its buckets are intrusive lists
+//! @param Node - has the links 'timer_prev' and 'timer_next', the expiry time
+//! 'expires' and the bucket 'timer_bucket' (maintained by the wheel)
+template<class Node>
+class timerWheel {
+	static constexpr unsigned slot_bits = 6;
+	static constexpr size_t slots_count = size_t(1) << slot_bits;
+	static constexpr size_t slot_mask = slots_count - 1;
+	static constexpr size_t levels_count = 4;
+
+	using bucketList = intrusiveList<Node, &Node::timer_prev, &Node::timer_next>;
+
+	bucketList buckets[levels_count * slots_count];
+
+	//! The next tick to process
+	uint64_t current;
+	size_t count;
+
+	//! Put the node into the bucket of its expiry time
+	void place(Node *node);
+	//! Spread the nodes of the slot over the lower levels
+	void cascade(size_t level);
+public:
+	//! The bucket of the node that is not scheduled
+	static constexpr uint32_t unscheduled = std::numeric_limits<uint32_t>::max();
+
+	timerWheel();
+
+	timerWheel(const timerWheel &rhs) = delete;
+	timerWheel& operator=(const timerWheel &rhs) = delete;
+
+	//! The last tick processed
+	uint64_t now() const;
+	size_t size() const;
+
+	//! Expire the node at the given tick (the past ones expire on the next advance)
+	void schedule(Node *node, uint64_t expires);
+	//! Remove the scheduled node from the wheel
+	void cancel(Node *node);
+
+	//! @brief Process all ticks up to 'now' calling 'expire(node)' for every node
+	//! that expires. The node is already removed from the wheel then
+	template<class Expire>
+	void advance(uint64_t now, Expire expire);
+};
+
+template<class Node>
+inline timerWheel<Node>::timerWheel() :
+		current(1), count(0) {
+}
+
+template<class Node>
+inline uint64_t timerWheel<Node>::now() const {
+	return current - 1;
+}
+
+template<class Node>
+inline size_t timerWheel<Node>::size() const {
+	return count;
+}
+
+template<class Node>
+inline void timerWheel<Node>::place(Node *node) {
+	uint64_t expires_ = std::max(node->expires, current);
+	uint64_t delta_ = expires_ - current;
+	size_t level_ = 0;
+
+	while (level_ + 1 < levels_count
+			&& delta_ >= (uint64_t(1) << (slot_bits * (level_ + 1))))
+		level_++;
+
+	// Too far for the top level - wait in its farthest slot
+	if (delta_ >= (uint64_t(1) << (slot_bits * levels_count)))
+		expires_ = current + (uint64_t(1) << (slot_bits * levels_count)) - 1;
+
+	size_t slot_ = (expires_ >> (slot_bits * level_)) & slot_mask;
+
+	node->timer_bucket = level_ * slots_count + slot_;
+	buckets[node->timer_bucket].push_back(node);
+}
+
+template<class Node>
+inline void timerWheel<Node>::cascade(size_t level) {
+	bucketList &bucket_ = buckets[level * slots_count
+			+ ((current >> (slot_bits * level)) & slot_mask)];
+
+	while (!bucket_.empty()) {
+		Node *node = bucket_.front();
+
+		bucket_.remove(node);
+		place(node);
+	}
+}
+
+template<class Node>
+inline void timerWheel<Node>::schedule(Node *node, uint64_t expires) {
+	assert(node && node->timer_bucket == unscheduled);
+
+	node->expires = expires;
+	place(node);
+	count++;
+}
+
+template<class Node>
+inline void timerWheel<Node>::cancel(Node *node) {
+	assert(node && node->timer_bucket != unscheduled);
+
+	buckets[node->timer_bucket].remove(node);
+	node->timer_bucket = unscheduled;
+	count--;
+}
+
+template<class Node>
+template<class Expire>
+inline void timerWheel<Node>::advance(uint64_t now, Expire expire) {
+	for (; current <= now; current++) {
+		// Nothing to wait for - jump to the end
+		if (count == 0) {
+			current = now + 1;
+			break;
+		}
+
+		// The lower level wrapped around - take the next slots of the upper ones
+		for (size_t level = 1; level < levels_count; level++) {
+			if (((current >> (slot_bits * (level - 1))) & slot_mask) != 0)
+				break;
+
+			cascade(level);
+		}
+
+		bucketList &bucket_ = buckets[current & slot_mask];
+
+		while (!bucket_.empty()) {
+			Node *node = bucket_.front();
+
+			bucket_.remove(node);
+			node->timer_bucket = unscheduled;
+			count--;
+
+			expire(node);
+		}
+	}
+}
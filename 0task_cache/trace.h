@@ -0,0 +1,532 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//! @brief Header of the binary trace. It is followed by 'count' keys,
+//! each one is a little-endian integer of 'key_width' bytes. The header
+//! is 24 bytes, so the keys are aligned in a mapped file
+struct traceHeader {
+	//! "CTRC"
+	char magic[4];
+	//! 4 or 8 bytes
+	uint32_t key_width;
+	//! The cache size written in the trace
+	uint64_t cache_size;
+	//! The amount of keys
+	uint64_t count;
+};
+
+static_assert(sizeof(traceHeader) == 24, "The header must be packed");
+
+//! @brief The sequence of keys accessed in the cache. It is read either from
+//! the text format ('input_test' format: the cache size, the amount of accesses
+//! and then all the keys) or from the binary one. The binary trace is mapped
+//! into memory and its keys are used in place without copying (if their width
+//! is the width of KeyT)
+template<class KeyT = int>
+class trace {
+	std::vector<KeyT> storage;
+
+	//! The mapped binary trace
+	void *mapping;
+	size_t mapping_size;
+
+	void unmap();
+public:
+	//! The keys in the order of accesses
+	const KeyT *keys;
+	size_t size;
+
+	//! The cache size written in the trace
+	size_t cache_size;
+
+	trace();
+	~trace();
+
+	trace(const trace &rhs) = delete;
+	trace& operator=(const trace &rhs) = delete;
+
+	//! Read the trace in the text format, false on a broken input
+	bool readText(std::istream &input);
+	//! Map the trace in the binary format, false on a broken file
+	bool mapBinary(const char *path);
+	//! Open the trace in any format (the binary one is recognized by its header)
+	bool open(const char *path);
+
+	//! Write the trace in the binary format
+	//! @param key_width - the width of keys in the file (4 or 8 bytes)
+	bool writeBinary(std::ostream &output, uint32_t key_width) const;
+
+	//! The width in bytes enough for all keys of the trace (4 or 8)
+	uint32_t minKeyWidth() const;
+};
+
+//! @brief Reads the trace by chunks, so traces bigger than the memory can be
+//! replayed. Both formats are read forward, the binary one can also be read
+//! from any access (for example backward by chunks)
+template<class KeyT = int>
+class traceReader {
+	std::ifstream input;
+
+	bool binary;
+	uint32_t key_width;
+	//! The access read next
+	size_t position;
+
+	//! The raw bytes of the chunk of the binary trace
+	std::vector<uint8_t> bytes;
+public:
+	//! The amount of accesses
+	size_t size;
+	//! The cache size written in the trace
+	size_t cache_size;
+
+	traceReader();
+
+	//! Open the trace in any format, false on a broken file
+	bool open(const char *path);
+	//! Read at most 'count' next keys. A text trace ends before its first
+	//! broken key (the keys before it are returned, 'size' becomes their amount)
+	//! @return the amount of keys read, 0 at the end or on a broken trace
+	size_t read(KeyT *keys, size_t count);
+	//! Continue reading from the given access, false if the trace is not binary
+	bool seek(size_t access);
+
+	bool isBinary() const;
+};
+
+//! @brief Writes the binary trace by chunks, so a trace bigger than the memory
+//! can be converted. The header is written first with no keys, the amount of
+//! keys written is put into it when the writer is closed
+template<class KeyT = int>
+class traceWriter {
+	std::ofstream output;
+
+	uint32_t key_width;
+
+	//! The raw bytes of the written block
+	std::vector<uint8_t> bytes;
+public:
+	//! The amount of keys written
+	size_t size;
+
+	traceWriter();
+
+	//! Create the trace, false if it can't be written
+	//! @param key_width - the width of keys in the file (4 or 8 bytes)
+	bool open(const char *path, uint32_t key_width, size_t cache_size);
+	//! Append the keys, false if a key doesn't fit the width or on a write error
+	bool write(const KeyT *keys, size_t count);
+	//! Write the amount of keys into the header and close the file
+	bool close();
+};
+
+namespace detail {
+	const char trace_magic[4] = { 'C', 'T', 'R', 'C' };
+
+	inline bool isLittleEndian() {
+		const uint16_t probe = 1;
+		return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+	}
+
+	//! Read the little-endian integer of 'width' bytes
+	inline int64_t readLE(const uint8_t *bytes, uint32_t width) {
+		uint64_t value = 0;
+
+		for (uint32_t i = 0; i < width; i++)
+			value |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+
+		// Sign extension of 4-byte keys
+		if (width == 4)
+			return static_cast<int32_t>(value);
+
+		return static_cast<int64_t>(value);
+	}
+
+	//! Write the integer as little-endian of 'width' bytes
+	inline void writeLE(uint8_t *bytes, int64_t value, uint32_t width) {
+		for (uint32_t i = 0; i < width; i++)
+			bytes[i] = static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i));
+	}
+
+	//! The width in bytes enough for the key (4 or 8)
+	inline uint32_t keyWidth(int64_t key) {
+		if (key < std::numeric_limits<int32_t>::min()
+				|| key > std::numeric_limits<int32_t>::max())
+			return 8;
+
+		return 4;
+	}
+
+	//! Fill the header of the binary trace
+	inline void writeHeader(uint8_t *header, uint32_t key_width,
+			uint64_t cache_size, uint64_t count) {
+		std::memcpy(header, trace_magic, 4);
+		writeLE(header + 4, key_width, 4);
+		writeLE(header + 8, cache_size, 8);
+		writeLE(header + 16, count, 8);
+	}
+}
+
+//! @brief The width of keys in the binary trace, 0 if the file is not a binary trace
+inline uint32_t traceKeyWidth(const char *path) {
+	std::ifstream input_(path, std::ios::binary);
+	uint8_t header_[8] = { };
+
+	if (!input_ || !input_.read(reinterpret_cast<char*>(header_), 8)
+			|| std::memcmp(header_, detail::trace_magic, 4))
+		return 0;
+
+	return detail::readLE(header_ + 4, 4);
+}
+
+template<class KeyT>
+inline trace<KeyT>::trace() :
+		mapping(nullptr), mapping_size(0), keys(nullptr), size(0), cache_size(
+				0) {
+}
+
+template<class KeyT>
+inline trace<KeyT>::~trace() {
+	unmap();
+}
+
+template<class KeyT>
+inline void trace<KeyT>::unmap() {
+	if (mapping != nullptr)
+		munmap(mapping, mapping_size);
+
+	mapping = nullptr;
+	mapping_size = 0;
+}
+
+template<class KeyT>
+inline bool trace<KeyT>::readText(std::istream &input) {
+	size_t memory_size_ = 0;
+
+	if (!(input >> cache_size >> memory_size_))
+		return false;
+
+	// The count is not trusted for the allocation, the keys must be there
+	const size_t max_reserve = 1 << 20;
+
+	storage.clear();
+	storage.reserve(std::min(memory_size_, max_reserve));
+
+	for (size_t i = 0; i < memory_size_; i++) {
+		KeyT key_;
+
+		if (!(input >> key_))
+			return false;
+
+		storage.push_back(key_);
+	}
+
+	unmap();
+
+	keys = storage.data();
+	size = storage.size();
+
+	return true;
+}
+
+template<class KeyT>
+inline bool trace<KeyT>::mapBinary(const char *path) {
+	static_assert(std::is_integral<KeyT>::value, "Binary traces keep integer keys");
+
+	int fd_ = ::open(path, O_RDONLY);
+	if (fd_ < 0)
+		return false;
+
+	struct stat stat_;
+	if (fstat(fd_, &stat_) < 0 || (size_t) stat_.st_size < sizeof(traceHeader)) {
+		close(fd_);
+		return false;
+	}
+
+	size_t file_size_ = stat_.st_size;
+	void *file_ = mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+	close(fd_);
+
+	if (file_ == MAP_FAILED)
+		return false;
+
+	// The keys are read once from the beginning to the end
+	madvise(file_, file_size_, MADV_SEQUENTIAL);
+
+	const uint8_t *bytes_ = static_cast<const uint8_t*>(file_);
+	traceHeader header_;
+
+	header_.key_width = detail::readLE(bytes_ + 4, 4);
+	header_.cache_size = detail::readLE(bytes_ + 8, 8);
+	header_.count = detail::readLE(bytes_ + 16, 8);
+
+	if (std::memcmp(bytes_, detail::trace_magic, 4)
+			|| (header_.key_width != 4 && header_.key_width != 8)
+			|| header_.count
+					> (file_size_ - sizeof(traceHeader)) / header_.key_width) {
+		munmap(file_, file_size_);
+		return false;
+	}
+
+	unmap();
+	storage.clear();
+
+	cache_size = header_.cache_size;
+	size = header_.count;
+
+	const uint8_t *data_ = bytes_ + sizeof(traceHeader);
+
+	if (header_.key_width == sizeof(KeyT) && detail::isLittleEndian()) {
+		// Use the keys in place
+		mapping = file_;
+		mapping_size = file_size_;
+
+		keys = reinterpret_cast<const KeyT*>(data_);
+
+		return true;
+	}
+
+	// Different width or byte order - the keys have to be converted
+	storage.resize(size);
+
+	for (size_t i = 0; i < size; i++) {
+		int64_t key_ = detail::readLE(data_ + i * header_.key_width,
+				header_.key_width);
+
+		if (key_ < (int64_t) std::numeric_limits<KeyT>::min()
+				|| key_ > (int64_t) std::numeric_limits<KeyT>::max()) {
+			std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+			std::cerr << "The key " << key_ << " doesn't fit the key type\n";
+
+			munmap(file_, file_size_);
+			return false;
+		}
+
+		storage[i] = static_cast<KeyT>(key_);
+	}
+
+	munmap(file_, file_size_);
+	keys = storage.data();
+
+	return true;
+}
+
+template<class KeyT>
+inline bool trace<KeyT>::open(const char *path) {
+	std::ifstream input_(path, std::ios::binary);
+	char magic_[4] = { };
+
+	if (!input_ || !input_.read(magic_, 4))
+		return false;
+
+	if (!std::memcmp(magic_, detail::trace_magic, 4)) {
+		input_.close();
+		return mapBinary(path);
+	}
+
+	input_.seekg(0);
+
+	return readText(input_);
+}
+
+template<class KeyT>
+inline bool trace<KeyT>::writeBinary(std::ostream &output,
+		uint32_t key_width) const {
+	if (key_width != 4 && key_width != 8)
+		return false;
+
+	uint8_t header_[sizeof(traceHeader)];
+	detail::writeHeader(header_, key_width, cache_size, size);
+
+	output.write(reinterpret_cast<const char*>(header_), sizeof(header_));
+
+	// Write by blocks not to call the stream for each key
+	const size_t block_size = 1 << 16;
+	std::vector<uint8_t> block_(block_size * key_width);
+
+	for (size_t i = 0; i < size; i += block_size) {
+		size_t count_ = std::min(block_size, size - i);
+
+		for (size_t j = 0; j < count_; j++)
+			detail::writeLE(&block_[j * key_width], keys[i + j], key_width);
+
+		output.write(reinterpret_cast<const char*>(block_.data()),
+				count_ * key_width);
+	}
+
+	return bool(output);
+}
+
+template<class KeyT>
+inline uint32_t trace<KeyT>::minKeyWidth() const {
+	for (size_t i = 0; i < size; i++) {
+		if (detail::keyWidth(keys[i]) == 8)
+			return 8;
+	}
+
+	return 4;
+}
+
+template<class KeyT>
+inline traceReader<KeyT>::traceReader() :
+		binary(false), key_width(0), position(0), size(0), cache_size(0) {
+}
+
+template<class KeyT>
+inline bool traceReader<KeyT>::open(const char *path) {
+	input.open(path, std::ios::binary);
+	uint8_t header_[sizeof(traceHeader)] = { };
+
+	if (!input || !input.read(reinterpret_cast<char*>(header_), 4))
+		return false;
+
+	position = 0;
+	binary = !std::memcmp(header_, detail::trace_magic, 4);
+
+	if (!binary) {
+		input.seekg(0);
+		return bool(input >> cache_size >> size);
+	}
+
+	if (!input.read(reinterpret_cast<char*>(header_ + 4),
+			sizeof(traceHeader) - 4))
+		return false;
+
+	key_width = detail::readLE(header_ + 4, 4);
+	cache_size = detail::readLE(header_ + 8, 8);
+	size = detail::readLE(header_ + 16, 8);
+
+	return key_width == 4 || key_width == 8;
+}
+
+template<class KeyT>
+inline size_t traceReader<KeyT>::read(KeyT *keys, size_t count) {
+	count = std::min(count, size - position);
+
+	if (!binary) {
+		for (size_t i = 0; i < count; i++) {
+			// The keys before the broken one are returned
+			if (!(input >> keys[i])) {
+				size = position + i;
+				count = i;
+				break;
+			}
+		}
+
+		position += count;
+
+		return count;
+	}
+
+	bytes.resize(count * key_width);
+
+	if (!input.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+		return 0;
+
+	for (size_t i = 0; i < count; i++) {
+		int64_t key_ = detail::readLE(&bytes[i * key_width], key_width);
+
+		if (key_ < (int64_t) std::numeric_limits<KeyT>::min()
+				|| key_ > (int64_t) std::numeric_limits<KeyT>::max()) {
+			std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+			std::cerr << "The key " << key_ << " doesn't fit the key type\n";
+
+			return 0;
+		}
+
+		keys[i] = static_cast<KeyT>(key_);
+	}
+
+	position += count;
+
+	return count;
+}
+
+template<class KeyT>
+inline bool traceReader<KeyT>::seek(size_t access) {
+	if (!binary || access > size)
+		return false;
+
+	input.clear();
+	input.seekg(sizeof(traceHeader) + access * key_width);
+	position = access;
+
+	return bool(input);
+}
+
+template<class KeyT>
+inline bool traceReader<KeyT>::isBinary() const {
+	return binary;
+}
+
+template<class KeyT>
+inline traceWriter<KeyT>::traceWriter() :
+		key_width(0), size(0) {
+}
+
+template<class KeyT>
+inline bool traceWriter<KeyT>::open(const char *path, uint32_t key_width,
+		size_t cache_size) {
+	if (key_width != 4 && key_width != 8)
+		return false;
+
+	this->key_width = key_width;
+	size = 0;
+
+	output.open(path, std::ios::binary);
+
+	uint8_t header_[sizeof(traceHeader)];
+	detail::writeHeader(header_, key_width, cache_size, 0);
+
+	output.write(reinterpret_cast<const char*>(header_), sizeof(header_));
+
+	return bool(output);
+}
+
+template<class KeyT>
+inline bool traceWriter<KeyT>::write(const KeyT *keys, size_t count) {
+	bytes.resize(count * key_width);
+
+	for (size_t i = 0; i < count; i++) {
+		if (detail::keyWidth(keys[i]) > key_width) {
+			std::cerr << "Error! " << __PRETTY_FUNCTION__ << "\n";
+			std::cerr << "The key " << keys[i] << " doesn't fit into "
+					<< key_width << " bytes\n";
+
+			return false;
+		}
+
+		detail::writeLE(&bytes[i * key_width], keys[i], key_width);
+	}
+
+	output.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	size += count;
+
+	return bool(output);
+}
+
+template<class KeyT>
+inline bool traceWriter<KeyT>::close() {
+	uint8_t count_[8];
+	detail::writeLE(count_, size, 8);
+
+	output.seekp(offsetof(traceHeader, count));
+	output.write(reinterpret_cast<const char*>(count_), sizeof(count_));
+	output.close();
+
+	return !output.fail();
+}
@@ -0,0 +1,113 @@
+// Converts the text trace ('input_test' format) into the binary one. The trace
+// is converted by chunks, so it doesn't have to fit into the memory; the amount
+// of accesses in the binary header is the amount of keys really converted
+//
+// Usage: traceConvert <text trace> <binary trace> [key_width]
+// Without the key width the smallest one (4 or 8 bytes) that fits all keys is
+// used, it is found by one more pass over the text trace. The binary trace is
+// removed if it can't be written whole (a key doesn't fit the given width)
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+namespace {
+
+//! Keys converted at once
+const size_t chunk = 1 << 16;
+
+//! The width enough for all keys of the text trace, 0 if it can't be read
+uint32_t scanKeyWidth(const char *path) {
+	traceReader<long long> reader_;
+
+	if (!reader_.open(path) || reader_.isBinary())
+		return 0;
+
+	std::vector<long long> keys_(chunk);
+	uint32_t key_width_ = 4;
+
+	for (size_t count_; (count_ = reader_.read(keys_.data(), keys_.size())) != 0;) {
+		for (size_t i = 0; i < count_; i++)
+			key_width_ = std::max(key_width_, detail::keyWidth(keys_[i]));
+	}
+
+	return key_width_;
+}
+
+//! Close and remove the binary trace that can't be written whole
+int removeOutput(traceWriter<long long> &writer, const char *path) {
+	std::cerr << "Error! Can't write the trace " << path << "\n";
+
+	writer.close();
+	std::remove(path);
+
+	return -1;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0]
+				<< " <text trace> <binary trace> [key_width]\n";
+		return -1;
+	}
+
+	traceReader<long long> reader;
+
+	if (!reader.open(argv[1]) || reader.isBinary()) {
+		std::cerr << "Error! Can't read the trace " << argv[1] << "\n";
+		return -1;
+	}
+
+	// The header is the amount of keys the trace claims to have
+	size_t claimed_size = reader.size;
+	uint32_t key_width = 0;
+
+	if (argc > 3) {
+		std::string width_ = argv[3];
+
+		if (width_ != "4" && width_ != "8") {
+			std::cerr << "Error! The key width must be 4 or 8 bytes, not "
+					<< width_ << "\n";
+			return -1;
+		}
+
+		key_width = std::stoul(width_);
+	} else if ((key_width = scanKeyWidth(argv[1])) == 0) {
+		std::cerr << "Error! Can't read the trace " << argv[1] << "\n";
+		return -1;
+	}
+
+	traceWriter<long long> writer;
+
+	if (!writer.open(argv[2], key_width, reader.cache_size))
+		return removeOutput(writer, argv[2]);
+
+	std::vector<long long> keys(chunk);
+
+	for (size_t count; (count = reader.read(keys.data(), keys.size())) != 0;) {
+		if (!writer.write(keys.data(), count))
+			return removeOutput(writer, argv[2]);
+	}
+
+	if (!writer.close()) {
+		std::cerr << "Error! Can't write the trace " << argv[2] << "\n";
+		std::remove(argv[2]);
+		return -1;
+	}
+
+	if (writer.size != claimed_size)
+		std::cerr << "The trace has " << writer.size << " of " << claimed_size
+				<< " accesses written in its header\n";
+
+	std::cout << "Converted " << writer.size << " accesses, key width "
+			<< key_width << " bytes\n";
+
+	return 0;
+}
@@ -1,11 +1,20 @@
 #include "unitTests.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <iomanip>
+#include <vector>
 
 #include "ARCache.h"
+#include "LRUCache.h"
+#include "backingStore.h"
+#include "cachePolicy.h"
 #include "cacheData.h"
+#include "evictionQueue.h"
 #include "Memory.h"
+#include "WTinyLFUCache.h"
+#include "workloadGen.h"
 
 void unit_test_1(int cache_size, int memory_size, int access_times) {
 	// For output
@@ -119,3 +128,407 @@ void unit_test_3(int cache_size, int memory_size, int access_times) {
 			<< ", total amount of requests - " << access_times << " ("
 			<< std::setprecision(3) << percent << "%)" << "\n";
 }
+
+void unit_test_4(int cache_size, int memory_size, int access_times) {
+	// For output
+	int hit_count = 0;
+	int load_count = 0;
+	int wrong_count = 0;
+	float percent = 0;
+
+	ARCache<cacheData<int>> arc_cache(cache_size);
+	Memory<cacheData<int>> memory(memory_size);
+
+	// Fill the memory randomly
+	memory.fill_rand();
+
+	for (int i = 0; i < access_times; i++) {
+		int index = std::rand() % memory_size;
+		int loads_before = load_count;
+
+		const cacheData<int> &elem = arc_cache.get_or_load(
+				memory.data[index].id, [&](int) {
+					load_count++;
+					return memory.data[index];
+				});
+
+		if (load_count == loads_before)
+			hit_count++;
+		if (elem.id != memory.data[index].id
+				|| elem.data != memory.data[index].data)
+			wrong_count++;
+	}
+
+	percent = ((float) hit_count) * 100.f / access_times;
+	std::cout << "Unit Test 4 (Loader): hits - " << hit_count << ", loads - "
+			<< load_count << ", wrong elements - " << wrong_count
+			<< ", total amount of requests - " << access_times << " ("
+			<< std::setprecision(3) << percent << "%)" << "\n";
+}
+
+void unit_test_5(size_t cache_bytes, int memory_size, int access_times) {
+	// For output
+	int hit_count = 0;
+	int over_budget = 0;
+	size_t max_weight = 0;
+	float percent = 0;
+
+	// The size of an element depends only on its id
+	auto bytes = [](int id, const cacheData<int>&) -> size_t {
+		return 100 + (static_cast<size_t>(id) * 7919) % (1 << 20);
+	};
+
+	ARCache<cacheData<int>, int, decltype(bytes)> arc_cache(cache_bytes, bytes);
+	Memory<cacheData<int>> memory(memory_size);
+
+	// Fill the memory randomly
+	memory.fill_rand();
+
+	for (int i = 0; i < access_times; i++) {
+		int index = std::rand() % memory_size;
+
+		if (arc_cache.lookup(&memory.data[index]))
+			hit_count++;
+
+		max_weight = std::max(max_weight, arc_cache.weight());
+		if (arc_cache.weight() > cache_bytes)
+			over_budget++;
+	}
+
+	percent = ((float) hit_count) * 100.f / access_times;
+	std::cout << "Unit Test 5 (Weighted): hits - " << hit_count
+			<< ", max weight - " << max_weight << " of " << cache_bytes
+			<< " bytes, over budget - " << over_budget
+			<< ", total amount of requests - " << access_times << " ("
+			<< std::setprecision(3) << percent << "%)" << "\n";
+}
+
+void unit_test_6(int cache_size, int memory_size, int access_times, int ttl) {
+	// For output
+	int hit_count = 0;
+	int stale_hits = 0;
+	float percent = 0;
+
+	ARCache<cacheData<int>> arc_cache(cache_size);
+	Memory<cacheData<int>> memory(memory_size);
+	// The tick every element was loaded at
+	std::vector<int> loaded(memory_size, -1);
+
+	// Fill the memory randomly
+	memory.fill_rand();
+	arc_cache.setDefaultTTL(ttl);
+
+	for (int i = 0; i < access_times; i++) {
+		int index = std::rand() % memory_size;
+		bool hit = true;
+
+		arc_cache.advanceTime(i);
+		arc_cache.get_or_load(memory.data[index].id, [&](int) {
+			hit = false;
+			loaded[index] = i;
+
+			return memory.data[index];
+		});
+
+		if (hit) {
+			hit_count++;
+
+			if (i - loaded[index] >= ttl)
+				stale_hits++;
+		}
+	}
+
+	percent = ((float) hit_count) * 100.f / access_times;
+	std::cout << "Unit Test 6 (TTL): hits - " << hit_count << ", expired - "
+			<< arc_cache.snapshot().expirations << ", stale hits - "
+			<< stale_hits << ", total amount of requests - " << access_times
+			<< " (" << std::setprecision(3) << percent << "%)" << "\n";
+}
+
+void unit_test_7(int cache_size, int memory_size, int access_times) {
+	// For output
+	int hit_count = 0;
+	int restored_hit_count = 0;
+	float percent = 0;
+
+	const char *snapshot_name = "unit_test_7.snap";
+
+	// Snapshots keep elements as they are in memory, so they are plain ints
+	ARCache<int> arc_cache(cache_size);
+	ARCache<int> restored_cache(cache_size);
+	std::vector<int> keys(access_times);
+
+	for (int i = 0; i < access_times; i++)
+		keys[i] = std::rand() % memory_size;
+
+	auto access = [&](ARCache<int> &cache, int key) {
+		bool hit = true;
+
+		cache.get_or_load(key, [&](int key_) {
+			hit = false;
+
+			return key_;
+		});
+
+		return hit;
+	};
+
+	// Warm up the cache, then restart it from the snapshot
+	for (int i = 0; i < access_times / 2; i++)
+		access(arc_cache, keys[i]);
+
+	if (!arc_cache.save(snapshot_name)
+			|| !restored_cache.restore(snapshot_name)) {
+		std::cout << "Unit Test 7 (snapshot): can't save or restore the cache\n";
+		return;
+	}
+
+	std::remove(snapshot_name);
+
+	for (int i = access_times / 2; i < access_times; i++) {
+		if (access(arc_cache, keys[i]))
+			hit_count++;
+		if (access(restored_cache, keys[i]))
+			restored_hit_count++;
+	}
+
+	percent = ((float) restored_hit_count) * 100.f
+			/ (access_times - access_times / 2);
+	std::cout << "Unit Test 7 (snapshot): hits - " << restored_hit_count
+			<< ", hits without the restart - " << hit_count
+			<< ", total amount of requests - "
+			<< access_times - access_times / 2 << " (" << std::setprecision(3)
+			<< percent << "%)" << "\n";
+}
+
+void unit_test_8(int cache_size, uint64_t phase_accesses, uint64_t seed) {
+	// For output
+	size_t arc_hit_count = 0;
+	size_t car_hit_count = 0;
+	size_t mismatches = 0;
+	float percent = 0;
+
+	std::vector<workloadPhase> phases = {
+			workloadPhase(WORKLOAD_ZIPF, phase_accesses, 20 * cache_size),
+			workloadPhase(WORKLOAD_SCAN_HOTSET, phase_accesses, 100 * cache_size),
+			workloadPhase(WORKLOAD_LOOP, phase_accesses, 2 * cache_size),
+			workloadPhase(WORKLOAD_SHIFTING, phase_accesses, 4 * cache_size) };
+
+	ARCache<long long, long long> arc_cache(cache_size);
+	CARCache<beladyData<long long, long long>, long long> car_cache(cache_size);
+	workloadGenerator<long long> workload(phases, seed);
+	workloadGenerator<long long> replay(phases, seed);
+
+	std::vector<long long> keys(4096);
+	std::vector<long long> replay_keys(keys.size());
+	beladyData<long long, long long> elem;
+
+	for (size_t count; (count = workload.read(keys.data(), keys.size())) != 0;) {
+		replay.read(replay_keys.data(), count);
+
+		for (size_t i = 0; i < count; i++) {
+			if (keys[i] != replay_keys[i])
+				mismatches++;
+
+			elem.id = keys[i];
+			elem.data = keys[i];
+
+			if (accessKey(arc_cache, keys[i]))
+				arc_hit_count++;
+			if (car_cache.lookup(&elem))
+				car_hit_count++;
+		}
+	}
+
+	std::cout << "Unit Test 8 (workload, seed " << seed << "):\n";
+	percent = ((float) arc_hit_count) * 100.f / workload.size;
+	std::cout << "ARC: hits - " << arc_hit_count
+			<< ", total amount of requests - " << workload.size << " ("
+			<< std::setprecision(3) << percent << "%)" << "\n";
+	percent = ((float) car_hit_count) * 100.f / workload.size;
+	std::cout << "CAR: hits - " << car_hit_count
+			<< ", total amount of requests - " << workload.size << " ("
+			<< std::setprecision(3) << percent << "%)" << "\n";
+	std::cout << "Keys that differ with the same seed - " << mismatches << "\n";
+}
+
+void unit_test_9(int cache_size, int memory_size, int access_times) {
+	// For output
+	int stale_reads = 0;
+	int stale_memory = 0;
+	int lru_stale_reads = 0;
+	int lru_stale_memory = 0;
+	float percent = 0;
+
+	ARCache<cacheData<int>> arc_cache(cache_size);
+	LRUCache<cacheData<int>> lru_cache(cache_size);
+	Memory<cacheData<int>> memory(memory_size);
+	Memory<cacheData<int>> lru_memory(memory_size);
+	// The last written value of every element
+	std::vector<int> written(memory_size);
+
+	// Fill the memory randomly
+	memory.fill_rand();
+
+	for (int i = 0; i < memory_size; i++) {
+		written[i] = memory.data[i].data;
+		lru_memory.data[i] = memory.data[i];
+	}
+
+	backingStore<cacheData<int>> store(memory, backendModel());
+	backingStore<cacheData<int>> lru_store(lru_memory, backendModel());
+	storeFrontend<ARCache<cacheData<int>>, cacheData<int>> frontend(arc_cache,
+			store, WRITE_BACK);
+	// LRU writes back through the eviction hook of policyBase
+	storeFrontend<LRUCache<cacheData<int>>, cacheData<int>> lru_frontend(
+			lru_cache, lru_store, WRITE_BACK);
+	cacheData<int> elem;
+
+	for (int i = 0; i < access_times; i++) {
+		int index = std::rand() % memory_size;
+
+		elem.id = memory.data[index].id;
+
+		// Every 4th access is a write
+		if (std::rand() % 4 == 0) {
+			elem.data = std::rand();
+			written[index] = elem.data;
+
+			frontend.write(elem.id, elem);
+			lru_frontend.write(elem.id, elem);
+		} else {
+			frontend.read(elem.id, &elem);
+
+			if (elem.data != written[index])
+				stale_reads++;
+
+			lru_frontend.read(elem.id, &elem);
+
+			if (elem.data != written[index])
+				lru_stale_reads++;
+		}
+	}
+
+	frontend.finish();
+	lru_frontend.finish();
+
+	for (int i = 0; i < memory_size; i++) {
+		if (memory.data[i].data != written[i])
+			stale_memory++;
+		if (lru_memory.data[i].data != written[i])
+			lru_stale_memory++;
+	}
+
+	const backendStats &stats = store.getStats();
+
+	percent = ((float) stats.hits) * 100.f / access_times;
+	std::cout << "Unit Test 9 (write-back): hits - " << stats.hits
+			<< ", backend reads - " << stats.reads << ", writes - "
+			<< stats.writes << " in " << stats.write_requests
+			<< " requests, stale reads - " << stale_reads
+			<< ", stale elements in memory - " << stale_memory
+			<< ", total amount of requests - " << access_times << " ("
+			<< std::setprecision(3) << percent << "%)" << "\n";
+	std::cout << "LRU: backend writes - " << lru_store.getStats().writes
+			<< ", stale reads - " << lru_stale_reads
+			<< ", stale elements in memory - " << lru_stale_memory << "\n";
+
+	// Caches that keep no written element at all, so nothing is left to write
+	// back at 'finish'
+	ARCache<cacheData<int>> empty_cache(0);
+	WTinyLFUCache<cacheData<int>> tiny_cache(1);
+	Memory<cacheData<int>> empty_memory(4);
+	Memory<cacheData<int>> tiny_memory(4);
+
+	empty_memory.fill_rand();
+	tiny_memory.fill_rand();
+
+	backingStore<cacheData<int>> empty_store(empty_memory, backendModel());
+	backingStore<cacheData<int>> tiny_store(tiny_memory, backendModel());
+	storeFrontend<ARCache<cacheData<int>>, cacheData<int>> empty_frontend(
+			empty_cache, empty_store, WRITE_BACK);
+	storeFrontend<WTinyLFUCache<cacheData<int>>, cacheData<int>> tiny_frontend(
+			tiny_cache, tiny_store, WRITE_BACK);
+	int lost_writes = 0;
+
+	for (int i = 0; i < 4; i++) {
+		elem.id = empty_memory.data[i].id;
+		elem.data = i + 1;
+
+		empty_frontend.write(elem.id, elem);
+
+		elem.id = tiny_memory.data[i].id;
+
+		tiny_frontend.write(elem.id, elem);
+	}
+
+	empty_frontend.finish();
+	tiny_frontend.finish();
+
+	for (int i = 0; i < 4; i++) {
+		if (empty_memory.data[i].data != i + 1)
+			lost_writes++;
+		if (tiny_memory.data[i].data != i + 1)
+			lost_writes++;
+	}
+
+	std::cout << "Zero-size ARC and 1-element W-TinyLFU: lost writes - "
+			<< lost_writes << "\n";
+}
+
+void unit_test_10(int cache_size, int memory_size, int access_times, int ttl) {
+	// For output
+	int hit_count = 0;
+	float percent = 0;
+
+	// Written by the background thread only, read after 'flush'
+	size_t reasons[3] = { 0, 0, 0 };
+	size_t wrong_elements = 0;
+	size_t batches = 0;
+
+	ARCache<cacheData<int>> arc_cache(cache_size);
+	Memory<cacheData<int>> memory(memory_size);
+	evictionQueue<cacheData<int>> queue(256,
+			[&](evictionRecord<cacheData<int>> *records, size_t count) {
+				batches++;
+
+				for (size_t i = 0; i < count; i++) {
+					reasons[records[i].reason]++;
+
+					if (records[i].elem.id != records[i].key)
+						wrong_elements++;
+				}
+			});
+
+	// Fill the memory randomly
+	memory.fill_rand();
+	arc_cache.setDefaultTTL(ttl);
+	arc_cache.setEvictionListener(queue.listener());
+
+	for (int i = 0; i < access_times; i++) {
+		// The scan first: T1 takes the whole cache and evicts without ghosts
+		int index = (i < memory_size) ? i : std::rand() % memory_size;
+
+		arc_cache.advanceTime(i);
+
+		if (arc_cache.lookup(&memory.data[index]))
+			hit_count++;
+	}
+
+	queue.flush();
+
+	arcSnapshot snapshot = arc_cache.snapshot();
+
+	percent = ((float) hit_count) * 100.f / access_times;
+	std::cout << "Unit Test 10 (eviction listener): hits - " << hit_count
+			<< ", total amount of requests - " << access_times << " ("
+			<< std::setprecision(3) << percent << "%)" << "\n";
+
+	for (evictionReason reason : { EVICT_CAPACITY, EVICT_GHOST_TRIM, EVICT_TTL })
+		std::cout << reasonName(reason) << " - " << reasons[reason] << ", ";
+
+	std::cout << "ARC evictions - " << snapshot.evictions << ", expirations - "
+			<< snapshot.expirations << ", batches - " << batches
+			<< ", ring stalls - " << queue.stalls() << ", wrong elements - "
+			<< wrong_elements << "\n";
+}
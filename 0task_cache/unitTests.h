@@ -1,10 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <iomanip>
 #include <iostream>
 
 #include "ARCache.h"
 #include "beladyCache.h"
+#include "CARCache.h"
 
 #include "cacheData.h"
 #include "Memory.h"
@@ -32,12 +34,68 @@ void unit_test_2(int cache_size, int memory_size, int range, int median_changes,
 //! @param access_times The amount of memory accesses
 void unit_test_3(int cache_size, int memory_size, int access_times);
 
+//! @brief Test with read-through loading: the loader must be called once per miss
+//! @brief and the returned elements must be the ones from the memory
+//!	@param cache_size The size of the cache
+//! @param memory_size The size of the memory
+//! @param access_times The amount of memory accesses
+void unit_test_4(int cache_size, int memory_size, int access_times);
+
+//! @brief Test with byte-weighted capacity: elements weigh from 100 B to 1 MB
+//! @brief and the resident weight must never exceed the budget
+//!	@param cache_bytes The size of the cache in bytes
+//! @param memory_size The size of the memory
+//! @param access_times The amount of memory accesses
+void unit_test_5(size_t cache_bytes, int memory_size, int access_times);
+
+//! @brief Test with TTL: the clock ticks once per access, every element lives
+//! @brief 'ttl' ticks since it was loaded and must never be hit after that
+//!	@param cache_size The size of the cache
+//! @param memory_size The size of the memory
+//! @param access_times The amount of memory accesses
+//! @param ttl The time to live of the elements in ticks
+void unit_test_6(int cache_size, int memory_size, int access_times, int ttl);
+
+//! @brief Test with the warm restart: the cache is saved to the snapshot halfway,
+//! @brief the restored cache must hit the rest of the accesses like the original one
+//!	@param cache_size The size of the cache
+//! @param memory_size The size of the memory
+//! @param access_times The amount of memory accesses
+void unit_test_7(int cache_size, int memory_size, int access_times);
+
+//! @brief Test with the synthetic workload: zipf, scans with the hot set, a loop
+//! @brief and the shifting working set (see workloadGen.h) for ARC and CAR.
+//! @brief The same seed must give the same keys
+//!	@param cache_size The size of the cache
+//! @param phase_accesses The amount of accesses of every phase
+//! @param seed The seed of the workload
+void unit_test_8(int cache_size, uint64_t phase_accesses, uint64_t seed);
+
+//! @brief Test with the write-back backend (see backingStore.h): a part of the
+//! @brief accesses write new values, every read must return the last written
+//! @brief value and the memory must have all of them after the final flush.
+//! @brief Runs ARC and LRU (written back through the eviction hook of policyBase)
+//!	@param cache_size The size of the cache
+//! @param memory_size The size of the memory
+//! @param access_times The amount of memory accesses
+void unit_test_9(int cache_size, int memory_size, int access_times);
+
+//! @brief Test with the eviction listener: evicted and expired entries go through
+//! @brief evictionQueue to the background thread, every entry must come with its
+//! @brief own element and the counts of reasons must match the counters of ARC
+//!	@param cache_size The size of the cache
+//! @param memory_size The size of the memory
+//! @param access_times The amount of memory accesses
+//! @param ttl The time to live of the elements in ticks
+void unit_test_10(int cache_size, int memory_size, int access_times, int ttl);
+
 //! @brief Test cache with input data
 //! @param type variable needed only for the type of keys for the cache
 template<class KeyT>
 void input_test(KeyT type) {
 	// For output
 	int arc_hit_count = 0;
+	int car_hit_count = 0;
 	int bel_hit_count = 0;
 	float percent = 0;
 
@@ -48,6 +106,7 @@ void input_test(KeyT type) {
 	std::cin >> memory_size;
 
 	ARCache<beladyData<int, KeyT>, KeyT> arc_cache(cache_size);
+	CARCache<beladyData<int, KeyT>, KeyT> car_cache(cache_size);
 	Memory<beladyData<int, KeyT>> memory(memory_size);
 
 	for (int i = 0; i < memory_size; i++) {
@@ -63,6 +122,8 @@ void input_test(KeyT type) {
 	for (int i = 0; i < memory_size; i++) {
 		if (arc_cache.lookup(&memory.data[i]))
 			arc_hit_count++;
+		if (car_cache.lookup(&memory.data[i]))
+			car_hit_count++;
 		if (belady_cache.lookup(&memory.data[i]))
 			bel_hit_count++;
 		// std::cout << "The element is " << memory.data[i].data << "\n";
@@ -74,6 +135,10 @@ void input_test(KeyT type) {
 	std::cout << "ARC: hits - " << arc_hit_count
 			<< ", total amount of requests - " << memory_size << " ("
 			<< std::setprecision(3) << percent << "%)" << "\n";
+	percent = ((float) car_hit_count) * 100.f / memory_size;
+	std::cout << "CAR: hits - " << car_hit_count
+			<< ", total amount of requests - " << memory_size << " ("
+			<< std::setprecision(3) << percent << "%)" << "\n";
 	percent = ((float) bel_hit_count) * 100.f / memory_size;
 	std::cout << "BELADY: hits - " << bel_hit_count
 				<< ", total amount of requests - " << memory_size << " ("
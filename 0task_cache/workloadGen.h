@@ -0,0 +1,365 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//! @brief Zipf distribution over ranks 1..n: the rank k is drawn with the
+//! probability proportional to 1 / k^skew. Sampled by rejection-inversion
+//! (Hormann and Derflinger), so a sample costs O(1) and no table of n
+//! probabilities is kept - n may be billions. Skew 0 is the uniform distribution
+class zipfDistribution {
+	uint64_t n;
+	double skew;
+
+	double h_integral_x1;
+	double h_integral_n;
+	double s;
+
+	//! (exp(x) - 1) / x and log(1 + x) / x, precise near 0
+	static double expm1Ratio(double x);
+	static double log1pRatio(double x);
+
+	//! The integral of 1 / x^skew and its inverse
+	double hIntegral(double x) const;
+	double hIntegralInverse(double x) const;
+	double h(double x) const;
+public:
+	zipfDistribution(uint64_t n, double skew);
+
+	//! The rank from 1 to n
+	template<class Generator>
+	uint64_t operator()(Generator &gen) const;
+};
+
+inline zipfDistribution::zipfDistribution(uint64_t n, double skew) :
+		n(std::max<uint64_t>(1, n)), skew(skew) {
+	assert(skew >= 0);
+
+	h_integral_x1 = hIntegral(1.5) - 1;
+	h_integral_n = hIntegral(this->n + 0.5);
+	s = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+}
+
+inline double zipfDistribution::expm1Ratio(double x) {
+	return (std::abs(x) > 1e-8) ? std::expm1(x) / x : 1 + x / 2;
+}
+
+inline double zipfDistribution::log1pRatio(double x) {
+	return (std::abs(x) > 1e-8) ? std::log1p(x) / x : 1 - x / 2;
+}
+
+inline double zipfDistribution::hIntegral(double x) const {
+	double log_x_ = std::log(x);
+
+	return expm1Ratio((1 - skew) * log_x_) * log_x_;
+}
+
+inline double zipfDistribution::hIntegralInverse(double x) const {
+	// Rounding may take the argument a bit below -1
+	double t_ = std::max(-1.0, x * (1 - skew));
+
+	return std::exp(log1pRatio(t_) * x);
+}
+
+inline double zipfDistribution::h(double x) const {
+	return std::exp(-skew * std::log(x));
+}
+
+//! @brief Uniform double in [0, 1) from the 53 high bits of the 64-bit generator
+//! (std::uniform_real_distribution costs several times more)
+template<class Generator>
+inline double uniformUnit(Generator &gen) {
+	return (gen() >> 11) * (1.0 / (uint64_t(1) << 53));
+}
+
+template<class Generator>
+inline uint64_t zipfDistribution::operator()(Generator &gen) const {
+	while (true) {
+		double u_ = h_integral_n + uniformUnit(gen) * (h_integral_x1 - h_integral_n);
+		double x_ = hIntegralInverse(u_);
+		double k_ = std::floor(x_ + 0.5);
+
+		k_ = std::min(std::max(k_, 1.0), (double) n);
+
+		if (k_ - x_ <= s || u_ >= hIntegral(k_ + 0.5) - h(k_))
+			return static_cast<uint64_t>(k_);
+	}
+}
+
+//! @brief Access patterns of workloadGenerator
+enum workloadKind {
+	//! Zipf over 'keys' keys (key 0 is the hottest one)
+	WORKLOAD_ZIPF,
+	//! 'hot_fraction' of accesses go uniformly to 'hot_keys' keys, the others
+	//! scan the rest of 'keys' keys in order (wrapping around)
+	WORKLOAD_SCAN_HOTSET,
+	//! 'keys' keys accessed in order again and again
+	WORKLOAD_LOOP,
+	//! Zipf over the window of 'keys' keys that slides by 'shift' keys every
+	//! 'shift_period' accesses, so the working set changes gradually
+	WORKLOAD_SHIFTING
+};
+
+//! @brief One phase of the workload. Keys of the phase start from 'base'
+struct workloadPhase {
+	workloadKind kind;
+	uint64_t accesses;
+	uint64_t keys;
+	uint64_t base;
+
+	//! Zipf skew (zipf, shifting)
+	double skew;
+	//! Scan with the hot set
+	uint64_t hot_keys;
+	double hot_fraction;
+	//! Shifting working set
+	uint64_t shift;
+	uint64_t shift_period;
+
+	workloadPhase(workloadKind kind = WORKLOAD_ZIPF, uint64_t accesses = 0,
+			uint64_t keys = 1);
+};
+
+inline workloadPhase::workloadPhase(workloadKind kind, uint64_t accesses,
+		uint64_t keys) :
+		kind(kind), accesses(accesses), keys(std::max<uint64_t>(1, keys)), base(
+				0), skew(1), hot_keys(std::max<uint64_t>(1, keys / 100)), hot_fraction(
+				0.5), shift(std::max<uint64_t>(1, keys / 100)), shift_period(
+				std::max<uint64_t>(1, keys)) {
+}
+
+//! @brief Stream of keys of a synthetic workload: the phases are played one
+//! after another, every key is generated when it is read, so a stream of
+//! billions of accesses takes the memory of one chunk the caller reads into.
+//! The same phases and seed give the same keys, 'reset' starts the stream
+//! over. It reads like traceReader, so the tools that replay traces by chunks
+//! take it as well
+//! @param KeyT - an integer type wide enough for all keys of the phases
+template<class KeyT = long long>
+class workloadGenerator {
+	std::vector<workloadPhase> phases;
+	uint64_t seed;
+
+	std::mt19937_64 gen;
+	zipfDistribution zipf;
+
+	size_t phase;
+	//! Accesses done in the current phase
+	uint64_t done;
+	//! The next key of the scan or the loop
+	uint64_t cursor;
+
+	//! Prepare the distribution of the current phase
+	void startPhase();
+	KeyT next();
+public:
+	//! The amount of accesses of all phases
+	size_t size;
+	//! Always 0 - workloads don't have a cache size
+	size_t cache_size;
+
+	workloadGenerator(const std::vector<workloadPhase> &phases,
+			uint64_t seed = 1);
+
+	//! Write at most 'count' next keys
+	//! @return the amount of keys written, 0 at the end
+	size_t read(KeyT *keys, size_t count);
+	//! Start the stream from the beginning (the same keys again)
+	void reset();
+};
+
+template<class KeyT>
+inline workloadGenerator<KeyT>::workloadGenerator(
+		const std::vector<workloadPhase> &phases, uint64_t seed) :
+		phases(phases), seed(seed), zipf(1, 0), phase(0), done(0), cursor(0), size(
+				0), cache_size(0) {
+	for (const workloadPhase &phase_ : phases)
+		size += phase_.accesses;
+
+	reset();
+}
+
+template<class KeyT>
+inline void workloadGenerator<KeyT>::reset() {
+	gen.seed(seed);
+	phase = 0;
+
+	startPhase();
+}
+
+template<class KeyT>
+inline void workloadGenerator<KeyT>::startPhase() {
+	done = 0;
+	cursor = 0;
+
+	// Skip the empty phases
+	while (phase < phases.size() && phases[phase].accesses == 0)
+		phase++;
+
+	if (phase == phases.size())
+		return;
+
+	const workloadPhase &phase_ = phases[phase];
+
+	if (phase_.kind == WORKLOAD_ZIPF || phase_.kind == WORKLOAD_SHIFTING)
+		zipf = zipfDistribution(phase_.keys, phase_.skew);
+}
+
+template<class KeyT>
+inline KeyT workloadGenerator<KeyT>::next() {
+	const workloadPhase &phase_ = phases[phase];
+	uint64_t key_ = 0;
+
+	switch (phase_.kind) {
+	case WORKLOAD_ZIPF:
+		key_ = zipf(gen) - 1;
+		break;
+	case WORKLOAD_SCAN_HOTSET: {
+		uint64_t hot_keys_ = std::min(phase_.hot_keys, phase_.keys);
+
+		if (hot_keys_ == phase_.keys || uniformUnit(gen) < phase_.hot_fraction) {
+			key_ = gen() % hot_keys_;
+		} else {
+			key_ = hot_keys_ + cursor;
+			cursor = (cursor + 1) % (phase_.keys - hot_keys_);
+		}
+
+		break;
+	}
+	case WORKLOAD_LOOP:
+		key_ = cursor;
+		cursor = (cursor + 1) % phase_.keys;
+		break;
+	case WORKLOAD_SHIFTING:
+		key_ = (done / phase_.shift_period) * phase_.shift + zipf(gen) - 1;
+		break;
+	}
+
+	if (++done == phase_.accesses) {
+		phase++;
+		startPhase();
+	}
+
+	return static_cast<KeyT>(phase_.base + key_);
+}
+
+template<class KeyT>
+inline size_t workloadGenerator<KeyT>::read(KeyT *keys, size_t count) {
+	size_t read_ = 0;
+
+	while (read_ < count && phase < phases.size())
+		keys[read_++] = next();
+
+	return read_;
+}
+
+//! @brief Parse the workload written as phases separated by ';', every phase is
+//! the kind and its parameters: 'kind:name=value,name=value'. The kinds are
+//! zipf, scan (with the hot set), loop and shift; the parameters are accesses,
+//! keys, base, skew, hot_keys, hot_fraction, shift and shift_period (numbers
+//! like 1e9 are fine). For example
+//!   zipf:accesses=1e9,keys=1e7,skew=0.9;scan:accesses=1e6,keys=1e8,hot_keys=1e4
+//! @return false if the text is broken (the error is printed)
+inline bool parseWorkload(const std::string &text,
+		std::vector<workloadPhase> &phases) {
+	std::stringstream phases_(text);
+	std::string phase_text_;
+
+	phases.clear();
+
+	while (std::getline(phases_, phase_text_, ';')) {
+		size_t colon_ = phase_text_.find(':');
+		std::string kind_ = phase_text_.substr(0, colon_);
+		workloadPhase phase_;
+
+		if (kind_ == "zipf")
+			phase_.kind = WORKLOAD_ZIPF;
+		else if (kind_ == "scan")
+			phase_.kind = WORKLOAD_SCAN_HOTSET;
+		else if (kind_ == "loop")
+			phase_.kind = WORKLOAD_LOOP;
+		else if (kind_ == "shift")
+			phase_.kind = WORKLOAD_SHIFTING;
+		else {
+			std::cerr << "Error! Unknown workload " << kind_ << "\n";
+			return false;
+		}
+
+		// The defaults that depend on the amount of keys are set after parsing
+		bool hot_keys_set_ = false;
+		bool shift_set_ = false;
+		bool shift_period_set_ = false;
+
+		std::stringstream params_(
+				(colon_ == std::string::npos) ? "" : phase_text_.substr(colon_ + 1));
+		std::string param_;
+
+		while (std::getline(params_, param_, ',')) {
+			size_t equal_ = param_.find('=');
+
+			if (equal_ == std::string::npos) {
+				std::cerr << "Error! No value of " << param_ << "\n";
+				return false;
+			}
+
+			std::string name_ = param_.substr(0, equal_);
+			char *end_ = nullptr;
+			double value_ = std::strtod(param_.c_str() + equal_ + 1, &end_);
+
+			if (*end_ != '\0' || value_ < 0) {
+				std::cerr << "Error! Wrong value of " << name_ << "\n";
+				return false;
+			}
+
+			if (name_ == "accesses")
+				phase_.accesses = value_;
+			else if (name_ == "keys")
+				phase_.keys = std::max(1.0, value_);
+			else if (name_ == "base")
+				phase_.base = value_;
+			else if (name_ == "skew")
+				phase_.skew = value_;
+			else if (name_ == "hot_keys") {
+				phase_.hot_keys = std::max(1.0, value_);
+				hot_keys_set_ = true;
+			} else if (name_ == "hot_fraction")
+				phase_.hot_fraction = std::min(1.0, value_);
+			else if (name_ == "shift") {
+				phase_.shift = value_;
+				shift_set_ = true;
+			} else if (name_ == "shift_period") {
+				phase_.shift_period = std::max(1.0, value_);
+				shift_period_set_ = true;
+			} else {
+				std::cerr << "Error! Unknown parameter " << name_ << "\n";
+				return false;
+			}
+		}
+
+		workloadPhase defaults_(phase_.kind, phase_.accesses, phase_.keys);
+
+		if (!hot_keys_set_)
+			phase_.hot_keys = defaults_.hot_keys;
+		if (!shift_set_)
+			phase_.shift = defaults_.shift;
+		if (!shift_period_set_)
+			phase_.shift_period = defaults_.shift_period;
+
+		phases.push_back(phase_);
+	}
+
+	if (phases.empty()) {
+		std::cerr << "Error! The workload has no phases\n";
+		return false;
+	}
+
+	return true;
+}